@@ -0,0 +1,156 @@
+/**
+ * @file acquisition.h
+ * @brief ADS1115 acquisition front-end: single-shot polling, continuous
+ *        conversion paced by the ALERT/RDY pin, hardware window comparator,
+ *        or a round-robin scan over several mux inputs, on one or several
+ *        converters sharing the I2C bus.
+ */
+
+#ifndef ACQUISITION_H
+#define ACQUISITION_H
+
+#include <stdint.h>
+#include <time.h>
+#include <gpiod.h>
+#include "ads1115_rpi.h"
+#include "autorange.h"
+#include "sample.h"
+
+#define ACQ_I2C_BUS   "/dev/i2c-1"
+#define ACQ_GPIO_CHIP "/dev/gpiochip0"
+#define ACQ_RDY_GPIO  27   /**< Default GPIO wired to the first ADS1115 ALERT/RDY pin */
+#define ACQ_RDY_TIMEOUT_MS 100
+#define ACQ_WINDOW_POLL_MS 10  /**< Default stream period while the comparator watches thresholds */
+#define ACQ_MAX_SCAN 8         /**< Maximum number of entries in the scan list */
+#define ACQ_MAX_DEVICES 4      /**< One ADS1115 per address 0x48..0x4B */
+
+#define ACQ_EXCURSION 1        /**< acq_read() result: window mode sample outside the comparator thresholds */
+
+/**
+ * @brief Acquisition modes selectable with the ADC_MODE env variable.
+ */
+enum AcqMode {
+    ACQ_MODE_SINGLE,   /**< One single-shot conversion per sample, polled over I2C */
+    ACQ_MODE_CONTIN,   /**< Continuous conversion, one register read per RDY edge */
+    ACQ_MODE_WINDOW,   /**< Continuous conversion, ALERT latched by the window comparator */
+    ACQ_MODE_SCAN      /**< Round-robin single-shot conversions over the scan list */
+};
+
+/**
+ * @brief One input of the scan list, with its own gain and data rate.
+ */
+struct ScanEntry {
+    char label[8];           /**< Input name as given in ADC_SCAN ("0", "2-3"...) */
+    unsigned int mux;        /**< CONFIG_REG_MUX_* */
+    unsigned int pga;        /**< CONFIG_REG_PGA_* */
+    unsigned int data_rate;  /**< CONFIG_REG_DR_* */
+};
+
+/**
+ * @brief Acquisition settings.
+ */
+struct AcqConfig {
+    enum AcqMode mode;
+    int channel;
+    unsigned int pga;        /**< CONFIG_REG_PGA_* */
+    unsigned int data_rate;  /**< CONFIG_REG_DR_* */
+    float v_high_thr;        /**< Window comparator limits (ACQ_MODE_WINDOW) */
+    float v_low_thr;
+    int poll_ms;             /**< Stream period in ACQ_MODE_WINDOW */
+    int autorange;           /**< Automatic PGA selection (contin/scan modes) */
+    struct ScanEntry scan[ACQ_MAX_SCAN];
+    int scan_len;            /**< Entries in scan[] (ACQ_MODE_SCAN) */
+    int num_devices;
+    unsigned char addrs[ACQ_MAX_DEVICES];   /**< I2C address of each converter */
+    int rdy_gpios[ACQ_MAX_DEVICES];         /**< GPIO wired to each ALERT/RDY pin */
+};
+
+/**
+ * @brief Per-converter context: its own bus handle, RDY line, scan position
+ *        and counters.
+ */
+struct AcqDevice {
+    struct ADS1115 adc;
+    struct gpiod_line *line;
+    int scan_pos;                 /**< Scan entry whose conversion is in progress */
+    struct AutoRange range[ACQ_MAX_SCAN]; /**< Current gain of each input (fixed unless autorange) */
+    int settle;                   /**< Conversions to drop after a gain change in continuous mode */
+    unsigned long missed;         /**< RDY edges that arrived before we read the previous sample */
+    unsigned long excursions;     /**< ALERT edges latched by the window comparator */
+    unsigned long stale_alerts;   /**< ALERT edges whose conversion was already back inside */
+    int16_t win_lo, win_hi;       /**< Window comparator thresholds, counts */
+    unsigned long ch_count[ACQ_MAX_SCAN];
+    double ch_rate_sps[ACQ_MAX_SCAN]; /**< Last measured samples/s per scan entry */
+};
+
+/**
+ * @brief Acquisition runtime state, including the samples/s counters.
+ */
+struct AcqState {
+    struct AcqConfig cfg;
+    struct AcqDevice dev[ACQ_MAX_DEVICES];
+    struct gpiod_chip *chip;
+    struct gpiod_line_bulk lines;
+    unsigned int ready;           /**< Devices signalled by the last wait, not yet serviced */
+    unsigned int periodic;        /**< ready[] came from a poll timeout, not from ALERT */
+    int next_dev;                 /**< Round-robin cursor for single-shot mode */
+    unsigned long rate_count;     /**< Samples since the last rate report */
+    unsigned long gpio_syscalls;  /**< RDY waits and event reads */
+    unsigned long last_syscalls;  /**< I2C + GPIO syscalls at the last rate report */
+    unsigned long last_transactions; /**< I2C transactions at the last rate report */
+    struct timespec rate_t0;
+    double rate_sps;              /**< Last measured aggregate samples/s */
+};
+
+/**
+ * @brief Fills @p cfg with defaults overridden by ADC_MODE (single|contin|window|scan),
+ *        ADC_CHANNEL, ADC_ADDRS, ADC_RDY_GPIO, ADC_POLL_MS, ADC_SCAN and
+ *        ADC_AUTORANGE environment variables. Thresholds must be filled in
+ *        by the caller.
+ *
+ * ADC_SCAN is a comma separated list of input[:fullscale_V[:sps]] entries,
+ * e.g. "0:4.096:860,1,2-3:0.512:475". Inputs are 0..3 or the differential
+ * pairs 0-1, 0-3, 1-3, 2-3. ADC_ADDRS ("0x48,0x49") and ADC_RDY_GPIO
+ * ("27,22") list one address and one RDY GPIO per converter.
+ *
+ * @return 0 on success, -1 if the configuration cannot be parsed.
+ */
+int acq_load_env(struct AcqConfig *cfg);
+
+/**
+ * @brief Nominal sample rate of each converter/input stream, in Hz.
+ *
+ * In ACQ_MODE_SCAN an input gets one conversion per pass over the scan
+ * list, so its rate is 1 / sum(1 / rate of each entry); in ACQ_MODE_SINGLE
+ * the converters take turns; in ACQ_MODE_WINDOW the stream is the poll.
+ */
+double acq_input_rate(const struct AcqConfig *cfg);
+
+/**
+ * @brief Opens every converter and its ALERT/RDY GPIO line and starts them.
+ * @return 0 on success, -1 on failure.
+ */
+int acq_init(struct AcqState *st, const struct AcqConfig *cfg);
+
+/**
+ * @brief Blocks until the next conversion from any converter is available.
+ *
+ * All converters run concurrently; one wait collects every RDY edge that
+ * fired and the ready devices are then serviced in turn, so the bus is
+ * kept busy reading one chip while the others convert. In ACQ_MODE_WINDOW
+ * a sample is taken every poll_ms, or immediately when the comparator
+ * latches ALERT; the read also clears the latch. In ACQ_MODE_SCAN the next
+ * entry's conversion is started before the previous result is read back,
+ * so mux settling overlaps the I2C readout.
+ *
+ * @return 0 on a regular sample, ACQ_EXCURSION when the window comparator
+ *         fired, -1 on timeout or I/O error.
+ */
+int acq_read(struct AcqState *st, struct AdcSample *sample);
+
+/**
+ * @brief Releases the GPIO lines and closes every converter.
+ */
+void acq_cleanup(struct AcqState *st);
+
+#endif // ACQUISITION_H
@@ -1,6 +1,16 @@
 #ifndef ADS1115_RPI
 #define ADS1115_RPI
 
+#include <stdint.h>
+
+/*=========================================================================
+POINTER REGISTER
+-----------------------------------------------------------------------*/
+#define REG_CONVERSION				(0x00)
+#define REG_CONFIG					(0x01)
+#define REG_LO_THRESH				(0x02)
+#define REG_HI_THRESH				(0x03)
+
 /*=========================================================================
 CONFIG REGISTER
 -----------------------------------------------------------------------*/
@@ -41,18 +51,66 @@ CONFIG REGISTER
 #define CONFIG_REG_CMODE_WINDOW		(0x0010)
 
 #define CONFIG_REG_CPOL_ACTIV_LOW	(0x0000) // default
-#define CONFIG_REG_CPOL_ACTIV_HIGH	(0x0080)
+#define CONFIG_REG_CPOL_ACTIV_HIGH	(0x0008)
 
 #define CONFIG_REG_CLATCH_NONLATCH	(0x0000) // default
-#define CONFIG_REG_CLATCH_LATCH		(0x0040)
+#define CONFIG_REG_CLATCH_LATCH		(0x0004)
 
 #define CONFIG_REG_CQUE_1CONV		(0x0000)
 #define CONFIG_REG_CQUE_2CONV		(0x0001)
 #define CONFIG_REG_CQUE_4CONV		(0x0002)
 #define CONFIG_REG_CQUE_NONE		(0x0003) // default
 
-int openI2CBus(char *bus);
-int setI2CSlave(unsigned char deviceAddr);
-float readVoltage(int channel);
+#define CONFIG_REG_PGA_MASK			(0x0E00)
+#define CONFIG_REG_DR_MASK			(0x00E0)
+
+#define ADS1115_ADDR_GND			(0x48) // ADDR pin to GND
+#define ADS1115_ADDR_VDD			(0x49)
+#define ADS1115_ADDR_SDA			(0x4A)
+#define ADS1115_ADDR_SCL			(0x4B)
+
+/*=========================================================================
+DEVICE CONTEXT
+-----------------------------------------------------------------------*/
+struct ADS1115 {
+	int fd;						// Own descriptor on the bus, bound to addr with I2C_SLAVE
+	unsigned char addr;
+	unsigned int config;		// Last value written to the config register
+	unsigned int regs[4];		// Register cache, indexed by pointer value
+	unsigned char regsValid;	// Bit n set when regs[n] mirrors the device
+	unsigned char pointer;		// Register the pointer currently selects
+	unsigned char pointerValid;
+	unsigned long syscalls;		// ioctl(I2C_RDWR) calls issued
+	unsigned long transactions;	// Bus transactions (one START..STOP each)
+	unsigned long skippedWrites;// Register writes avoided by the cache
+};
+
+int openI2CBus(struct ADS1115 *dev, char *bus);
+int setI2CSlave(struct ADS1115 *dev, unsigned char deviceAddr);
+void closeI2CBus(struct ADS1115 *dev);
+int readRaw(struct ADS1115 *dev, int channel, int16_t *raw);
+float readVoltage(struct ADS1115 *dev, int channel);
+
+/*=========================================================================
+CONTINUOUS / COMPARATOR MODES
+-----------------------------------------------------------------------*/
+int writeRegister(struct ADS1115 *dev, unsigned char reg, unsigned int value);
+int writeRegisterCached(struct ADS1115 *dev, unsigned char reg, unsigned int value);
+int readRegister(struct ADS1115 *dev, unsigned char reg, unsigned int *value);
+unsigned int channelMux(int channel);
+int startContinuous(struct ADS1115 *dev, int channel, unsigned int pga, unsigned int dataRate);
+int startWindowComparator(struct ADS1115 *dev, int channel, unsigned int pga,
+						  unsigned int dataRate, int16_t loThresh, int16_t hiThresh);
+int readConversion(struct ADS1115 *dev, int16_t *raw);
+int setConversionReady(struct ADS1115 *dev);
+int startSingleShot(struct ADS1115 *dev, unsigned int mux, unsigned int pga, unsigned int dataRate);
+int readLastConversion(struct ADS1115 *dev, int16_t *raw);
+float pgaFullScale(unsigned int pga);
+float rawToVoltage(int16_t raw, unsigned int pga);
+int16_t voltageToRaw(float voltage, unsigned int pga);
+unsigned int dataRateSps(unsigned int dataRate);
+unsigned int dataRateFromSps(unsigned int sps);
+unsigned int pgaFromVolts(float fullScale);
+int muxFromName(const char *name, unsigned int *mux);
 
 #endif
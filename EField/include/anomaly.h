@@ -0,0 +1,87 @@
+/**
+ * @file anomaly.h
+ * @brief Adaptive excursion thresholds from a rolling quantile baseline.
+ *
+ * Each converter/input keeps its recent distribution in two quantile
+ * sketches (quantile.h) that each cover half of ANOM_WINDOW_S; when the
+ * current half is full the older one is cleared and takes over, so the
+ * baseline always spans between one half and one whole window with fixed
+ * memory. Every ANOM_UPDATE_S the halves are merged and summarised as:
+ *
+ *   median, sigma = max(IQR / 1.349, ANOM_MIN_SIGMA_V)
+ *   high = median + ANOM_Z * sigma,  low = median - ANOM_Z * sigma
+ *
+ * and, if ANOM_PCT is set (e.g. 99.9), the thresholds are widened to the
+ * ANOM_PCT and 100 - ANOM_PCT percentiles. Either test can be switched off
+ * with 0. Alerting starts once the first half window is complete. Off
+ * unless ANOM=1: its alerts share the alert topic with the fixed ones.
+ *
+ * The thresholds drive an excursion tracker (excursion.h) with the dwell
+ * and update period of the fixed ones and a release level one sigma
+ * inside. While an excursion is open its samples stay out of the sketches,
+ * so an anomaly does not become its own baseline.
+ */
+
+#ifndef ANOMALY_H
+#define ANOMALY_H
+
+#include <stdint.h>
+#include "excursion.h"
+#include "quantile.h"
+#include "sample.h"
+
+/**
+ * @brief Settings (ANOM, ANOM_Z, ANOM_PCT, ANOM_MIN_SIGMA_V, ANOM_WINDOW_S,
+ *        ANOM_UPDATE_S).
+ */
+struct AnomalyConfig {
+    int enabled;
+    float z;                 /**< Robust z-score limit, 0 = off */
+    float pct;               /**< Percentile limit, 0 = off */
+    float min_sigma_v;
+    uint64_t half_ns;        /**< Half of the baseline window */
+    uint64_t update_ns;
+    uint64_t dwell_ns;       /**< From the fixed excursion settings */
+    uint64_t exc_update_ns;
+};
+
+struct AnomalyBaseline {
+    int valid;
+    float median;
+    float sigma;
+    float thr_low, thr_high;
+};
+
+struct AnomalyDetector {
+    struct QSketch half[2];
+    int cur;                 /**< Half being filled */
+    int have_prev;           /**< The other half holds a complete half window */
+    uint64_t half_start_ns;
+    uint64_t next_update_ns;
+    int started;
+    struct AnomalyBaseline base;
+    struct ExcursionConfig exc;
+    struct ExcursionTracker tr;
+};
+
+/**
+ * @brief Reads the environment and prints the settings; dwell and update
+ *        period are taken from @p exc.
+ */
+void anomaly_load_env(struct AnomalyConfig *cfg, const struct ExcursionConfig *exc);
+
+void anomaly_init(struct AnomalyDetector *d);
+
+/**
+ * @brief Feeds one sample of the detector's stream.
+ * @return 1 if @p ev was filled with an excursion event, 0 otherwise.
+ */
+int anomaly_add(struct AnomalyDetector *d, const struct AnomalyConfig *cfg, const struct AdcSample *s,
+                struct ExcursionEvent *ev);
+
+/**
+ * @brief Robust z-score of @p v against the current baseline.
+ */
+float anomaly_z(const struct AnomalyDetector *d, float v);
+
+#endif // ANOMALY_H
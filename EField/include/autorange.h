@@ -0,0 +1,44 @@
+/**
+ * @file autorange.h
+ * @brief Automatic PGA selection: keeps each input on the tightest ADS1115
+ *        range that still fits its recent envelope.
+ */
+
+#ifndef AUTORANGE_H
+#define AUTORANGE_H
+
+#include <stdint.h>
+
+#define AR_UP_FRACTION   0.90f  /**< Widen as soon as |raw| reaches this fraction of full scale */
+#define AR_DOWN_FRACTION 0.40f  /**< Narrow when the block peak fits in this fraction of the tighter range */
+#define AR_CALM_BLOCKS   3      /**< Consecutive calm blocks required before narrowing */
+
+/**
+ * @brief Range tracker for one input.
+ */
+struct AutoRange {
+    unsigned int pga;      /**< Current CONFIG_REG_PGA_* */
+    int block_len;         /**< Samples per envelope block */
+    int block_n;           /**< Samples seen in the current block */
+    int block_peak;        /**< Largest |raw| in the current block */
+    int calm_blocks;       /**< Consecutive blocks that would fit the tighter range */
+    unsigned long switches;
+};
+
+/**
+ * @brief Starts tracking at range @p pga with envelope blocks of @p block_len samples.
+ */
+void autorange_init(struct AutoRange *ar, unsigned int pga, int block_len);
+
+/**
+ * @brief Feeds one conversion taken at ar->pga.
+ *
+ * Widening is immediate when the sample approaches clipping; narrowing
+ * needs AR_CALM_BLOCKS blocks in a row whose peak would stay below
+ * AR_DOWN_FRACTION of the tighter range, so the range does not thrash.
+ *
+ * @return 1 if ar->pga changed and must be programmed, 0 otherwise.
+ */
+int autorange_update(struct AutoRange *ar, int16_t raw);
+
+#endif // AUTORANGE_H
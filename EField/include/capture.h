@@ -0,0 +1,175 @@
+/**
+ * @file capture.h
+ * @brief Native binary capture format (.efb).
+ *
+ * A capture file is a sequence of fixed-size 4 KiB blocks. Each block holds
+ * up to CAP_BLOCK_SAMPLES raw int16 conversions of one input of one
+ * converter at one gain, uniformly spaced by period_ns from start_mono_ns,
+ * plus a CRC32 over the whole block. All fields are little-endian and the
+ * layout is naturally aligned, so a reader can mmap() the file and use the
+ * blocks in place.
+ *
+ * Blocks flagged CAP_FLAG_PACKED carry a Gorilla-style bit stream instead
+ * of the plain array: the first count as 16 bits, then for every further
+ * sample the delta-of-delta of its timestamp and the zigzag delta of its
+ * count, each in a prefix-coded bucket (MSB first):
+ *
+ *   timestamp dod  '0' = 0 | '10'+4 | '110'+9 | '1110'+12 | '1111'+32 bits
+ *   count delta    '0' = 0 | '10'+3 | '110'+6 | '1110'+10 | '1111'+17 bits
+ *
+ * The buckets are sized for ADC noise of a few counts and conversion
+ * jitter of a few ticks. Timestamps are rounded to tick_ns units from
+ * start_mono_ns, so they keep the real sample-to-sample jitter down to
+ * that resolution; counts are lossless. Every block decodes on its own,
+ * so random access stays at block granularity.
+ *
+ * An event capture (evcapture.h) is a file of the same blocks that starts
+ * with one block flagged CAP_FLAG_EVENT: it has no samples (count 0) and
+ * its payload is a struct CaptureEventInfo describing the trigger and the
+ * window, so the file is self-contained and older readers just skip it.
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CAP_MAGIC         0x31424645u   /**< "EFB1" */
+#define CAP_VERSION       1
+#define CAP_BLOCK_SIZE    4096
+#define CAP_HEADER_SIZE   64
+#define CAP_BLOCK_SAMPLES ((CAP_BLOCK_SIZE - CAP_HEADER_SIZE) / 2)
+#define CAP_PAYLOAD_BITS  ((CAP_BLOCK_SIZE - CAP_HEADER_SIZE) * 8)
+
+#define CAP_FLAG_PACKED   0x01   /**< Payload is the delta-of-delta bit stream */
+#define CAP_FLAG_EVENT    0x02   /**< Payload is a struct CaptureEventInfo */
+
+/**
+ * @brief Block header, 64 bytes.
+ */
+struct CaptureBlockHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;     /**< CAP_HEADER_SIZE */
+    uint64_t start_mono_ns;   /**< CLOCK_MONOTONIC of the first sample */
+    int64_t  start_utc_ns;    /**< Wall-clock time of the first sample */
+    uint32_t period_ns;       /**< Mean spacing between samples */
+    uint16_t count;           /**< Samples in the payload */
+    uint8_t  channel;         /**< Scan entry index */
+    uint8_t  device;          /**< Converter index */
+    uint8_t  pga;             /**< CONFIG_REG_PGA_* >> 9 */
+    uint8_t  flags;           /**< CAP_FLAG_* */
+    uint16_t payload_bits;    /**< Bits used by a packed payload */
+    float    lsb_volts;       /**< Volts per count at this gain */
+    uint32_t seq;             /**< Block number within the file */
+    uint32_t tick_ns;         /**< Timestamp resolution of a packed payload */
+    uint8_t  reserved[12];
+    uint32_t crc32;           /**< CRC32 of the block with this field set to 0 */
+};
+
+/**
+ * @brief One block as stored on disk.
+ */
+struct CaptureBlock {
+    struct CaptureBlockHeader h;
+    int16_t samples[CAP_BLOCK_SAMPLES];
+};
+
+/**
+ * @brief Payload of the CAP_FLAG_EVENT block of an event capture.
+ *
+ * The block header's start_mono_ns / start_utc_ns are the start of the
+ * window, and its device / channel those of the triggering input.
+ */
+struct CaptureEventInfo {
+    uint64_t trigger_mono_ns;
+    int64_t  trigger_utc_ns;
+    uint64_t end_mono_ns;     /**< Last sample of the window */
+    uint32_t samples;         /**< In the whole file, all inputs */
+    uint16_t triggers;        /**< Triggers merged into this window */
+    uint8_t  source;          /**< CAP_EVENT_* of the first trigger */
+    uint8_t  side;            /**< Excursion side or step sign (+1 / -1 as int8) */
+    float    value;           /**< Triggering voltage, or step amplitude */
+    uint32_t pre_ms;          /**< Configured pre- and post-trigger time */
+    uint32_t post_ms;
+    uint8_t  reserved[16];
+};
+
+enum CaptureEventSource {
+    CAP_EVENT_EXCURSION = 1,
+    CAP_EVENT_TRANSIENT = 2
+};
+
+_Static_assert(sizeof(struct CaptureBlockHeader) == CAP_HEADER_SIZE, "capture header size");
+_Static_assert(sizeof(struct CaptureBlock) == CAP_BLOCK_SIZE, "capture block size");
+
+/**
+ * @brief Encoder state for one packed block.
+ */
+struct CapturePacker {
+    uint8_t *buf;
+    uint32_t bits;
+    uint64_t start_ns;
+    uint32_t tick_ns;
+    uint64_t last_tick;
+    int64_t last_delta;
+    int16_t last_raw;
+};
+
+/**
+ * @brief Decoder state for one packed block.
+ */
+struct CaptureUnpacker {
+    const uint8_t *buf;
+    uint32_t bits;
+    uint32_t end_bits;
+    uint16_t left;
+    uint64_t last_tick;
+    int64_t last_delta;
+    int16_t last_raw;
+};
+
+/**
+ * @brief CRC32 (IEEE 802.3) of @p len bytes, continuing from @p crc.
+ */
+uint32_t capture_crc32(uint32_t crc, const void *data, size_t len);
+
+/**
+ * @brief Fills in crc32 for a complete block.
+ */
+void capture_block_seal(struct CaptureBlock *b);
+
+/**
+ * @brief Checks magic, version, count and CRC.
+ * @return 1 if the block is valid, 0 otherwise.
+ */
+int capture_block_valid(const struct CaptureBlock *b);
+
+/**
+ * @brief Starts a packed payload in @p b with its first sample.
+ *
+ * The header's start_mono_ns must already hold @p t_ns.
+ */
+void capture_pack_begin(struct CapturePacker *p, struct CaptureBlock *b, uint64_t t_ns, int16_t raw,
+                        uint32_t tick_ns);
+
+/**
+ * @brief Appends one sample to a packed block.
+ * @return 1 if it was stored, 0 if the block is full (or the gap does not
+ *         fit in 32 bits) and a new block must be started.
+ */
+int capture_pack_append(struct CapturePacker *p, struct CaptureBlock *b, uint64_t t_ns, int16_t raw);
+
+/**
+ * @brief Prepares to iterate over a packed or plain block.
+ */
+void capture_unpack_begin(struct CaptureUnpacker *u, const struct CaptureBlock *b);
+
+/**
+ * @brief Returns the next sample of the block.
+ * @return 1 if a sample was produced, 0 at the end of the block.
+ */
+int capture_unpack_next(struct CaptureUnpacker *u, const struct CaptureBlock *b, uint64_t *t_ns, int16_t *raw);
+
+#endif // CAPTURE_H
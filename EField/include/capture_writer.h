@@ -0,0 +1,98 @@
+/**
+ * @file capture_writer.h
+ * @brief Binary capture sink (.efb) running on its own thread.
+ *
+ * Samples are grouped per converter/input into 4 KiB blocks (see capture.h).
+ * A block is closed when it is full, when the gain changes, when the sample
+ * spacing breaks (missed conversions), or when it gets older than
+ * flush_ms; closed blocks are written in batches of CAPW_WRITE_BLOCKS.
+ * With the packed codec a block instead closes when its bit stream is full,
+ * and gaps are simply encoded in the timestamps. Segments rotate between
+ * write() calls, so every .efb segment holds whole blocks.
+ */
+
+#ifndef CAPTURE_WRITER_H
+#define CAPTURE_WRITER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "capture.h"
+#include "ringbuf.h"
+#include "timebase.h"
+#include "acquisition.h"
+#include "segments.h"
+
+#define CAPW_MAX_STREAMS  (ACQ_MAX_DEVICES * ACQ_MAX_SCAN)
+#define CAPW_WRITE_BLOCKS 16     /**< Blocks per write() (64 KiB) */
+
+/**
+ * @brief Writer settings (CAP_CODEC, CAP_TICK_NS, CAP_FLUSH_MS, CAP_SYNC_MS, CAP_RING).
+ */
+struct CaptureWriterConfig {
+    int packed;          /**< 1: delta-of-delta bit stream, 0: plain int16 array */
+    uint32_t tick_ns;    /**< Timestamp resolution of packed blocks */
+    int flush_ms;        /**< Max age of an open block before it is written partially filled */
+    int sync_ms;         /**< fdatasync period; 0 leaves durability to the kernel */
+    size_t ring_slots;   /**< Batches queued between acquisition and writer */
+};
+
+/**
+ * @brief Block being filled for one converter/input.
+ */
+struct CaptureStream {
+    struct CaptureBlock *block;
+    uint64_t last_ns;       /**< t_ns of the last sample appended */
+    uint64_t spacing_ns;    /**< First interval of the block, used to detect gaps */
+    struct CapturePacker pk;
+};
+
+struct CaptureWriter {
+    struct CaptureWriterConfig cfg;
+    struct SpscRing ring;
+    pthread_t thread;
+    atomic_int running;
+    struct SegmentIndex *segs;
+    struct Segment seg;
+    char prefix[32];
+    struct CaptureBlock *blocks;   /**< CAPW_MAX_STREAMS open blocks + CAPW_WRITE_BLOCKS output */
+    struct CaptureStream streams[CAPW_MAX_STREAMS];
+    struct CaptureBlock *out;
+    size_t out_n;
+    uint32_t seq;
+    struct TimeAnchor anchor;
+    uint64_t last_sync_ns;
+    int dirty;
+    unsigned long blocks_written;
+    unsigned long long samples_written;
+    unsigned long long lost_bytes;  /**< Not written because write() failed */
+};
+
+/**
+ * @brief Reads the writer settings from the environment.
+ */
+void capture_writer_load_env(struct CaptureWriterConfig *cfg);
+
+/**
+ * @brief Opens the first <prefix>_*.efb segment in @p segs and starts the
+ *        writer thread.
+ * @return 0 on success, -1 on failure.
+ */
+int capture_writer_open(struct CaptureWriter *w, const struct CaptureWriterConfig *cfg,
+                        struct SegmentIndex *segs, const char *prefix);
+
+/**
+ * @brief Producer side: queues one sample. Never blocks.
+ */
+void capture_writer_push(struct CaptureWriter *w, const struct AdcSample *s);
+
+/**
+ * @brief Producer side: hands over a partial batch when acquisition is idle.
+ */
+void capture_writer_idle(struct CaptureWriter *w, uint64_t now_ns);
+
+/**
+ * @brief Drains the queue, writes every open block, syncs and closes the segment.
+ */
+void capture_writer_close(struct CaptureWriter *w);
+
+#endif // CAPTURE_WRITER_H
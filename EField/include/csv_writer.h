@@ -0,0 +1,95 @@
+/**
+ * @file csv_writer.h
+ * @brief CSV sink running on its own thread.
+ *
+ * The acquisition thread hands samples over through an SPSC ring; the
+ * writer formats them into a large buffer, issues big sequential write()
+ * calls and applies the durability policy (periodic fdatasync), so storage
+ * stalls never reach the sampling loop. Output goes to rolling segments
+ * (segments.h); each one starts with the header and a time anchor. The
+ * writer thread reports its counters and write()/fdatasync() latency
+ * histogram once a minute.
+ */
+
+#ifndef CSV_WRITER_H
+#define CSV_WRITER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "ringbuf.h"
+#include "timebase.h"
+#include "histogram.h"
+#include "segments.h"
+
+#define CSV_ROW_MAX 128
+
+/**
+ * @brief Formats one sample as a CSV row (with trailing newline).
+ * @param n Room left in the buffer, at least CSV_ROW_MAX.
+ * @return snprintf() result; a row longer than @p n - 1 is kept truncated.
+ */
+typedef int (*csv_row_fn)(char *dst, size_t n, const struct AdcSample *s, void *ctx);
+
+/**
+ * @brief Writer settings (CSV_BUF_KB, CSV_FLUSH_MS, CSV_SYNC_MS, CSV_RING).
+ */
+struct CsvWriterConfig {
+    size_t buf_size;     /**< Bytes accumulated before a write() */
+    int flush_ms;        /**< Max age of buffered rows before they are written anyway */
+    int sync_ms;         /**< fdatasync period; 0 leaves durability to the kernel */
+    size_t ring_slots;   /**< Batches queued between acquisition and writer */
+};
+
+struct CsvWriter {
+    struct CsvWriterConfig cfg;
+    struct SpscRing ring;
+    pthread_t thread;
+    atomic_int running;
+    struct SegmentIndex *segs;
+    struct Segment seg;
+    char prefix[32];
+    char header[128];
+    char *buf;
+    size_t len;
+    csv_row_fn format_row;
+    void *ctx;
+    struct TimeAnchor anchor;
+    uint64_t last_write_ns;
+    uint64_t last_sync_ns;
+    int dirty;                  /**< Data written since the last fdatasync */
+    unsigned long writes;
+    unsigned long syncs;
+    unsigned long long bytes;
+    unsigned long long lost_bytes;  /**< Not written because write() failed */
+    struct LatencyHist write_lat;   /**< Time spent in write()/fdatasync() */
+};
+
+/**
+ * @brief Reads the writer settings from the environment.
+ */
+void csv_writer_load_env(struct CsvWriterConfig *cfg);
+
+/**
+ * @brief Opens the first <prefix>_*.csv segment in @p segs, writes
+ *        @p header and starts the writer thread.
+ * @return 0 on success, -1 on failure.
+ */
+int csv_writer_open(struct CsvWriter *w, const struct CsvWriterConfig *cfg, struct SegmentIndex *segs,
+                    const char *prefix, const char *header, csv_row_fn format_row, void *ctx);
+
+/**
+ * @brief Producer side: queues one sample. Never blocks.
+ */
+void csv_writer_push(struct CsvWriter *w, const struct AdcSample *s);
+
+/**
+ * @brief Producer side: hands over a partial batch when acquisition is idle.
+ */
+void csv_writer_idle(struct CsvWriter *w, uint64_t now_ns);
+
+/**
+ * @brief Drains the queue, syncs and closes the segment, stops the thread.
+ */
+void csv_writer_close(struct CsvWriter *w);
+
+#endif // CSV_WRITER_H
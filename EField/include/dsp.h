@@ -0,0 +1,145 @@
+/**
+ * @file dsp.h
+ * @brief Block-based filtering and decimation of one sample stream.
+ *
+ * The chain applied to each converter/input, all optional, is
+ *
+ *   notch (biquad at DSP_NOTCH_HZ) -> low-pass (biquad at DSP_IIR_HZ)
+ *     -> low-pass FIR (DSP_FIR_TAPS, cut-off DSP_CUTOFF_HZ) decimating by DSP_DECIM
+ *
+ * The FIR is evaluated in polyphase form: only every DSP_DECIM-th output
+ * is computed, so decimating by M costs M times fewer multiply-adds than
+ * filtering at the input rate and discarding. Averaging M samples of
+ * uncorrelated noise this way gains up to log2(sqrt(M)) effective bits.
+ *
+ * Blocks come in as signed conversion counts and the outputs are counts
+ * too, with their fractional part; the caller applies the volts per count.
+ * The block is widened to float once on entry, since the biquads carry
+ * fractional state from sample to sample.
+ *
+ * The count conversion and the FIR dot product are vectorised with NEON
+ * on aarch64 and have a portable scalar fallback; the biquads are
+ * recursive and stay scalar.
+ * Output timestamps are corrected for the FIR group delay, so a filtered
+ * sample lines up with the raw samples it represents.
+ */
+
+#ifndef DSP_H
+#define DSP_H
+
+#include <stdint.h>
+
+#define DSP_FIR_MAX_TAPS 256
+#define DSP_BLOCK_MAX    256   /**< Samples per dsp_chain_process() call */
+#define DSP_MAX_BIQUADS  2
+
+/**
+ * @brief Chain settings (DSP, DSP_FS_HZ, DSP_DECIM, DSP_FIR_TAPS,
+ *        DSP_CUTOFF_HZ, DSP_IIR_HZ, DSP_NOTCH_HZ, DSP_NOTCH_Q).
+ */
+struct DspConfig {
+    int enabled;
+    double fs_hz;        /**< Sample rate of one input stream */
+    int decim;           /**< Output rate is fs_hz / decim */
+    int fir_taps;        /**< 0 = no FIR (and no decimation) */
+    double cutoff_hz;    /**< FIR cut-off */
+    double iir_hz;       /**< Biquad low-pass corner, 0 = off */
+    double notch_hz;     /**< Mains notch, 0 = off */
+    double notch_q;
+};
+
+/**
+ * @brief Second-order section, transposed direct form II.
+ */
+struct DspBiquad {
+    float b0, b1, b2, a1, a2;
+    float z1, z2;
+};
+
+/**
+ * @brief Decimating FIR. The delay line is stored twice so that the last
+ *        @c taps inputs are always contiguous for the vector dot product.
+ */
+struct DspFir {
+    int taps;
+    int decim;
+    int phase;
+    int pos;
+    float h[DSP_FIR_MAX_TAPS];            /**< Coefficients, time-reversed */
+    float delay[2 * DSP_FIR_MAX_TAPS];
+};
+
+struct DspChain {
+    struct DspBiquad bq[DSP_MAX_BIQUADS];
+    int nbq;
+    struct DspFir fir;
+    int use_fir;
+    uint64_t delay_ns;   /**< FIR group delay subtracted from output timestamps */
+};
+
+/**
+ * @brief Reads the environment; @p default_fs_hz, the rate of one
+ *        converter/input stream, is used when DSP_FS_HZ is not set.
+ *        Prints the settings.
+ */
+void dsp_load_env(struct DspConfig *cfg, double default_fs_hz);
+
+/**
+ * @brief Windowed-sinc (Blackman) low-pass with unity DC gain.
+ * @param fc Cut-off as a fraction of the sample rate (0 .. 0.5).
+ */
+void dsp_design_lowpass(float *h, int taps, double fc);
+
+void dsp_biquad_lowpass(struct DspBiquad *bq, double fs_hz, double f0_hz, double q);
+void dsp_biquad_notch(struct DspBiquad *bq, double fs_hz, double f0_hz, double q);
+
+/**
+ * @brief Filters @p n samples in place.
+ */
+void dsp_biquad_process(struct DspBiquad *bq, float *x, int n);
+
+/**
+ * @brief Sets up a FIR with @p taps coefficients (copied, any order handled)
+ *        and a clear delay line.
+ */
+void dsp_fir_init(struct DspFir *f, const float *h, int taps, int decim);
+
+/**
+ * @brief Feeds @p n inputs; writes one output per @c decim inputs to @p y.
+ * @param idx If not NULL, receives the index in @p x of the input each
+ *            output was computed at.
+ * @return Number of outputs written.
+ */
+int dsp_fir_process(struct DspFir *f, const float *x, int n, float *y, int *idx);
+
+/**
+ * @brief Dot product of @p n floats (NEON on aarch64).
+ */
+float dsp_dot(const float *a, const float *b, int n);
+
+/**
+ * @brief Converts @p n counts to float (NEON on aarch64).
+ */
+void dsp_from_counts(float *y, const int16_t *x, int n);
+
+/**
+ * @brief Builds the chain described by @p cfg with cleared state.
+ */
+void dsp_chain_init(struct DspChain *ch, const struct DspConfig *cfg);
+
+/**
+ * @brief Clears the filter state (after a gap or a gain change).
+ */
+void dsp_chain_reset(struct DspChain *ch);
+
+/**
+ * @brief Runs up to DSP_BLOCK_MAX samples through the chain.
+ * @param x Conversion counts, all at the same gain.
+ * @param t_ns Timestamps of @p x.
+ * @param y, t_out Filtered samples (counts) and their timestamps.
+ * @return Number of outputs.
+ */
+int dsp_chain_process(struct DspChain *ch, const int16_t *x, const uint64_t *t_ns, int n,
+                      float *y, uint64_t *t_out);
+
+#endif // DSP_H
@@ -0,0 +1,165 @@
+/**
+ * @file evcapture.h
+ * @brief Pre/post-trigger event capture at the full sample rate.
+ *
+ * The acquisition thread stores every sample in fixed-size chunks taken
+ * from a preallocated pool. The last EVCAP_PRE_S seconds of chunks form
+ * the pre-trigger history; older ones go straight back to the pool.
+ *
+ * On a trigger (excursion onset, and field steps with EVCAP_TRANSIENT=1)
+ * the history chunks are moved into an event descriptor by index, and the
+ * chunks filled during the next EVCAP_POST_S seconds follow them. Triggers
+ * inside an open window extend it, up to EVCAP_MAX_S after the first one.
+ * The closed descriptor is handed to a writer thread, which packs the
+ * window into one .efb file (capture.h) and gives the chunks back. No
+ * sample is copied between the threads, and the acquisition thread never
+ * blocks: without a free chunk it takes the oldest history chunk, and
+ * without a free descriptor the trigger is counted and ignored.
+ *
+ * Files are <prefix>_YYYYmmdd_HHMMSS.efb segments of the shared
+ * segment index, so the retention policy covers them. For each file a
+ * summary goes back to the MQTT thread through a lock-free queue.
+ * Off unless EVCAP=1.
+ */
+
+#ifndef EVCAPTURE_H
+#define EVCAPTURE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "capture.h"
+#include "sample.h"
+#include "segments.h"
+
+#define EVCAP_CHUNK_SAMPLES 256
+#define EVCAP_EVENT_SLOTS   4      /**< Windows being collected or written; power of two */
+#define EVCAP_DONE_SLOTS    8      /**< Power of two */
+
+/**
+ * @brief Settings (EVCAP, EVCAP_PRE_S, EVCAP_POST_S, EVCAP_MAX_S,
+ *        EVCAP_TRANSIENT).
+ */
+struct EventCaptureConfig {
+    int enabled;
+    uint64_t pre_ns;
+    uint64_t post_ns;
+    uint64_t max_ns;         /**< Longest post-trigger time after retriggers */
+    int on_transient;        /**< Field steps also trigger */
+};
+
+struct EvChunk {
+    uint32_t count;
+    struct AdcSample s[EVCAP_CHUNK_SAMPLES];
+};
+
+/**
+ * @brief One window: trigger and the chunks that hold it, oldest first.
+ */
+struct EvDescriptor {
+    struct CaptureEventInfo info;
+    uint64_t start_ns;       /**< trigger - pre */
+    uint8_t device, channel;
+    uint32_t *chunks;        /**< Chunk indices, max_chunks entries */
+    uint32_t nchunks;
+};
+
+/**
+ * @brief Summary of a written file, for the event message.
+ */
+struct EvCaptureDone {
+    char name[SEG_NAME_MAX];
+    struct CaptureEventInfo info;
+    int64_t start_utc_ns;
+    uint64_t bytes;
+    uint8_t device, channel;
+};
+
+struct EventCapture {
+    struct EventCaptureConfig cfg;
+    struct SegmentIndex *segs;
+    char prefix[32];
+    struct EvChunk *pool;
+    uint32_t pool_n;
+    uint32_t max_chunks;     /**< Per window */
+
+    /* Acquisition thread */
+    uint32_t *free_stack;
+    uint32_t nfree;
+    uint32_t *hist;          /**< Circular, hist_cap entries */
+    uint32_t hist_cap, hist_n, hist_head;
+    int64_t cur;             /**< Chunk being filled, -1 if none */
+    struct EvDescriptor *open;
+    uint64_t post_end_ns;
+    unsigned long dropped_samples;
+    unsigned long dropped_triggers;
+
+    /* Acquisition -> writer: windows */
+    struct EvDescriptor ev[EVCAP_EVENT_SLOTS];
+    _Alignas(64) atomic_uint ev_head;
+    _Alignas(64) atomic_uint ev_tail;
+
+    /* Writer -> acquisition: chunks to reuse */
+    uint32_t *rel;           /**< rel_mask + 1 entries */
+    uint32_t rel_mask;
+    _Alignas(64) atomic_uint rel_head;
+    _Alignas(64) atomic_uint rel_tail;
+
+    /* Writer -> MQTT thread: summaries */
+    struct EvCaptureDone done[EVCAP_DONE_SLOTS];
+    _Alignas(64) atomic_uint done_head;
+    _Alignas(64) atomic_uint done_tail;
+    unsigned long done_dropped;
+
+    pthread_t thread;
+    atomic_int running;
+    int efd;
+    struct CaptureBlock *blocks;
+    unsigned long files;
+};
+
+/**
+ * @brief Reads the environment and prints the settings.
+ */
+void evcap_load_env(struct EventCaptureConfig *cfg);
+
+/**
+ * @brief Sizes the chunk pool for @p sps samples per second (all inputs)
+ *        and starts the writer thread.
+ * @return 0 on success, -1 on failure.
+ */
+int evcap_open(struct EventCapture *c, const struct EventCaptureConfig *cfg, struct SegmentIndex *segs,
+               const char *prefix, double sps);
+
+/**
+ * @brief Acquisition thread: stores one sample. Never blocks.
+ */
+void evcap_push(struct EventCapture *c, const struct AdcSample *s);
+
+/**
+ * @brief Acquisition thread: opens a window around @p t_ns, or extends the
+ *        open one.
+ * @param source CAP_EVENT_*.
+ * @param side Excursion side, or step sign.
+ * @param value Triggering voltage, or step amplitude.
+ */
+void evcap_trigger(struct EventCapture *c, uint64_t t_ns, int source, const struct AdcSample *s, int side,
+                   float value);
+
+/**
+ * @brief MQTT thread: takes the summary of the oldest written file.
+ * @return 1 if @p d was filled, 0 if there is none.
+ */
+int evcap_done_pop(struct EventCapture *c, struct EvCaptureDone *d);
+
+/**
+ * @brief Prints the counters.
+ */
+void evcap_print_stats(struct EventCapture *c);
+
+/**
+ * @brief Hands over the open window, writes what is pending and stops the writer.
+ */
+void evcap_close(struct EventCapture *c);
+
+#endif // EVCAPTURE_H
@@ -0,0 +1,135 @@
+/**
+ * @file excursion.h
+ * @brief Threshold excursion tracking with hysteresis and minimum dwell.
+ *
+ * Each converter/input has a tracker that turns the per-sample threshold
+ * comparison into excursions:
+ *
+ *   IDLE -> PENDING   a sample crosses V_HIGH_THR or V_LOW_THR
+ *   PENDING -> ACTIVE the crossing held for EXC_DWELL_MS: onset event
+ *   ACTIVE -> CLEARING the signal came back inside by EXC_HYST_V
+ *   CLEARING -> IDLE  it stayed back for EXC_DWELL_MS: end event
+ *
+ * A PENDING crossing that does not last is forgotten, and a CLEARING one
+ * that crosses the release level again goes back to ACTIVE, so noise on a
+ * threshold produces neither alert floods nor split excursions. While
+ * ACTIVE an update event is emitted every EXC_UPDATE_MS (0 = never). The
+ * end event carries the peak, the duration (onset to release) and the
+ * area beyond the threshold in V*s.
+ *
+ * Samples are compared in counts against thresholds converted once per
+ * gain, so a sample inside the thresholds costs two integer compares.
+ *
+ * Events go from the acquisition thread to the MQTT thread through a
+ * lock-free single-producer/single-consumer queue; pushing never blocks.
+ */
+
+#ifndef EXCURSION_H
+#define EXCURSION_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include "sample.h"
+
+#define EXC_QUEUE_SLOTS 64   /**< Power of two */
+
+enum ExcursionPhase {
+    EXC_ONSET = 1,
+    EXC_UPDATE = 2,
+    EXC_END = 3
+};
+
+enum ExcursionSide {
+    EXC_HIGH = 1,   /**< Same values as PAYLOAD_TRIGGER_HIGH / _LOW */
+    EXC_LOW = 2
+};
+
+/**
+ * @brief Thresholds and timing (V_HIGH_THR, V_LOW_THR, EXC_HYST_V,
+ *        EXC_DWELL_MS, EXC_UPDATE_MS).
+ */
+struct ExcursionConfig {
+    float v_high_thr;
+    float v_low_thr;
+    float hyst_v;           /**< Release level is this far inside the threshold */
+    uint64_t dwell_ns;      /**< Minimum time beyond (onset) and back (end) */
+    uint64_t update_ns;     /**< Period of update events, 0 = none */
+    /* The three levels in counts for each gain code; see excursion_scale() */
+    int32_t high_counts[8];
+    int32_t low_counts[8];
+    int32_t hyst_counts[8];
+};
+
+/**
+ * @brief One alert handed to the sender.
+ */
+struct ExcursionEvent {
+    uint64_t t_ns;          /**< Sample that produced the event */
+    uint64_t start_ns;      /**< First sample beyond the threshold */
+    uint64_t duration_ns;   /**< start_ns -> t_ns (onset, update) or release (end) */
+    float peak_v;           /**< Furthest value beyond the threshold so far */
+    float area_vs;          /**< Integral of the part beyond the threshold */
+    int16_t raw;            /**< Sample at t_ns; volts are raw * sample_lsb(pga) */
+    uint8_t pga;
+    uint8_t device;
+    uint8_t channel;
+    uint8_t phase;          /**< ExcursionPhase */
+    uint8_t side;           /**< ExcursionSide */
+};
+
+struct ExcursionTracker {
+    int state;
+    int side;
+    uint64_t start_ns;
+    uint64_t last_ns;
+    uint64_t release_ns;    /**< First sample back inside (CLEARING) */
+    uint64_t update_ns;     /**< Last onset/update event */
+    float peak_v;
+    double area_vs;
+};
+
+struct ExcursionQueue {
+    _Alignas(64) atomic_uint head;
+    unsigned long dropped;           /**< Events lost because the queue was full */
+    _Alignas(64) atomic_uint tail;
+    struct ExcursionEvent slots[EXC_QUEUE_SLOTS];
+};
+
+/**
+ * @brief Reads the environment and prints the settings; the thresholds are
+ *        passed in by the caller.
+ */
+void excursion_load_env(struct ExcursionConfig *cfg, float v_high_thr, float v_low_thr);
+
+/**
+ * @brief Converts the thresholds and release margin to counts for every
+ *        gain; needed after changing any of them.
+ */
+void excursion_scale(struct ExcursionConfig *cfg);
+
+/**
+ * @brief Feeds one sample of the tracker's stream.
+ * @param hw_trip 1 if the converter's comparator flagged the sample.
+ * @return 1 if @p ev was filled with an event, 0 otherwise.
+ */
+int excursion_update(struct ExcursionTracker *tr, const struct ExcursionConfig *cfg,
+                     const struct AdcSample *s, int hw_trip, struct ExcursionEvent *ev);
+
+/**
+ * @brief 1 if the tracker has no excursion open or pending.
+ */
+int excursion_idle(const struct ExcursionTracker *tr);
+
+/**
+ * @brief Producer: queues an event; never blocks.
+ * @return 0 on success, -1 if the queue was full (the event is counted and dropped).
+ */
+int excursion_queue_push(struct ExcursionQueue *q, const struct ExcursionEvent *ev);
+
+/**
+ * @brief Consumer: takes the oldest event.
+ * @return 1 if @p ev was filled, 0 if the queue is empty.
+ */
+int excursion_queue_pop(struct ExcursionQueue *q, struct ExcursionEvent *ev);
+
+#endif // EXCURSION_H
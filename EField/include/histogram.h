@@ -0,0 +1,41 @@
+/**
+ * @file histogram.h
+ * @brief Log2-bucketed latency histogram (1 us .. ~32 s).
+ */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+#define HIST_BUCKETS 26   /**< Bucket i holds [2^(i-1), 2^i) us; bucket 0 is < 1 us */
+
+struct LatencyHist {
+    unsigned long buckets[HIST_BUCKETS];
+    unsigned long count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+};
+
+/**
+ * @brief Clears all buckets.
+ */
+void hist_reset(struct LatencyHist *h);
+
+/**
+ * @brief Records one latency.
+ */
+void hist_add(struct LatencyHist *h, uint64_t ns);
+
+/**
+ * @brief Latency below which @p q (0..1) of the samples fall, as the upper
+ *        edge of the bucket, in ns.
+ */
+uint64_t hist_quantile(const struct LatencyHist *h, double q);
+
+/**
+ * @brief Prints the non-empty buckets with a label prefix.
+ */
+void hist_print(const struct LatencyHist *h, const char *label);
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,97 @@
+/**
+ * @file mqtt_batch.h
+ * @brief Groups the sample stream into one MQTT message per batch.
+ *
+ * Samples of each converter/input are collected until MQTT_BATCH_N samples
+ * or MQTT_BATCH_MS milliseconds have accumulated, or until the gain or the
+ * sample spacing changes. A batch goes out as
+ *
+ *   {"seq":N,"t0_ns":<UTC ns of the first sample>,"dt_ns":<mean period>,
+ *    "n":<count>,"v":[v0,v1,...]}
+ *
+ * so sample i was taken at t0_ns + i * dt_ns. seq counts batches per
+ * stream; a gap means a batch was lost. With MQTT_FORMAT=bin the same
+ * batch is sent as a PAYLOAD_READINGS message instead (payload.h), with
+ * raw counts and optional LZ compression (MQTT_LZ). Batches of the
+ * filtered stream (dsp.h) keep their extra resolution: two more decimals
+ * in JSON, float32 values (PAYLOAD_SERIES) in binary.
+ *
+ * A batch holds counts at one gain; they are turned into volts only when
+ * the JSON or PAYLOAD_SERIES payload is formatted.
+ */
+
+#ifndef MQTT_BATCH_H
+#define MQTT_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sample.h"
+#include "timebase.h"
+#include "payload.h"
+
+#define MQTT_BATCH_MAX PAYLOAD_MAX_SAMPLES   /**< Upper bound for MQTT_BATCH_N */
+
+/**
+ * @brief Batching settings (MQTT_BATCH_N, MQTT_BATCH_MS, MQTT_FORMAT, MQTT_LZ).
+ */
+struct MqttBatchConfig {
+    int max_samples;
+    int max_ms;
+    int decimals;    /**< Digits after the decimal point in "v" */
+    int binary;      /**< 1: payload.h encoding, 0: JSON */
+    int lz;          /**< Compress binary batches */
+};
+
+struct ReadingBatch {
+    uint64_t start_ns;       /**< CLOCK_MONOTONIC of the first sample */
+    uint64_t last_ns;
+    uint64_t spacing_ns;     /**< First interval, used to detect gaps */
+    uint32_t count;
+    uint32_t seq;
+    uint8_t device;
+    uint8_t channel;
+    uint8_t pga;
+    uint8_t filtered;        /**< DSP output, kept in v[] and sent as PAYLOAD_SERIES */
+    union {
+        int16_t raw[MQTT_BATCH_MAX];
+        float v[MQTT_BATCH_MAX];     /**< Filtered counts, with their fractional part */
+    };
+};
+
+/**
+ * @brief Reads the batching settings from the environment.
+ */
+void mqtt_batch_load_env(struct MqttBatchConfig *cfg);
+
+/**
+ * @brief Tells whether @p s cannot join @p b (gain change or broken spacing).
+ */
+int reading_batch_breaks(const struct ReadingBatch *b, const struct AdcSample *s);
+
+/**
+ * @brief Appends @p s to @p b.
+ * @return 1 if the batch is now full and must be sent, 0 otherwise.
+ */
+int reading_batch_add(struct ReadingBatch *b, const struct AdcSample *s, const struct MqttBatchConfig *cfg);
+
+/**
+ * @brief Appends a filtered value, in counts at the gain of @p s, to a
+ *        filtered batch; @p s gives its time, stream and gain.
+ * @return 1 if the batch is now full and must be sent, 0 otherwise.
+ */
+int reading_batch_add_filtered(struct ReadingBatch *b, const struct AdcSample *s, float counts,
+                               const struct MqttBatchConfig *cfg);
+
+/**
+ * @brief Tells whether the first sample of @p b is older than max_ms at @p now_ns.
+ */
+int reading_batch_due(const struct ReadingBatch *b, const struct MqttBatchConfig *cfg, uint64_t now_ns);
+
+/**
+ * @brief Formats @p b as a JSON or binary payload and empties it.
+ * @return Payload length, or -1 if @p n is too small.
+ */
+int reading_batch_take(struct ReadingBatch *b, const struct MqttBatchConfig *cfg,
+                       const struct TimeAnchor *anchor, char *buf, size_t n);
+
+#endif // MQTT_BATCH_H
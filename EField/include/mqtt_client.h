@@ -1,9 +1,22 @@
 #ifndef MQTT_CLIENT_H
 #define MQTT_CLIENT_H
 
+// Carriles de salida con prioridad estricta: una alerta sale antes que cualquier lectura encolada
+enum MqttLane {
+    MQTT_LANE_ALERT,   // Inicio de excursión; tiene una ranura de la ventana reservada
+    MQTT_LANE_EVENT,   // Actualizaciones, resúmenes y configuración
+    MQTT_LANE_BULK,    // Lotes de lecturas
+    MQTT_LANES
+};
+
 void mqtt_init(void);
-void mqtt_send(float value);
-int mqtt_send_alert_json(const char* json);
+int mqtt_send_batch(const char *tag, const char *payload, int len);  // TOPIC o TOPIC/<tag> (modo scan / varios ADC)
+int mqtt_send_alert(int lane, const void *payload, int len);
+int mqtt_send_alert_json(int lane, const char* json);
+int mqtt_send_alert_config(const void *payload, int len);  // ALERT_TOPIC/config, retenido
+int mqtt_send_event(const char *subtopic, const void *payload, int len);  // EVENT_TOPIC/<subtopic>, carril de eventos
+int mqtt_service(void);       // Reconexión, planificador y reenvío del spool; 1 si queda backlog por enviar
+void mqtt_print_stats(void);  // Contadores, profundidad y latencia por carril desde la última llamada
 void mqtt_cleanup(void);
 
 #endif // MQTT_CLIENT_H
@@ -0,0 +1,357 @@
+/**
+ * @file payload.h
+ * @brief Compact binary MQTT payloads (MQTT_FORMAT=bin) and their decoder.
+ *
+ * This file and payload.c have no other dependencies, so subscribers can
+ * build them as-is to decode the messages.
+ *
+ * Every payload starts with an 8-byte header, all fields little-endian:
+ *
+ *   off size
+ *   0   1    magic 'E' (0x45)
+ *   1   1    version (1)
+ *   2   1    type (PAYLOAD_READINGS, PAYLOAD_ALERT, PAYLOAD_THRESHOLDS,
+ *                  PAYLOAD_SERIES, PAYLOAD_STATS, PAYLOAD_STORM,
+ *                  PAYLOAD_TRANSIENT, PAYLOAD_ANOMALY, PAYLOAD_CAPTURE)
+ *   3   1    flags (PAYLOAD_FLAG_LZ: the body is an LZ4 block,
+ *                   PAYLOAD_FLAG_DELTA: raw[i] holds raw[i] - raw[i-1])
+ *   4   2    body length before compression
+ *   6   2    reserved (0)
+ *
+ * Body of PAYLOAD_READINGS (26 bytes + 2 per sample):
+ *
+ *   0   4    seq           batch number of this stream
+ *   4   8    t0_utc_ns     time of the first sample
+ *   12  4    dt_ns         mean sample period; sample i is at t0 + i*dt
+ *   16  4    lsb_volts     float32, volts per count for the whole batch
+ *   20  1    device        converter index
+ *   21  1    channel       scan entry index
+ *   22  1    pga           CONFIG_REG_PGA_* >> 9
+ *   23  1    reserved
+ *   24  2    n             number of samples
+ *   26  2*n  raw           int16 counts; volts = raw * lsb_volts
+ *
+ * Body of PAYLOAD_ALERT (40 bytes), one per excursion phase (excursion.h):
+ *
+ *   0   8    t_utc_ns      sample that produced the alert
+ *   8   4    lsb_volts
+ *   12  2    raw
+ *   14  1    device
+ *   15  1    channel
+ *   16  1    trigger       PAYLOAD_TRIGGER_HIGH / PAYLOAD_TRIGGER_LOW
+ *   17  1    phase         PAYLOAD_PHASE_ONSET / _UPDATE / _END
+ *   18  2    reserved
+ *   20  8    start_utc_ns  first sample beyond the threshold
+ *   28  4    duration_ms   up to t_utc_ns, or to the release for _END
+ *   32  4    peak_v        float32, furthest value beyond the threshold
+ *   36  4    area_vs       float32, integral beyond the threshold in V*s
+ *
+ * Body of PAYLOAD_THRESHOLDS (8 bytes), published once and retained:
+ *
+ *   0   4    v_high_thr    float32
+ *   4   4    v_low_thr     float32
+ *
+ * Body of PAYLOAD_SERIES (20 bytes + 4 per sample), the filtered and
+ * decimated stream (dsp.h), whose values carry more resolution than one
+ * count:
+ *
+ *   0   4    seq
+ *   4   8    t0_utc_ns
+ *   12  4    dt_ns
+ *   16  1    device
+ *   17  1    channel
+ *   18  2    n
+ *   20  4*n  v             float32 volts
+ *
+ * Body of PAYLOAD_STATS (44 bytes), one window summary (winstats.h):
+ *
+ *   0   8    t_end_utc_ns  end of the window
+ *   8   4    window_ms
+ *   12  4    n             samples in the window
+ *   16  1    device
+ *   17  1    channel
+ *   18  2    reserved
+ *   20  4    mean          float32 volts
+ *   24  4    rms
+ *   28  4    min
+ *   32  4    max
+ *   36  4    std
+ *   40  4    slope         float32 volts per second
+ *
+ * Body of PAYLOAD_STORM (20 bytes + 4 per timescale), storm-onset
+ * detector report (storm.h):
+ *
+ *   0   8    t_utc_ns
+ *   8   4    confidence    float32, 0..1
+ *   12  1    device
+ *   13  1    channel
+ *   14  1    level         StormLevel: 0 none, 1 watch, 2 warning, 3 alert
+ *   15  1    polarity      int8, +1 / -1, 0 unknown
+ *   16  1    flags         PAYLOAD_STORM_REVERSAL, PAYLOAD_STORM_CHANGED
+ *   17  1    nscales
+ *   18  2    reserved
+ *   20  4*n  slope         float32 volts per minute, shortest timescale first
+ *
+ * Body of PAYLOAD_TRANSIENT (32 bytes), one field step (transient.h):
+ *
+ *   0   8    t_utc_ns      first sample after the step
+ *   8   4    gap_us        time since the previous sample: the step lies
+ *                          in (t_utc_ns - gap_us, t_utc_ns]
+ *   12  4    amplitude_v   float32, signed step size
+ *   16  4    jump_v        float32, largest first difference across it
+ *   20  4    noise_v       float32, noise sigma of the first difference
+ *   24  4    level_v       float32, field before the step
+ *   28  1    device
+ *   29  1    channel
+ *   30  1    pga
+ *   31  1    sign          int8, +1 / -1
+ *
+ * Body of PAYLOAD_ANOMALY (52 bytes), one phase of an excursion beyond the
+ * adaptive thresholds (anomaly.h), published on the alert topic:
+ *
+ *   0   8    t_utc_ns
+ *   8   8    start_utc_ns
+ *   16  4    duration_ms
+ *   20  4    voltage       float32, sample at t_utc_ns
+ *   24  4    peak_v        float32
+ *   28  4    z             float32, robust z-score of the peak
+ *   32  4    median_v      float32, baseline
+ *   36  4    sigma_v       float32, robust spread of the baseline
+ *   40  4    thr_low       float32
+ *   44  4    thr_high      float32
+ *   48  1    device
+ *   49  1    channel
+ *   50  1    phase         PAYLOAD_PHASE_*
+ *   51  1    trigger       PAYLOAD_TRIGGER_HIGH / PAYLOAD_TRIGGER_LOW
+ *
+ * Body of PAYLOAD_CAPTURE (40 bytes + name), an event capture file was
+ * written (evcapture.h):
+ *
+ *   0   8    trigger_utc_ns
+ *   8   8    start_utc_ns  first sample of the window
+ *   16  4    duration_ms   start to last sample
+ *   20  4    samples       all inputs
+ *   24  4    bytes         file size
+ *   28  4    value         float32, triggering voltage or step amplitude
+ *   32  2    triggers      merged into the window
+ *   34  1    source        CAP_EVENT_EXCURSION / CAP_EVENT_TRANSIENT
+ *   35  1    device
+ *   36  1    channel
+ *   37  1    name_len
+ *   38  2    reserved
+ *   40  n    name          file name in SEG_DIR, not terminated
+ *
+ * With compression enabled the readings are delta-coded first (modulo
+ * 2^16), which turns slowly drifting counts into small numbers LZ can
+ * match. The LZ flag is only set when it makes the payload smaller; the
+ * block is plain LZ4 block format, so LZ4_decompress_safe() can decode it
+ * too. payload_decode() undoes both steps.
+ */
+
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PAYLOAD_MAGIC        0x45
+#define PAYLOAD_VERSION      1
+#define PAYLOAD_HEADER_SIZE  8
+#define PAYLOAD_FLAG_LZ      0x01
+#define PAYLOAD_FLAG_DELTA   0x02
+#define PAYLOAD_MAX_SAMPLES  512
+#define PAYLOAD_MAX_SIZE     (PAYLOAD_HEADER_SIZE + 20 + 4 * PAYLOAD_MAX_SAMPLES + 64)
+
+enum PayloadType {
+    PAYLOAD_READINGS = 1,
+    PAYLOAD_ALERT = 2,
+    PAYLOAD_THRESHOLDS = 3,
+    PAYLOAD_SERIES = 4,
+    PAYLOAD_STATS = 5,
+    PAYLOAD_STORM = 6,
+    PAYLOAD_TRANSIENT = 7,
+    PAYLOAD_ANOMALY = 8,
+    PAYLOAD_CAPTURE = 9
+};
+
+#define PAYLOAD_NAME_MAX 64
+
+#define PAYLOAD_STORM_REVERSAL 0x01   /**< Polarity reversal confirmed in this report */
+#define PAYLOAD_STORM_CHANGED  0x02   /**< Level differs from the previous report */
+#define PAYLOAD_STORM_SCALES   4
+
+enum PayloadTrigger {
+    PAYLOAD_TRIGGER_HIGH = 1,
+    PAYLOAD_TRIGGER_LOW = 2
+};
+
+enum PayloadPhase {
+    PAYLOAD_PHASE_ONSET = 1,
+    PAYLOAD_PHASE_UPDATE = 2,
+    PAYLOAD_PHASE_END = 3
+};
+
+struct PayloadReadings {
+    uint32_t seq;
+    int64_t t0_utc_ns;
+    uint32_t dt_ns;
+    float lsb_volts;
+    uint8_t device;
+    uint8_t channel;
+    uint8_t pga;
+    uint16_t n;
+    int16_t raw[PAYLOAD_MAX_SAMPLES];
+};
+
+struct PayloadAlert {
+    int64_t t_utc_ns;
+    float lsb_volts;
+    int16_t raw;
+    uint8_t device;
+    uint8_t channel;
+    uint8_t trigger;
+    uint8_t phase;
+    int64_t start_utc_ns;
+    uint32_t duration_ms;
+    float peak_v;
+    float area_vs;
+};
+
+struct PayloadThresholds {
+    float v_high_thr;
+    float v_low_thr;
+};
+
+struct PayloadStats {
+    int64_t t_end_utc_ns;
+    uint32_t window_ms;
+    uint32_t n;
+    uint8_t device;
+    uint8_t channel;
+    float mean, rms, min, max, std, slope;
+};
+
+struct PayloadStorm {
+    int64_t t_utc_ns;
+    float confidence;
+    uint8_t device;
+    uint8_t channel;
+    uint8_t level;
+    int8_t polarity;
+    uint8_t flags;
+    uint8_t nscales;
+    float slope_v_min[PAYLOAD_STORM_SCALES];
+};
+
+struct PayloadTransient {
+    int64_t t_utc_ns;
+    uint32_t gap_us;
+    float amplitude_v;
+    float jump_v;
+    float noise_v;
+    float level_v;
+    uint8_t device;
+    uint8_t channel;
+    uint8_t pga;
+    int8_t sign;
+};
+
+struct PayloadAnomaly {
+    int64_t t_utc_ns;
+    int64_t start_utc_ns;
+    uint32_t duration_ms;
+    float voltage;
+    float peak_v;
+    float z;
+    float median_v;
+    float sigma_v;
+    float thr_low;
+    float thr_high;
+    uint8_t device;
+    uint8_t channel;
+    uint8_t phase;
+    uint8_t trigger;
+};
+
+struct PayloadCapture {
+    int64_t trigger_utc_ns;
+    int64_t start_utc_ns;
+    uint32_t duration_ms;
+    uint32_t samples;
+    uint32_t bytes;
+    float value;
+    uint16_t triggers;
+    uint8_t source;
+    uint8_t device;
+    uint8_t channel;
+    char name[PAYLOAD_NAME_MAX];   /**< NUL-terminated */
+};
+
+struct PayloadSeries {
+    uint32_t seq;
+    int64_t t0_utc_ns;
+    uint32_t dt_ns;
+    uint8_t device;
+    uint8_t channel;
+    uint16_t n;
+    float v[PAYLOAD_MAX_SAMPLES];
+};
+
+/**
+ * @brief A decoded payload; only the member matching @p type is filled.
+ */
+struct PayloadMessage {
+    uint8_t type;
+    union {
+        struct PayloadReadings readings;
+        struct PayloadAlert alert;
+        struct PayloadThresholds thresholds;
+        struct PayloadSeries series;
+        struct PayloadStats stats;
+        struct PayloadStorm storm;
+        struct PayloadTransient transient;
+        struct PayloadAnomaly anomaly;
+        struct PayloadCapture capture;
+    } u;
+};
+
+/**
+ * @brief Encodes a readings batch of @p r->n samples taken from @p raw.
+ * @return Payload length, or -1 if @p cap is too small.
+ */
+int payload_encode_readings(const struct PayloadReadings *r, const int16_t *raw, int lz,
+                            uint8_t *out, size_t cap);
+
+int payload_encode_alert(const struct PayloadAlert *a, uint8_t *out, size_t cap);
+int payload_encode_thresholds(const struct PayloadThresholds *t, uint8_t *out, size_t cap);
+int payload_encode_stats(const struct PayloadStats *st, uint8_t *out, size_t cap);
+int payload_encode_storm(const struct PayloadStorm *st, uint8_t *out, size_t cap);
+int payload_encode_transient(const struct PayloadTransient *tr, uint8_t *out, size_t cap);
+int payload_encode_anomaly(const struct PayloadAnomaly *an, uint8_t *out, size_t cap);
+int payload_encode_capture(const struct PayloadCapture *pc, uint8_t *out, size_t cap);
+
+/**
+ * @brief Encodes @p s->n float values taken from @p v (uncompressed).
+ * @return Payload length, or -1 if @p cap is too small.
+ */
+int payload_encode_series(const struct PayloadSeries *s, const float *v, uint8_t *out, size_t cap);
+
+/**
+ * @brief Decodes any payload type.
+ * @return 0 on success, -1 if the payload is malformed.
+ */
+int payload_decode(const uint8_t *msg, size_t len, struct PayloadMessage *out);
+
+/**
+ * @brief LZ4 block compression of @p n bytes.
+ * @return Compressed length, or -1 if it does not fit in @p cap.
+ */
+int payload_lz_compress(const uint8_t *src, int n, uint8_t *dst, int cap);
+
+/**
+ * @brief LZ4 block decompression with bounds checks.
+ * @return Decompressed length, or -1 on malformed input.
+ */
+int payload_lz_decompress(const uint8_t *src, int n, uint8_t *dst, int cap);
+
+#endif // PAYLOAD_H
@@ -0,0 +1,62 @@
+/**
+ * @file quantile.h
+ * @brief Streaming quantile sketch (merging t-digest) with fixed memory.
+ *
+ * Values are appended to a small buffer; when it fills it is sorted and
+ * merged into at most QS_MAX_CENTROIDS weighted centroids. How much a
+ * centroid may absorb is bounded by the arcsine scale function
+ *
+ *   k(q) = QS_COMPRESSION / (2 pi) * asin(2q - 1)
+ *
+ * (a centroid spans at most one unit of k), so the centroids are small in
+ * the tails and large around the median: extreme quantiles stay accurate
+ * to a fraction of a percent of rank, which is what thresholds need.
+ *
+ * Adding a value is O(1) amortised (a sort of QS_BUFFER values every
+ * QS_BUFFER additions) and the memory is the same whatever the stream
+ * length. Two sketches merge into one, which is how rolling windows are
+ * built on top of it.
+ */
+
+#ifndef QUANTILE_H
+#define QUANTILE_H
+
+#include <stdint.h>
+
+#define QS_COMPRESSION   100
+#define QS_MAX_CENTROIDS 128
+#define QS_BUFFER        128
+
+struct QsCentroid {
+    float mean;
+    float weight;
+};
+
+struct QSketch {
+    struct QsCentroid c[QS_MAX_CENTROIDS];
+    int nc;
+    float buf[QS_BUFFER];   /**< Values not merged yet */
+    int nbuf;
+    double total;           /**< Values in the sketch, merged or not */
+    float min, max;
+};
+
+void qsketch_reset(struct QSketch *s);
+
+/**
+ * @brief Adds one value.
+ */
+void qsketch_add(struct QSketch *s, float v);
+
+/**
+ * @brief Adds every value summarised by @p src to @p dst.
+ */
+void qsketch_merge(struct QSketch *dst, const struct QSketch *src);
+
+/**
+ * @brief Estimates the value at rank @p q (0..1), merging the buffer first.
+ * @return The estimate, or NAN if the sketch is empty.
+ */
+float qsketch_quantile(struct QSketch *s, float q);
+
+#endif // QUANTILE_H
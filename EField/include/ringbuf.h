@@ -0,0 +1,119 @@
+/**
+ * @file ringbuf.h
+ * @brief Lock-free single-producer/single-consumer ring of sample batches.
+ *
+ * The producer (acquisition thread) fills batches in place and never
+ * blocks: when the ring is full the batch is dropped and counted. The
+ * consumer sleeps on an eventfd that the producer only signals when the
+ * consumer has announced it is about to wait.
+ */
+
+#ifndef RINGBUF_H
+#define RINGBUF_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sample.h"
+
+#define RING_CACHE_LINE    64
+#define RING_BATCH_MAX     128   /**< Samples per batch slot */
+#define RING_DEFAULT_SLOTS 64    /**< Default capacity in batches */
+#define RING_BATCH_MAX_MS  50    /**< A partial batch is published once its first sample is this old */
+
+/**
+ * @brief One slot of the ring.
+ */
+struct SampleBatch {
+    uint64_t publish_ns;     /**< CLOCK_MONOTONIC when handed to the consumer */
+    uint32_t count;
+    uint32_t seq;            /**< Batch sequence number (gaps = dropped batches) */
+    struct AdcSample samples[RING_BATCH_MAX];
+};
+
+/**
+ * @brief Counters written only by the producer.
+ */
+struct RingProducerStats {
+    unsigned long published;      /**< Batches handed over */
+    unsigned long dropped_samples;/**< Samples lost because the ring was full */
+    size_t high_water;            /**< Highest occupancy seen, in batches */
+};
+
+/**
+ * @brief Counters written only by the consumer.
+ */
+struct RingConsumerStats {
+    unsigned long consumed;
+    uint64_t queue_ns_sum;        /**< publish -> consume, summed over consumed batches */
+    uint64_t queue_ns_max;
+    uint64_t age_ns_max;          /**< capture of the first sample -> consume */
+};
+
+struct SpscRing {
+    /* Producer cache line */
+    _Alignas(RING_CACHE_LINE) atomic_size_t head;
+    struct SampleBatch *open;         /**< Slot being filled, NULL if none */
+    uint32_t next_seq;
+    size_t batch_size;
+    struct RingProducerStats pstats;
+
+    /* Consumer cache line */
+    _Alignas(RING_CACHE_LINE) atomic_size_t tail;
+    atomic_int waiting;               /**< Consumer is (about to be) blocked on efd */
+    struct RingConsumerStats cstats;
+
+    /* Read-mostly */
+    _Alignas(RING_CACHE_LINE) struct SampleBatch *slots;
+    size_t capacity;                  /**< Power of two */
+    size_t mask;
+    int efd;
+};
+
+/**
+ * @brief Allocates a ring of @p capacity batches (rounded up to a power of
+ *        two) of @p batch_size samples each (<= RING_BATCH_MAX).
+ * @return 0 on success, -1 on failure.
+ */
+int ring_init(struct SpscRing *r, size_t capacity, size_t batch_size);
+
+/**
+ * @brief Producer: appends one sample, publishing the batch when it is full.
+ *        Never blocks.
+ */
+void ring_push(struct SpscRing *r, const struct AdcSample *s);
+
+/**
+ * @brief Producer: publishes a partial batch whose first sample is older
+ *        than @p max_age_ns at time @p now_ns.
+ */
+void ring_flush(struct SpscRing *r, uint64_t now_ns, uint64_t max_age_ns);
+
+/**
+ * @brief Consumer: waits up to @p timeout_ms (-1 = forever) for a batch.
+ * @return The oldest published batch, or NULL on timeout. The batch stays
+ *         owned by the consumer until ring_release().
+ */
+struct SampleBatch *ring_wait(struct SpscRing *r, int timeout_ms);
+
+/**
+ * @brief Consumer: returns the batch obtained from ring_wait() to the producer.
+ */
+void ring_release(struct SpscRing *r);
+
+/**
+ * @brief Batches currently queued.
+ */
+size_t ring_occupancy(struct SpscRing *r);
+
+/**
+ * @brief Prints the ring counters with a label prefix.
+ */
+void ring_print_stats(struct SpscRing *r, const char *label);
+
+/**
+ * @brief Frees the ring storage and closes the eventfd.
+ */
+void ring_destroy(struct SpscRing *r);
+
+#endif // RINGBUF_H
@@ -0,0 +1,43 @@
+/**
+ * @file sample.h
+ * @brief Sample record passed from the acquisition front-end to the sinks.
+ */
+
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <stdint.h>
+
+/**
+ * @brief One conversion result.
+ *
+ * Samples carry the signed conversion counts and the gain they were taken
+ * at; the pair is exact and 16 bytes wide. Filters and detectors work in
+ * counts, and sample_volts() is applied where a value is shown or compared
+ * across gains.
+ */
+struct AdcSample {
+    uint64_t t_ns;      /**< CLOCK_MONOTONIC time of the end of conversion */
+    int16_t raw;        /**< Conversion register contents */
+    uint8_t channel;    /**< Index in the scan list (0 when not scanning) */
+    uint8_t device;     /**< Converter index (order of ADC_ADDRS) */
+    uint8_t pga;        /**< Gain the conversion was taken at: CONFIG_REG_PGA_* >> 9 */
+};
+
+/**
+ * @brief Volts per count for a gain code (AdcSample::pga); the same value
+ *        as pgaFullScale(pga << 9) / 32768.
+ */
+static inline float sample_lsb(uint8_t pga) {
+    static const float lsb[8] = {
+        6.144f / 32768, 4.096f / 32768, 2.048f / 32768, 1.024f / 32768,
+        0.512f / 32768, 0.256f / 32768, 0.256f / 32768, 0.256f / 32768
+    };
+    return lsb[pga & 7];
+}
+
+static inline float sample_volts(const struct AdcSample *s) {
+    return s->raw * sample_lsb(s->pga);
+}
+
+#endif // SAMPLE_H
@@ -0,0 +1,110 @@
+/**
+ * @file segments.h
+ * @brief Rolling capture files with a manifest and a retention policy.
+ *
+ * Every sink writes into a sequence of segments named
+ * <prefix>_YYYYmmdd_HHMMSS.<ext> inside SEG_DIR. A segment is closed once
+ * it reaches SEG_MAX_MB or has been open SEG_MAX_S seconds. The list of
+ * segments lives in SEG_DIR/segments.idx (name, start time, size), so
+ * startup reads one small file instead of scanning the directory, and the
+ * oldest closed segments are deleted while the total exceeds SEG_KEEP_MB
+ * or they are older than SEG_KEEP_H hours. The index is shared by all
+ * writer threads and protected by a mutex; it is only touched when a
+ * segment is opened or closed. When a new segment cannot be created the
+ * writer keeps appending to the current one and retries later.
+ */
+
+#ifndef SEGMENTS_H
+#define SEGMENTS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#define SEG_NAME_MAX  64
+#define SEG_DIR_MAX   128
+#define SEG_MANIFEST  "segments.idx"
+#define SEG_RETRY_S   10     /**< Wait before retrying a rotation that failed */
+
+/**
+ * @brief Rotation and retention settings.
+ */
+struct SegmentPolicy {
+    char dir[SEG_DIR_MAX];
+    uint64_t max_bytes;    /**< Rotate when a segment reaches this size */
+    int max_s;             /**< Rotate when a segment has been open this long */
+    uint64_t keep_bytes;   /**< Prune oldest while the total exceeds this; 0 = no limit */
+    int keep_h;            /**< Prune segments older than this; 0 = no limit */
+};
+
+struct SegmentEntry {
+    char name[SEG_NAME_MAX];
+    int64_t start_utc_ns;
+    uint64_t bytes;
+    int open;              /**< Still being written (size not final) */
+};
+
+struct SegmentIndex {
+    struct SegmentPolicy pol;
+    pthread_mutex_t lock;
+    struct SegmentEntry *e;    /**< Oldest first */
+    size_t n;
+    size_t cap;
+    uint64_t total_bytes;      /**< Sum of the closed segments */
+    unsigned long pruned;
+};
+
+/**
+ * @brief The segment a writer is currently filling.
+ */
+struct Segment {
+    int fd;
+    char name[SEG_NAME_MAX];
+    uint64_t bytes;
+    uint64_t opened_ns;        /**< CLOCK_MONOTONIC */
+    uint64_t retry_ns;         /**< No rotation before this after a failed one */
+};
+
+/**
+ * @brief Reads SEG_DIR, SEG_MAX_MB, SEG_MAX_S, SEG_KEEP_MB and SEG_KEEP_H.
+ */
+void segment_policy_load_env(struct SegmentPolicy *pol);
+
+/**
+ * @brief Loads the manifest of @p pol->dir (if any) and applies retention.
+ * @return 0 on success, -1 on failure.
+ */
+int segment_index_open(struct SegmentIndex *idx, const struct SegmentPolicy *pol);
+
+/**
+ * @brief Creates a new segment and records it in the manifest.
+ * @return 0 on success, -1 on failure.
+ */
+int segment_open(struct SegmentIndex *idx, struct Segment *seg, const char *prefix, const char *ext);
+
+/**
+ * @brief Tells whether @p seg has reached its size or age limit.
+ */
+int segment_due(const struct SegmentIndex *idx, const struct Segment *seg, uint64_t now_ns);
+
+/**
+ * @brief Replaces @p seg with a new segment. If the new one cannot be
+ *        created, @p seg stays open and in use, and segment_due() holds
+ *        off for SEG_RETRY_S.
+ * @return 0 if @p seg is now the new segment, -1 if it is still the old one.
+ */
+int segment_rotate(struct SegmentIndex *idx, struct Segment *seg, const char *prefix, const char *ext);
+
+/**
+ * @brief Closes @p seg, records its final size and prunes old segments.
+ *
+ * The caller is responsible for any fdatasync() before closing.
+ */
+void segment_close(struct SegmentIndex *idx, struct Segment *seg);
+
+/**
+ * @brief Releases the in-memory index.
+ */
+void segment_index_close(struct SegmentIndex *idx);
+
+#endif // SEGMENTS_H
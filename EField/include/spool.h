@@ -0,0 +1,101 @@
+/**
+ * @file spool.h
+ * @brief Disk-backed store-and-forward queue for outbound MQTT messages.
+ *
+ * Messages that cannot be delivered (broker unreachable, publish failed,
+ * in-flight window full) are appended to a log of segment files
+ * SPOOL_DIR/spool_NNNNNNNNNN.log and replayed oldest first once the broker
+ * is back. A record is
+ *
+ *   u32 length of the rest, u32 CRC32 of the rest,
+ *   u8 qos, u8 retained, u8 topic length, u8 reserved, topic, payload
+ *
+ * Records leave the spool when they are handed back to the client, which
+ * re-spools them if delivery fails again, so delivery is at-least-once
+ * (subscribers can drop duplicates by seq). The total size is capped at
+ * SPOOL_MAX_MB; beyond that whole segments are dropped, oldest first.
+ */
+
+#ifndef SPOOL_H
+#define SPOOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#define SPOOL_DIR_MAX    128
+#define SPOOL_TOPIC_MAX  96
+#define SPOOL_PAYLOAD_MAX 16384
+
+/**
+ * @brief Spool settings (SPOOL_DIR, SPOOL_MAX_MB, SPOOL_SEG_KB).
+ */
+struct SpoolConfig {
+    char dir[SPOOL_DIR_MAX];
+    uint64_t max_bytes;    /**< Disk budget; 0 disables the spool */
+    uint64_t seg_bytes;    /**< Target segment size */
+};
+
+struct Spool {
+    struct SpoolConfig cfg;
+    pthread_mutex_t lock;
+    uint32_t first_seg;    /**< Oldest segment on disk */
+    uint32_t last_seg;     /**< Segment being appended to */
+    int wfd;
+    uint64_t woff;
+    int rfd;               /**< Segment being replayed (first_seg), -1 if not open */
+    uint64_t roff;
+    uint64_t total_bytes;  /**< Bytes on disk, including already replayed records */
+    int dirty;
+    unsigned long appended;
+    unsigned long replayed;
+    unsigned long dropped_segs;
+    uint64_t dropped_bytes;
+};
+
+/**
+ * @brief Reads the spool settings from the environment.
+ */
+void spool_load_env(struct SpoolConfig *cfg);
+
+/**
+ * @brief Opens (or creates) the spool directory and resumes any backlog.
+ * @return 0 on success, -1 on failure.
+ */
+int spool_open(struct Spool *sp, const struct SpoolConfig *cfg);
+
+/**
+ * @brief Appends one message. Thread-safe.
+ * @return 0 on success, -1 on failure (message lost).
+ */
+int spool_append(struct Spool *sp, const char *topic, const void *payload, int len, int qos, int retained);
+
+/**
+ * @brief Takes the oldest message out of the spool. Thread-safe.
+ * @param topic Receives the topic (SPOOL_TOPIC_MAX bytes).
+ * @param payload Receives the payload (@p cap bytes).
+ * @return 1 if a message was returned, 0 if the spool is empty.
+ */
+int spool_next(struct Spool *sp, char *topic, void *payload, int cap, int *len, int *qos, int *retained);
+
+/**
+ * @brief Tells whether there are messages waiting to be replayed.
+ */
+int spool_pending(struct Spool *sp);
+
+/**
+ * @brief fdatasync() of the segment being written, if anything was appended.
+ */
+void spool_sync(struct Spool *sp);
+
+/**
+ * @brief Prints the spool counters.
+ */
+void spool_print_stats(struct Spool *sp);
+
+/**
+ * @brief Syncs and closes the spool; the backlog stays on disk.
+ */
+void spool_close(struct Spool *sp);
+
+#endif // SPOOL_H
@@ -0,0 +1,119 @@
+/**
+ * @file storm.h
+ * @brief Storm-onset detector: sustained field drift and polarity reversal.
+ *
+ * Samples are reduced to one mean per second. Each timescale of
+ * STORM_SCALES (seconds, default "60,300,1200") keeps STORM_POINTS means
+ * of scale/STORM_POINTS seconds and estimates its trend with a Theil-Sen
+ * slope (median of the pairwise slopes), which ignores lightning steps
+ * and spikes, and the residual noise with the MAD. The per-sample cost is
+ * one addition; the slopes are recomputed once per point.
+ *
+ * The polarity is the side of STORM_ZERO_V the per-second mean sits on,
+ * beyond STORM_REV_MARGIN_V. A reversal is declared when the opposite
+ * polarity holds for STORM_REV_HOLD_S seconds.
+ *
+ * Confidence (0..1) combines, per timescale, how far the slope is past
+ * STORM_SLOPE_V_MIN (V/min), how clearly it stands out of the noise and
+ * whether it agrees with the longest timescale, plus a reversal term that
+ * fades over STORM_HOLD_S. It maps to graded levels:
+ *
+ *   NONE < 0.3 <= WATCH < 0.55 <= WARNING < 0.8 <= ALERT
+ *
+ * Levels rise at once and fall one step after the confidence has stayed
+ * below the level for STORM_HOLD_S.
+ *
+ * Off unless STORM=1, so existing subscribers see no new topics.
+ */
+
+#ifndef STORM_H
+#define STORM_H
+
+#include <stdint.h>
+
+#define STORM_MAX_SCALES 4
+#define STORM_POINTS     30
+
+enum StormLevel {
+    STORM_NONE,
+    STORM_WATCH,
+    STORM_WARNING,
+    STORM_ALERT
+};
+
+/**
+ * @brief Detector settings (STORM, STORM_SCALES, STORM_ZERO_V,
+ *        STORM_REV_MARGIN_V, STORM_REV_HOLD_S, STORM_SLOPE_V_MIN,
+ *        STORM_HOLD_S, STORM_REPORT_S).
+ */
+struct StormConfig {
+    int enabled;
+    int nscales;
+    int scale_s[STORM_MAX_SCALES];
+    float zero_v;            /**< Output of the sensor at zero field */
+    float rev_margin_v;
+    int rev_hold_s;
+    float slope_v_min;       /**< Drift that counts as significant, V/min */
+    int hold_s;
+    int report_s;            /**< Period of routine reports */
+};
+
+struct StormScale {
+    int res_s;               /**< Seconds per point */
+    int64_t bucket;          /**< Point being accumulated (second / res_s) */
+    double acc;
+    int acc_n;
+    double t[STORM_POINTS];  /**< Point time, s since the detector started */
+    float y[STORM_POINTS];
+    int n, head;
+    float slope;             /**< V/s */
+    float sigma;             /**< Robust residual noise, V */
+};
+
+/**
+ * @brief One report: level changes and the routine STORM_REPORT_S ones.
+ */
+struct StormReport {
+    uint64_t t_ns;
+    int level;
+    int level_changed;
+    int reversal;            /**< A reversal was confirmed in this second */
+    int polarity;            /**< +1 / -1, 0 until known */
+    float confidence;
+    int nscales;
+    float slope_v_min[STORM_MAX_SCALES];
+};
+
+struct StormDetector {
+    int started;
+    int64_t origin_s;        /**< First second seen */
+    int64_t sec;             /**< Second being accumulated */
+    double sec_acc;
+    int sec_n;
+    struct StormScale scales[STORM_MAX_SCALES];
+    int polarity;
+    int opposite_s;          /**< Consecutive seconds on the other side */
+    int64_t reversal_s;      /**< Second of the last reversal, -1 if none */
+    int level;
+    int64_t below_since_s;   /**< First second the confidence dropped under the level, -1 if not */
+    int64_t last_report_s;
+};
+
+/**
+ * @brief Reads the environment and prints the settings. @p default_zero_v
+ *        is used when STORM_ZERO_V is not set.
+ */
+void storm_load_env(struct StormConfig *cfg, float default_zero_v);
+
+void storm_init(struct StormDetector *d, const struct StormConfig *cfg);
+
+/**
+ * @brief Adds one sample.
+ * @return 1 if @p rep was filled (level change or routine report), 0 otherwise.
+ */
+int storm_add(struct StormDetector *d, const struct StormConfig *cfg, uint64_t t_ns, float v,
+              struct StormReport *rep);
+
+const char *storm_level_name(int level);
+
+#endif // STORM_H
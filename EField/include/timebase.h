@@ -0,0 +1,60 @@
+/**
+ * @file timebase.h
+ * @brief Monotonic sample timestamps and wall-clock anchors.
+ *
+ * Samples are stamped with CLOCK_MONOTONIC nanoseconds at capture. An
+ * anchor pairs one monotonic reading with the wall clock, so sinks can
+ * rebuild UTC times without calling localtime() per sample.
+ */
+
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#define TIME_ANCHOR_PERIOD_S 60   /**< How often sinks re-emit an anchor */
+
+/**
+ * @brief Monotonic/wall-clock pair.
+ */
+struct TimeAnchor {
+    uint64_t mono_ns;   /**< CLOCK_MONOTONIC */
+    int64_t utc_ns;     /**< CLOCK_REALTIME at the same instant (ns since the epoch) */
+};
+
+/**
+ * @brief Converts a timespec to nanoseconds.
+ */
+static inline uint64_t timespec_to_ns(const struct timespec *ts) {
+    return (uint64_t)ts->tv_sec * 1000000000ull + (uint64_t)ts->tv_nsec;
+}
+
+/**
+ * @brief Current CLOCK_MONOTONIC time in nanoseconds.
+ */
+uint64_t mono_now_ns(void);
+
+/**
+ * @brief Current CLOCK_REALTIME time in nanoseconds since the epoch.
+ */
+int64_t utc_now_ns(void);
+
+/**
+ * @brief Captures an anchor; the wall clock is read between two monotonic
+ *        reads and paired with their midpoint.
+ */
+void time_anchor_capture(struct TimeAnchor *a);
+
+/**
+ * @brief Wall-clock time of monotonic instant @p mono_ns according to @p a.
+ */
+int64_t time_anchor_to_utc_ns(const struct TimeAnchor *a, uint64_t mono_ns);
+
+/**
+ * @brief Formats @p utc_ns as local "YYYY-mm-dd HH:MM:SS.mmm".
+ */
+void time_format(int64_t utc_ns, char *buf, size_t n);
+
+#endif // TIMEBASE_H
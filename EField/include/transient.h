@@ -0,0 +1,128 @@
+/**
+ * @file transient.h
+ * @brief Fast-transient (lightning field-step) detector at the full sample rate.
+ *
+ * A nearby flash changes the quasi-static field in well under one
+ * conversion, so it shows up as a one- or two-sample jump that then
+ * relaxes over seconds. Each converter/input runs:
+ *
+ *   1. A derivative test: the first difference d = v[n] - v[n-1] is a
+ *      candidate when |d| exceeds TRANSIENT_K times the noise of d, and at
+ *      least TRANSIENT_MIN_V. The noise is a running mean of |d| (scaled
+ *      to a Gaussian sigma) over about TRANSIENT_TAU samples, fed with
+ *      values clipped at the threshold so the steps do not inflate it.
+ *   2. A matched filter for a step in white noise at the candidate: the
+ *      mean of the TRANSIENT_WIN samples after it minus the mean of the
+ *      TRANSIENT_WIN before it. The candidate sample itself is left out, so
+ *      a step split between two conversions is measured whole.
+ *
+ * A candidate whose step keeps less than half of the jump is a spike
+ * (interference, i2c glitch) and is only counted. After a candidate the
+ * detector ignores new ones for TRANSIENT_DEAD_MS. A gain change or a gap
+ * longer than TRANSIENT_GAP_MS restarts the windows.
+ *
+ * The cost per sample is a few operations; an event is ready TRANSIENT_WIN
+ * samples after the step and goes to the MQTT thread through a lock-free
+ * single-producer/single-consumer queue, like the excursion alerts.
+ * Off unless TRANSIENT=1.
+ */
+
+#ifndef TRANSIENT_H
+#define TRANSIENT_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include "sample.h"
+
+#define TRANSIENT_WIN_MAX     16
+#define TRANSIENT_QUEUE_SLOTS 64   /**< Power of two */
+
+/**
+ * @brief Detector settings (TRANSIENT, TRANSIENT_K, TRANSIENT_MIN_V,
+ *        TRANSIENT_WIN, TRANSIENT_TAU, TRANSIENT_DEAD_MS, TRANSIENT_GAP_MS).
+ */
+struct TransientConfig {
+    int enabled;
+    float k;                 /**< Threshold in noise sigmas of the first difference */
+    float min_v;             /**< Smallest step reported, V */
+    int win;                 /**< Samples averaged on each side of the step */
+    float alpha;             /**< Weight of a new |d| in the noise average, 1/TRANSIENT_TAU */
+    uint64_t dead_ns;        /**< No new candidate this long after one */
+    uint64_t gap_ns;         /**< Longer gaps restart the windows */
+};
+
+/**
+ * @brief One field step handed to the sender.
+ */
+struct TransientEvent {
+    uint64_t t_ns;           /**< First sample after the step */
+    uint64_t prev_ns;        /**< Last sample before it: the step lies in (prev_ns, t_ns] */
+    float amplitude_v;       /**< Step size from the matched filter, signed */
+    float jump_v;            /**< Largest first difference across the step, signed */
+    float noise_v;           /**< Noise sigma of the first difference at the time */
+    float level_v;           /**< Field before the step (mean of the pre window) */
+    uint8_t device;
+    uint8_t channel;
+    uint8_t pga;
+    int8_t sign;             /**< +1 / -1 */
+};
+
+/**
+ * @brief Per-stream state. Everything is kept in counts of the current gain
+ *        (a gain change restarts the windows); volts appear only in the
+ *        event handed out.
+ */
+struct TransientDetector {
+    int16_t pre[TRANSIENT_WIN_MAX]; /**< Last samples, circular */
+    int npre, head;
+    int16_t prev_raw;
+    uint64_t prev_ns;
+    uint8_t pga;
+    int started;
+    float lsb;               /**< Volts per count at pga */
+    float min_counts;        /**< TRANSIENT_MIN_V at pga */
+    float mean_abs_d;        /**< Running mean of the clipped |d| */
+    uint32_t warm;           /**< Differences seen since the start */
+    int post;                /**< Samples still to collect after a candidate, 0 = idle */
+    int32_t post_acc;
+    uint64_t dead_until_ns;
+    int32_t cand_jump;       /**< Candidate, in counts */
+    float cand_level;
+    float cand_noise;
+    struct TransientEvent cand;
+    unsigned long steps;     /**< Events produced */
+    unsigned long spikes;    /**< Candidates rejected as spikes */
+};
+
+struct TransientQueue {
+    _Alignas(64) atomic_uint head;
+    unsigned long dropped;           /**< Events lost because the queue was full */
+    _Alignas(64) atomic_uint tail;
+    struct TransientEvent slots[TRANSIENT_QUEUE_SLOTS];
+};
+
+/**
+ * @brief Reads the environment and prints the settings.
+ */
+void transient_load_env(struct TransientConfig *cfg);
+
+/**
+ * @brief Feeds one sample of the detector's stream.
+ * @return 1 if @p ev was filled with a step, 0 otherwise.
+ */
+int transient_update(struct TransientDetector *d, const struct TransientConfig *cfg,
+                     const struct AdcSample *s, struct TransientEvent *ev);
+
+/**
+ * @brief Producer: queues an event; never blocks.
+ * @return 0 on success, -1 if the queue was full (the event is counted and dropped).
+ */
+int transient_queue_push(struct TransientQueue *q, const struct TransientEvent *ev);
+
+/**
+ * @brief Consumer: takes the oldest event.
+ * @return 1 if @p ev was filled, 0 if the queue is empty.
+ */
+int transient_queue_pop(struct TransientQueue *q, struct TransientEvent *ev);
+
+#endif // TRANSIENT_H
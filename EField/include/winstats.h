@@ -0,0 +1,86 @@
+/**
+ * @file winstats.h
+ * @brief Sliding-window statistics of one sample stream.
+ *
+ * Samples are accumulated into buckets of STATS_HOP_MS. Each bucket keeps
+ * count, sum, sum of squares, min, max and the sums needed for a least
+ * squares slope, so adding a sample is O(1). Every time a bucket closes,
+ * each window of STATS_WINDOWS (seconds, e.g. "1,10,60") is summarised by
+ * merging its last buckets: O(window / hop) once per hop, amortised O(1)
+ * per sample, and the memory is fixed whatever the sample rate.
+ *
+ * Timestamps are kept relative to each bucket's start, so the slope stays
+ * precise however long the program has been running.
+ *
+ * Off unless STATS_WINDOWS lists at least one window, so existing
+ * subscribers see no new topics.
+ */
+
+#ifndef WINSTATS_H
+#define WINSTATS_H
+
+#include <stdint.h>
+
+#define STATS_MAX_WINDOWS 4
+#define STATS_MAX_BUCKETS 120
+#define STATS_LATE_NS     250000000ull   /**< Wait for samples still in the ring before closing a bucket */
+
+/**
+ * @brief Window settings (STATS_WINDOWS, STATS_HOP_MS).
+ */
+struct StatsConfig {
+    int nwin;                              /**< 0 = statistics off */
+    uint64_t hop_ns;                       /**< Bucket width and publishing period */
+    int win_buckets[STATS_MAX_WINDOWS];    /**< Window length in buckets */
+    int ring;                              /**< Buckets kept: the longest window plus the open one */
+};
+
+struct StatsBucket {
+    uint32_t n;
+    float min, max;
+    double sv, svv;          /**< Sum of v and of v^2 */
+    double su, suu, suv;     /**< Same for u = time since the bucket start (s) and u*v */
+};
+
+/**
+ * @brief Summary of one window.
+ */
+struct StatsSummary {
+    uint64_t t_end_ns;       /**< CLOCK_MONOTONIC end of the window */
+    uint32_t window_ms;
+    uint32_t n;
+    float mean, rms, min, max, std;
+    float slope;             /**< Least squares trend, units per second */
+};
+
+struct WinStats {
+    struct StatsBucket ring[STATS_MAX_BUCKETS + 1];
+    uint64_t cur;            /**< Index (t / hop) of the open bucket */
+    int started;
+};
+
+/**
+ * @brief Reads the environment and prints the settings.
+ */
+void stats_load_env(struct StatsConfig *cfg);
+
+/**
+ * @brief Adds one sample.
+ * @return 1 if buckets were closed first and summaries are due, 0 otherwise.
+ */
+int stats_add(struct WinStats *ws, const struct StatsConfig *cfg, uint64_t t_ns, float v);
+
+/**
+ * @brief Closes the open bucket once @p now_ns is past its end (plus
+ *        STATS_LATE_NS), so a stalled stream still reports.
+ * @return 1 if summaries are due, 0 otherwise.
+ */
+int stats_roll(struct WinStats *ws, const struct StatsConfig *cfg, uint64_t now_ns);
+
+/**
+ * @brief Summary of window @p w over the buckets closed so far.
+ * @return Number of samples in the window (0 = nothing to report).
+ */
+uint32_t stats_summary(const struct WinStats *ws, const struct StatsConfig *cfg, int w, struct StatsSummary *out);
+
+#endif // WINSTATS_H
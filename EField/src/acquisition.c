@@ -0,0 +1,461 @@
+/**
+ * @file acquisition.c
+ * @brief ADS1115 acquisition front-end.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ads1115_rpi.h"
+#include "acquisition.h"
+#include "timebase.h"
+
+#define RDY_EVENT_BURST 16
+
+static double elapsed_s(const struct timespec *a, const struct timespec *b) {
+    return (double)(b->tv_sec - a->tv_sec) + (double)(b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+static int num_channels(const struct AcqConfig *cfg) {
+    return cfg->mode == ACQ_MODE_SCAN ? cfg->scan_len : 1;
+}
+
+static void rate_tick(struct AcqState *st, int device, int channel) {
+    struct timespec now;
+
+    st->rate_count++;
+    st->dev[device].ch_count[channel]++;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double dt = elapsed_s(&st->rate_t0, &now);
+    if (dt < 1.0) return;
+
+    unsigned long syscalls = st->gpio_syscalls;
+    unsigned long transactions = 0;
+    for (int d = 0; d < st->cfg.num_devices; d++) {
+        syscalls += st->dev[d].adc.syscalls;
+        transactions += st->dev[d].adc.transactions;
+    }
+
+    st->rate_sps = (double)st->rate_count / dt;
+    printf("[STAT] %.1f muestras/s, %.2f syscalls/muestra, %.2f transacciones I2C/muestra\n",
+           st->rate_sps,
+           (double)(syscalls - st->last_syscalls) / (double)st->rate_count,
+           (double)(transactions - st->last_transactions) / (double)st->rate_count);
+    st->last_syscalls = syscalls;
+    st->last_transactions = transactions;
+    for (int d = 0; d < st->cfg.num_devices; d++) {
+        struct AcqDevice *dev = &st->dev[d];
+        for (int i = 0; i < num_channels(&st->cfg); i++) {
+            dev->ch_rate_sps[i] = (double)dev->ch_count[i] / dt;
+            printf("[STAT]   ADC 0x%02x canal %s: %.1f muestras/s (perdidas: %lu)\n",
+                   dev->adc.addr, st->cfg.mode == ACQ_MODE_SCAN ? st->cfg.scan[i].label : "-",
+                   dev->ch_rate_sps[i], dev->missed);
+            dev->ch_count[i] = 0;
+        }
+        if (st->cfg.mode == ACQ_MODE_WINDOW)
+            printf("[STAT]   ADC 0x%02x ventana: %lu excursiones, %lu avisos ALERT ya dentro\n",
+                   dev->adc.addr, dev->excursions, dev->stale_alerts);
+    }
+    st->rate_count = 0;
+    st->rate_t0 = now;
+}
+
+static const char *mode_name(enum AcqMode mode) {
+    switch (mode) {
+        case ACQ_MODE_CONTIN: return "contin";
+        case ACQ_MODE_WINDOW: return "window";
+        case ACQ_MODE_SCAN:   return "scan";
+        default:              return "single";
+    }
+}
+
+static int parse_scan(struct AcqConfig *cfg, const char *spec) {
+    char buf[256];
+    char *save = NULL;
+
+    snprintf(buf, sizeof(buf), "%s", spec);
+    cfg->scan_len = 0;
+    for (char *tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        if (cfg->scan_len == ACQ_MAX_SCAN) {
+            fprintf(stderr, "[ERROR] ADC_SCAN: máximo %d entradas\n", ACQ_MAX_SCAN);
+            return -1;
+        }
+        struct ScanEntry *e = &cfg->scan[cfg->scan_len];
+        char *sPga = strchr(tok, ':');
+        char *sSps = NULL;
+        if (sPga) {
+            *sPga++ = '\0';
+            sSps = strchr(sPga, ':');
+            if (sSps) *sSps++ = '\0';
+        }
+        if (muxFromName(tok, &e->mux) < 0) return -1;
+        snprintf(e->label, sizeof(e->label), "%s", tok);
+        e->pga = sPga ? pgaFromVolts(strtof(sPga, NULL)) : cfg->pga;
+        e->data_rate = sSps ? dataRateFromSps((unsigned int)atoi(sSps)) : cfg->data_rate;
+        cfg->scan_len++;
+    }
+    return cfg->scan_len > 0 ? 0 : -1;
+}
+
+/* Parses a comma separated list of integers (decimal or 0x..) */
+static int parse_int_list(const char *spec, int *out, int max) {
+    char buf[128];
+    char *save = NULL;
+    int n = 0;
+
+    snprintf(buf, sizeof(buf), "%s", spec);
+    for (char *tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        if (n == max) return -1;
+        out[n++] = (int)strtol(tok, NULL, 0);
+    }
+    return n;
+}
+
+int acq_load_env(struct AcqConfig *cfg) {
+    const char *sMode = getenv("ADC_MODE");
+    const char *sChan = getenv("ADC_CHANNEL");
+    const char *sAddr = getenv("ADC_ADDRS");
+    const char *sGpio = getenv("ADC_RDY_GPIO");
+    const char *sPoll = getenv("ADC_POLL_MS");
+    const char *sScan = getenv("ADC_SCAN");
+    const char *sAuto = getenv("ADC_AUTORANGE");
+    int addrs[ACQ_MAX_DEVICES];
+
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->mode = ACQ_MODE_SINGLE;
+    cfg->channel = 0;
+    cfg->pga = CONFIG_REG_PGA_4_096V;
+    cfg->data_rate = CONFIG_REG_DR_250SPS;
+    cfg->poll_ms = ACQ_WINDOW_POLL_MS;
+    cfg->num_devices = 1;
+    cfg->addrs[0] = ADS1115_ADDR_GND;
+    for (int i = 0; i < ACQ_MAX_DEVICES; i++) cfg->rdy_gpios[i] = ACQ_RDY_GPIO;
+
+    if (sMode && strcmp(sMode, "contin") == 0) {
+        cfg->mode = ACQ_MODE_CONTIN;
+        cfg->data_rate = CONFIG_REG_DR_860SPS;
+    } else if (sMode && strcmp(sMode, "window") == 0) {
+        cfg->mode = ACQ_MODE_WINDOW;
+        cfg->data_rate = CONFIG_REG_DR_860SPS;
+    } else if (sMode && strcmp(sMode, "scan") == 0) {
+        cfg->mode = ACQ_MODE_SCAN;
+        cfg->data_rate = CONFIG_REG_DR_860SPS;
+    }
+    if (sChan) cfg->channel = atoi(sChan);
+    if (sPoll) cfg->poll_ms = atoi(sPoll);
+    if (sAuto) cfg->autorange = atoi(sAuto);
+    if (cfg->autorange && (cfg->mode == ACQ_MODE_SINGLE || cfg->mode == ACQ_MODE_WINDOW)) {
+        // Los umbrales del comparador están en cuentas de un rango fijo
+        fprintf(stderr, "[WARN] ADC_AUTORANGE solo aplica a los modos contin y scan\n");
+        cfg->autorange = 0;
+    }
+    if (sAddr) {
+        cfg->num_devices = parse_int_list(sAddr, addrs, ACQ_MAX_DEVICES);
+        if (cfg->num_devices <= 0) {
+            fprintf(stderr, "[ERROR] ADC_ADDRS no válido: %s\n", sAddr);
+            return -1;
+        }
+        for (int i = 0; i < cfg->num_devices; i++) {
+            // El pin ADDR solo permite cuatro direcciones, y cada una es un único ADC
+            if (addrs[i] < ADS1115_ADDR_GND || addrs[i] > ADS1115_ADDR_SCL) {
+                fprintf(stderr, "[ERROR] ADC_ADDRS: 0x%02x fuera de 0x48..0x4B\n", addrs[i]);
+                return -1;
+            }
+            for (int j = 0; j < i; j++) {
+                if (addrs[j] == addrs[i]) {
+                    fprintf(stderr, "[ERROR] ADC_ADDRS: 0x%02x repetida\n", addrs[i]);
+                    return -1;
+                }
+            }
+            cfg->addrs[i] = (unsigned char)addrs[i];
+        }
+    }
+    if (cfg->mode != ACQ_MODE_SINGLE) {
+        // Cada ADC avisa por su propia línea RDY: con varios no vale el GPIO por defecto
+        int ngpio = sGpio ? parse_int_list(sGpio, cfg->rdy_gpios, ACQ_MAX_DEVICES) : 0;
+        if ((sGpio || cfg->num_devices > 1) && ngpio < cfg->num_devices) {
+            fprintf(stderr, "[ERROR] ADC_RDY_GPIO necesita un GPIO por ADC\n");
+            return -1;
+        }
+        for (int i = 0; i < cfg->num_devices; i++) {
+            for (int j = 0; j < i; j++) {
+                if (cfg->rdy_gpios[j] == cfg->rdy_gpios[i]) {
+                    fprintf(stderr, "[ERROR] ADC_RDY_GPIO: GPIO %d repetido\n", cfg->rdy_gpios[i]);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    fprintf(stdout, "[CFG] ADC_MODE=%s ADC_CHANNEL=%d (%u SPS) ADC_AUTORANGE=%d\n",
+            mode_name(cfg->mode), cfg->channel, dataRateSps(cfg->data_rate), cfg->autorange);
+    for (int i = 0; i < cfg->num_devices; i++)
+        fprintf(stdout, "[CFG]   ADC %d: addr=0x%02x RDY GPIO=%d\n", i, cfg->addrs[i], cfg->rdy_gpios[i]);
+
+    if (cfg->mode != ACQ_MODE_SCAN) return 0;
+
+    if (parse_scan(cfg, sScan ? sScan : "0") < 0) {
+        fprintf(stderr, "[ERROR] ADC_SCAN no válido: %s\n", sScan ? sScan : "");
+        return -1;
+    }
+    for (int i = 0; i < cfg->scan_len; i++) {
+        fprintf(stdout, "[CFG]   scan[%d] entrada=%s pga=0x%04x %u SPS\n", i,
+                cfg->scan[i].label, cfg->scan[i].pga, dataRateSps(cfg->scan[i].data_rate));
+    }
+    return 0;
+}
+
+static int start_converter(const struct AcqConfig *cfg, struct AcqDevice *dev) {
+    switch (cfg->mode) {
+        case ACQ_MODE_WINDOW: {
+            int16_t lo = dev->win_lo = voltageToRaw(cfg->v_low_thr, cfg->pga);
+            int16_t hi = dev->win_hi = voltageToRaw(cfg->v_high_thr, cfg->pga);
+            printf("[CFG] Comparador ventana 0x%02x: lo=%d hi=%d cuentas, muestreo cada %d ms\n",
+                   dev->adc.addr, lo, hi, cfg->poll_ms);
+            return startWindowComparator(&dev->adc, cfg->channel, cfg->pga, cfg->data_rate, lo, hi);
+        }
+        case ACQ_MODE_SCAN: {
+            const struct ScanEntry *e = &cfg->scan[0];
+            if (setConversionReady(&dev->adc) < 0) return -1;
+            dev->scan_pos = 0;
+            return startSingleShot(&dev->adc, e->mux, dev->range[0].pga, e->data_rate);
+        }
+        default:
+            return startContinuous(&dev->adc, cfg->channel, dev->range[0].pga, cfg->data_rate);
+    }
+}
+
+double acq_input_rate(const struct AcqConfig *cfg) {
+    switch (cfg->mode) {
+        case ACQ_MODE_SCAN: {
+            double period = 0;
+            for (int i = 0; i < cfg->scan_len; i++) period += 1.0 / dataRateSps(cfg->scan[i].data_rate);
+            return period > 0 ? 1.0 / period : 0;
+        }
+        case ACQ_MODE_SINGLE:
+            return (double)dataRateSps(cfg->data_rate) / cfg->num_devices;
+        case ACQ_MODE_WINDOW:
+            return cfg->poll_ms > 0 ? 1000.0 / cfg->poll_ms : 0;
+        default:
+            return dataRateSps(cfg->data_rate);
+    }
+}
+
+int acq_init(struct AcqState *st, const struct AcqConfig *cfg) {
+    memset(st, 0, sizeof(*st));
+    st->cfg = *cfg;
+    gpiod_line_bulk_init(&st->lines);
+    clock_gettime(CLOCK_MONOTONIC, &st->rate_t0);
+    for (int d = 0; d < ACQ_MAX_DEVICES; d++) st->dev[d].adc.fd = -1;
+
+    for (int d = 0; d < cfg->num_devices; d++) {
+        struct AcqDevice *dev = &st->dev[d];
+        if (openI2CBus(&dev->adc, ACQ_I2C_BUS) == -1 || setI2CSlave(&dev->adc, cfg->addrs[d]) == -1) {
+            acq_cleanup(st);
+            return -1;
+        }
+    }
+
+    if (cfg->mode == ACQ_MODE_SINGLE) return 0;
+
+    st->chip = gpiod_chip_open(ACQ_GPIO_CHIP);
+    if (!st->chip) {
+        perror("Failed to open GPIO chip");
+        acq_cleanup(st);
+        return -1;
+    }
+    for (int d = 0; d < cfg->num_devices; d++) {
+        struct AcqDevice *dev = &st->dev[d];
+        dev->line = gpiod_chip_get_line(st->chip, cfg->rdy_gpios[d]);
+        if (!dev->line) {
+            perror("Failed to get GPIO line");
+            acq_cleanup(st);
+            return -1;
+        }
+        if (gpiod_line_request_falling_edge_events(dev->line, "ads1115_rdy") < 0) {
+            perror("Failed to configure GPIO line");
+            dev->line = NULL;
+            acq_cleanup(st);
+            return -1;
+        }
+        gpiod_line_bulk_add(&st->lines, dev->line);
+    }
+    for (int d = 0; d < cfg->num_devices; d++) {
+        struct AcqDevice *dev = &st->dev[d];
+        for (int i = 0; i < num_channels(cfg); i++) {
+            const struct ScanEntry *e = &cfg->scan[i];
+            unsigned int dr = cfg->mode == ACQ_MODE_SCAN ? e->data_rate : cfg->data_rate;
+            // Bloques de envolvente de ~250 ms
+            autorange_init(&dev->range[i], cfg->mode == ACQ_MODE_SCAN ? e->pga : cfg->pga,
+                           (int)dataRateSps(dr) / 4);
+        }
+        if (start_converter(cfg, dev) < 0) {
+            acq_cleanup(st);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void report_range(struct AcqState *st, int d, int channel) {
+    printf("[INFO] ADC 0x%02x canal %s: rango ±%.3f V\n", st->dev[d].adc.addr,
+           st->cfg.mode == ACQ_MODE_SCAN ? st->cfg.scan[channel].label : "-",
+           pgaFullScale(st->dev[d].range[channel].pga));
+}
+
+/*
+ * Pipelined scan: the entry that just finished is still in the conversion
+ * register, so the next mux/PGA/rate is written (starting its conversion)
+ * before reading the previous result back. The readout then overlaps the
+ * next conversion instead of adding to it.
+ */
+static int scan_step(struct AcqState *st, int d, struct AdcSample *sample) {
+    struct AcqDevice *dev = &st->dev[d];
+    int done = dev->scan_pos;
+    int next = (done + 1) % st->cfg.scan_len;
+    const struct ScanEntry *e = &st->cfg.scan[next];
+    int16_t raw;
+
+    unsigned int pga = dev->range[done].pga;
+
+    if (startSingleShot(&dev->adc, e->mux, dev->range[next].pga, e->data_rate) < 0) return -1;
+    dev->scan_pos = next;
+    if (readLastConversion(&dev->adc, &raw) < 0) return -1;
+
+    sample->raw = raw;
+    sample->channel = (uint8_t)done;
+    sample->pga = (uint8_t)(pga >> 9);
+    rate_tick(st, d, done);
+    // El nuevo rango se aplica en la siguiente conversión de esta entrada
+    if (st->cfg.autorange && autorange_update(&dev->range[done], raw)) report_range(st, d, done);
+    return 0;
+}
+
+/* Services one device flagged in st->ready */
+static int service_device(struct AcqState *st, int d, struct AdcSample *sample) {
+    struct AcqDevice *dev = &st->dev[d];
+    int periodic = (st->periodic >> d) & 1;
+    int16_t raw;
+
+    st->ready &= ~(1u << d);
+    st->periodic &= ~(1u << d);
+    sample->device = (uint8_t)d;
+
+    if (!periodic) {
+        // Drenar todos los flancos pendientes: más de uno significa conversiones perdidas
+        struct gpiod_line_event events[RDY_EVENT_BURST];
+        int n = gpiod_line_event_read_multiple(dev->line, events, RDY_EVENT_BURST);
+        st->gpio_syscalls++;
+        if (n < 0) {
+            perror("Failed to read RDY event");
+            return -1;
+        }
+        if (n > 1 && st->cfg.mode != ACQ_MODE_WINDOW) dev->missed += (unsigned long)(n - 1);
+        // El kernel marca el flanco con CLOCK_MONOTONIC: fin de conversión, no de lectura
+        sample->t_ns = n > 0 ? timespec_to_ns(&events[n - 1].ts) : mono_now_ns();
+    } else {
+        sample->t_ns = mono_now_ns();
+    }
+
+    if (st->cfg.mode == ACQ_MODE_SCAN) return scan_step(st, d, sample);
+
+    // Leer la conversión también libera el latch de ALERT en modo ventana
+    if (readConversion(&dev->adc, &raw) < 0) return -1;
+    unsigned int pga = dev->range[0].pga;
+    if (dev->settle > 0) {
+        // Conversión que pudo empezar con la ganancia anterior: se descarta
+        dev->settle--;
+        return -1;
+    }
+    sample->raw = raw;
+    sample->pga = (uint8_t)(pga >> 9);
+    rate_tick(st, d, 0);
+    if (st->cfg.autorange && autorange_update(&dev->range[0], raw)) {
+        report_range(st, d, 0);
+        if (startContinuous(&dev->adc, st->cfg.channel, dev->range[0].pga, st->cfg.data_rate) < 0)
+            return -1;
+        dev->settle = 1;
+    }
+    if (st->cfg.mode == ACQ_MODE_WINDOW) {
+        /*
+         * The read just cleared the latch, so the flag follows the value read
+         * rather than the edge: an edge latched before a periodic read is
+         * still queued and arrives with a conversion that may be back inside,
+         * and a periodic read may be the one that finds the latch set.
+         */
+        int outside = raw >= dev->win_hi || raw <= dev->win_lo;
+        if (!periodic && !outside) dev->stale_alerts++;
+        if (outside) {
+            dev->excursions++;
+            return ACQ_EXCURSION;
+        }
+    }
+    return 0;
+}
+
+int acq_read(struct AcqState *st, struct AdcSample *sample) {
+    sample->channel = 0;
+    sample->device = 0;
+
+    if (st->cfg.mode == ACQ_MODE_SINGLE) {
+        int d = st->next_dev;
+        st->next_dev = (d + 1) % st->cfg.num_devices;
+        sample->device = (uint8_t)d;
+        if (readRaw(&st->dev[d].adc, st->cfg.channel, &sample->raw) < 0) return -1;
+        sample->t_ns = mono_now_ns();
+        sample->pga = CONFIG_REG_PGA_4_096V >> 9;
+        rate_tick(st, d, 0);
+        return 0;
+    }
+
+    if (!st->ready) {
+        int window = (st->cfg.mode == ACQ_MODE_WINDOW);
+        int wait_ms = window ? st->cfg.poll_ms : ACQ_RDY_TIMEOUT_MS;
+        struct timespec timeout = { wait_ms / 1000, (wait_ms % 1000) * 1000000L };
+        struct gpiod_line_bulk fired;
+
+        int ret = gpiod_line_event_wait_bulk(&st->lines, &timeout, &fired);
+        st->gpio_syscalls++;
+        if (ret < 0) {
+            perror("Failed to wait for RDY event");
+            return -1;
+        }
+        if (ret == 0) {
+            if (window) {
+                // Sin excursión: muestra periódica del flujo normal de cada ADC
+                st->ready = st->periodic = (1u << st->cfg.num_devices) - 1;
+            } else {
+                fprintf(stderr, "[WARN] Timeout esperando ALERT/RDY\n");
+                for (int d = 0; d < st->cfg.num_devices && st->cfg.mode == ACQ_MODE_SCAN; d++) {
+                    // Relanzar la conversión en curso por si se perdió el flanco
+                    struct AcqDevice *dev = &st->dev[d];
+                    const struct ScanEntry *e = &st->cfg.scan[dev->scan_pos];
+                    startSingleShot(&dev->adc, e->mux, dev->range[dev->scan_pos].pga, e->data_rate);
+                }
+                return -1;
+            }
+        } else {
+            for (unsigned int i = 0; i < gpiod_line_bulk_num_lines(&fired); i++) {
+                struct gpiod_line *line = gpiod_line_bulk_get_line(&fired, i);
+                for (int d = 0; d < st->cfg.num_devices; d++)
+                    if (st->dev[d].line == line) st->ready |= 1u << d;
+            }
+        }
+    }
+
+    for (int d = 0; d < st->cfg.num_devices; d++)
+        if (st->ready & (1u << d)) return service_device(st, d, sample);
+    return -1;
+}
+
+void acq_cleanup(struct AcqState *st) {
+    for (int d = 0; d < ACQ_MAX_DEVICES; d++) {
+        struct AcqDevice *dev = &st->dev[d];
+        if (dev->line) gpiod_line_release(dev->line);
+        dev->line = NULL;
+        if (dev->adc.fd >= 0) closeI2CBus(&dev->adc);
+    }
+    if (st->chip) gpiod_chip_close(st->chip);
+    st->chip = NULL;
+    gpiod_line_bulk_init(&st->lines);
+}
@@ -7,19 +7,19 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <linux/i2c.h>
 #include <linux/i2c-dev.h>
 #include <sys/ioctl.h>
 #include <fcntl.h>
 
 #include "ads1115_rpi.h"
 
-int i2cFile;
-unsigned char writeBuf[3] = {0};
-
-int openI2CBus(char *bus)
+int openI2CBus(struct ADS1115 *dev, char *bus)
 {
-	if ((i2cFile = open(bus, O_RDWR)) < 0)
+	memset(dev, 0, sizeof(*dev));
+	if ((dev->fd = open(bus, O_RDWR)) < 0)
 	{
 		printf("Failed to open the bus. \n");
 		return -1;
@@ -29,9 +29,10 @@ int openI2CBus(char *bus)
 	}
 }
 
-int setI2CSlave(unsigned char deviceAddr)
+int setI2CSlave(struct ADS1115 *dev, unsigned char deviceAddr)
 {
-	if(ioctl(i2cFile, I2C_SLAVE, deviceAddr) < 0)
+	dev->addr = deviceAddr;
+	if(ioctl(dev->fd, I2C_SLAVE, deviceAddr) < 0)
 	{
 		printf("Failed to set I2C_SLAVE at address: 0x%x. \n", deviceAddr);
 		return -1;
@@ -42,11 +43,86 @@ int setI2CSlave(unsigned char deviceAddr)
 
 }
 
-float readVoltage(int channel)
+void closeI2CBus(struct ADS1115 *dev)
+{
+	if (dev->fd >= 0) close(dev->fd);
+	dev->fd = -1;
+}
+
+/*
+ * All register access goes through ioctl(I2C_RDWR): a pointer write followed
+ * by a read is sent as one combined transaction (repeated start) in a single
+ * syscall, and the pointer is only re-sent when it is not already on the
+ * register being read.
+ */
+static int i2cTransfer(struct ADS1115 *dev, struct i2c_msg *msgs, unsigned int n)
+{
+	struct i2c_rdwr_ioctl_data data = { msgs, n };
+
+	dev->syscalls++;
+	dev->transactions++;
+	if (ioctl(dev->fd, I2C_RDWR, &data) != (int)n)
+	{
+		dev->pointerValid = 0;
+		return -1;
+	}
+	return 1;
+}
+
+int writeRegister(struct ADS1115 *dev, unsigned char reg, unsigned int value)
+{
+	unsigned char buf[3];
+	struct i2c_msg msg = { dev->addr, 0, 3, buf };
+
+	buf[0] = reg;
+	buf[1] = (value >> 8) & 0xFF;
+	buf[2] = value & 0xFF;
+	if (i2cTransfer(dev, &msg, 1) < 0)
+	{
+		printf("Failed to write register 0x%02x \n", reg);
+		return -1;
+	}
+	dev->pointer = reg;
+	dev->pointerValid = 1;
+	dev->regs[reg & 0x03] = value;
+	dev->regsValid |= 1 << (reg & 0x03);
+	if (reg == REG_CONFIG) dev->config = value;
+	return 1;
+}
+
+int writeRegisterCached(struct ADS1115 *dev, unsigned char reg, unsigned int value)
+{
+	if ((dev->regsValid & (1 << (reg & 0x03))) && dev->regs[reg & 0x03] == value)
+	{
+		dev->skippedWrites++;
+		return 1;
+	}
+	return writeRegister(dev, reg, value);
+}
+
+int readRegister(struct ADS1115 *dev, unsigned char reg, unsigned int *value)
+{
+	unsigned char buf[2] = {0};
+	struct i2c_msg msgs[2] = {
+		{ dev->addr, 0, 1, &reg },
+		{ dev->addr, I2C_M_RD, 2, buf },
+	};
+	int samePointer = dev->pointerValid && dev->pointer == reg;
+
+	if (i2cTransfer(dev, samePointer ? &msgs[1] : msgs, samePointer ? 1 : 2) < 0)
+	{
+		printf("Failed to read register 0x%02x \n", reg);
+		return -1;
+	}
+	dev->pointer = reg;
+	dev->pointerValid = 1;
+	*value = buf[0] << 8 | buf[1];
+	return 1;
+}
+
+int readRaw(struct ADS1115 *dev, int channel, int16_t *raw)
 {
-	unsigned char readBuf[2] = {0};
-	unsigned int analogVal;
-	float voltage;
+	unsigned int readVal = 0;
 	unsigned int config = 0;
 
 	config = 	CONFIG_REG_OS_SINGLE		|
@@ -58,50 +134,224 @@ float readVoltage(int channel)
 				CONFIG_REG_CLATCH_NONLATCH 	|
 				CONFIG_REG_CQUE_NONE;
 
-	void configDevice(unsigned int config)
+	config |= channelMux(channel);
+	// In single-shot mode the config write (OS bit) is what starts the conversion
+	if (writeRegister(dev, REG_CONFIG, config) < 0) return -1;
+
+	do {
+		if (readRegister(dev, REG_CONFIG, &readVal) < 0) return -1;
+	} while ((readVal & CONFIG_REG_OS_NOTBUSY) == 0);
+
+	if(readRegister(dev, REG_CONVERSION, &readVal) < 0) // read data and check error
 	{
-		writeBuf[0] = 0x01;
-		writeBuf[1] = config >> 8;
-		writeBuf[2] = config & 0xFF;
-		write(i2cFile, writeBuf, 3);
+		printf("Error : Input/Output Error \n");
+		return -1;
 	}
 
+	// The conversion register is two's complement: negative inputs read 0x8000..0xFFFF
+	*raw = (int16_t)readVal;
+	return 1;
+}
+
+float readVoltage(struct ADS1115 *dev, int channel)
+{
+	int16_t raw;
+
+	if (readRaw(dev, channel, &raw) < 0) return 0.0f;
+	return rawToVoltage(raw, CONFIG_REG_PGA_4_096V);
+}
+
+unsigned int channelMux(int channel)
+{
 	switch (channel) {
-		case 0:
-			config |= CONFIG_REG_MUX_CHAN_0;
-			break;
-		case 1:
-			config |= CONFIG_REG_MUX_CHAN_1;
-			break;
-		case 2:
-			config |= CONFIG_REG_MUX_CHAN_2;
-			break;
-		case 3:
-			config |= CONFIG_REG_MUX_CHAN_3;
-			break;
+		case 0: return CONFIG_REG_MUX_CHAN_0;
+		case 1: return CONFIG_REG_MUX_CHAN_1;
+		case 2: return CONFIG_REG_MUX_CHAN_2;
+		case 3: return CONFIG_REG_MUX_CHAN_3;
 		default:
 			printf("Give a channel between 0-3\n");
+			return CONFIG_REG_MUX_CHAN_0;
 	}
-	configDevice(config);
-	
-	while (readBuf[0] >> 7 != 1) {
-        	read(i2cFile, readBuf, 2);
-        }
-	
-	writeBuf[0] = 0x00;
-	write(i2cFile, writeBuf, 1);
-
-	if(read(i2cFile, readBuf, 2) != 2) // read data and check error
+}
+
+static int startConversions(struct ADS1115 *dev, unsigned int config, unsigned int loThresh, unsigned int hiThresh)
+{
+	// Only registers whose value actually changes are written
+	if (writeRegisterCached(dev, REG_LO_THRESH, loThresh) < 0) return -1;
+	if (writeRegisterCached(dev, REG_HI_THRESH, hiThresh) < 0) return -1;
+	if (writeRegisterCached(dev, REG_CONFIG, config) < 0) return -1;
+	return 1;
+}
+
+/*
+ * Continuous conversion with the ALERT/RDY pin in conversion-ready mode:
+ * Hi_thresh MSB = 1 and Lo_thresh MSB = 0 make the comparator pulse ALERT
+ * low for ~8 us at the end of every conversion, so the host only has to
+ * wait for the edge and read the conversion register once per sample.
+ */
+int startContinuous(struct ADS1115 *dev, int channel, unsigned int pga, unsigned int dataRate)
+{
+	unsigned int config;
+
+	config = 	channelMux(channel)			|
+				pga 						|
+				CONFIG_REG_MODE_CONTIN 		|
+				dataRate 					|
+				CONFIG_REG_CMODE_TRAD 		|
+				CONFIG_REG_CPOL_ACTIV_LOW 	|
+				CONFIG_REG_CLATCH_NONLATCH 	|
+				CONFIG_REG_CQUE_1CONV;
+
+	return startConversions(dev, config, 0x0000, 0x8000);
+}
+
+/*
+ * Continuous conversion with the window comparator: ALERT is asserted (low)
+ * as soon as a conversion falls outside [loThresh, hiThresh] and stays
+ * latched until the conversion register is read.
+ */
+int startWindowComparator(struct ADS1115 *dev, int channel, unsigned int pga,
+						  unsigned int dataRate, int16_t loThresh, int16_t hiThresh)
+{
+	unsigned int config;
+
+	config = 	channelMux(channel)			|
+				pga 						|
+				CONFIG_REG_MODE_CONTIN 		|
+				dataRate 					|
+				CONFIG_REG_CMODE_WINDOW 	|
+				CONFIG_REG_CPOL_ACTIV_LOW 	|
+				CONFIG_REG_CLATCH_LATCH 	|
+				CONFIG_REG_CQUE_1CONV;
+
+	return startConversions(dev, config, (uint16_t)loThresh, (uint16_t)hiThresh);
+}
+
+/*
+ * Single-shot conversions with the ALERT/RDY pin still in conversion-ready
+ * mode, used by the scan scheduler. The config write leaves the pointer on
+ * the config register, so the result must be fetched with readLastConversion().
+ */
+int setConversionReady(struct ADS1115 *dev)
+{
+	if (writeRegisterCached(dev, REG_LO_THRESH, 0x0000) < 0) return -1;
+	if (writeRegisterCached(dev, REG_HI_THRESH, 0x8000) < 0) return -1;
+	return 1;
+}
+
+int startSingleShot(struct ADS1115 *dev, unsigned int mux, unsigned int pga, unsigned int dataRate)
+{
+	unsigned int config;
+
+	config = 	CONFIG_REG_OS_SINGLE		|
+				(mux & CONFIG_REG_MUX_MASK)	|
+				pga 						|
+				CONFIG_REG_MODE_SINGLE 		|
+				dataRate 					|
+				CONFIG_REG_CMODE_TRAD 		|
+				CONFIG_REG_CPOL_ACTIV_LOW 	|
+				CONFIG_REG_CLATCH_NONLATCH 	|
+				CONFIG_REG_CQUE_1CONV;
+
+	return writeRegister(dev, REG_CONFIG, config);
+}
+
+int readLastConversion(struct ADS1115 *dev, int16_t *raw)
+{
+	unsigned int value;
+
+	if (readRegister(dev, REG_CONVERSION, &value) < 0) return -1;
+	*raw = (int16_t)value;
+	return 1;
+}
+
+int readConversion(struct ADS1115 *dev, int16_t *raw)
+{
+	unsigned int value;
+
+	// The pointer normally stays on the conversion register: a bare 2-byte read
+	if (readRegister(dev, REG_CONVERSION, &value) < 0)
 	{
 		printf("Error : Input/Output Error \n");
+		return -1;
 	}
-	else
-	{
-		analogVal = readBuf[0] << 8 | readBuf[1];
-		voltage = (float)analogVal*4.096/32767.0;
+	*raw = (int16_t)value;
+	return 1;
+}
+
+float pgaFullScale(unsigned int pga)
+{
+	switch (pga & CONFIG_REG_PGA_MASK) {
+		case CONFIG_REG_PGA_6_144V: return 6.144f;
+		case CONFIG_REG_PGA_4_096V: return 4.096f;
+		case CONFIG_REG_PGA_2_048V: return 2.048f;
+		case CONFIG_REG_PGA_1_024V: return 1.024f;
+		case CONFIG_REG_PGA_0_512V: return 0.512f;
+		default:                    return 0.256f;
 	}
+}
+
+float rawToVoltage(int16_t raw, unsigned int pga)
+{
+	return (float)raw * pgaFullScale(pga) / 32768.0f;
+}
+
+int16_t voltageToRaw(float voltage, unsigned int pga)
+{
+	float counts = voltage * 32768.0f / pgaFullScale(pga);
+
+	if (counts > 32767.0f) return 32767;
+	if (counts < -32768.0f) return -32768;
+	return (int16_t)counts;
+}
 
-	return voltage;
+static const unsigned int drSps[8] = {8, 16, 32, 64, 128, 250, 475, 860};
+
+unsigned int dataRateSps(unsigned int dataRate)
+{
+	return drSps[(dataRate & CONFIG_REG_DR_MASK) >> 5];
+}
+
+unsigned int dataRateFromSps(unsigned int sps)
+{
+	unsigned int i;
+
+	// Smallest rate that is at least the requested one
+	for (i = 0; i < 7 && drSps[i] < sps; i++);
+	return i << 5;
+}
+
+unsigned int pgaFromVolts(float fullScale)
+{
+	static const unsigned int pgas[6] = {
+		CONFIG_REG_PGA_0_256V, CONFIG_REG_PGA_0_512V, CONFIG_REG_PGA_1_024V,
+		CONFIG_REG_PGA_2_048V, CONFIG_REG_PGA_4_096V, CONFIG_REG_PGA_6_144V
+	};
+	int i;
+
+	// Tightest range that still covers the requested full scale
+	for (i = 0; i < 5 && pgaFullScale(pgas[i]) < fullScale - 0.0005f; i++);
+	return pgas[i];
 }
 
+int muxFromName(const char *name, unsigned int *mux)
+{
+	static const struct { const char *name; unsigned int mux; } muxes[] = {
+		{"0", CONFIG_REG_MUX_CHAN_0}, {"1", CONFIG_REG_MUX_CHAN_1},
+		{"2", CONFIG_REG_MUX_CHAN_2}, {"3", CONFIG_REG_MUX_CHAN_3},
+		{"0-1", CONFIG_REG_MUX_DIFF_0_1}, {"0-3", CONFIG_REG_MUX_DIFF_0_3},
+		{"1-3", CONFIG_REG_MUX_DIFF_1_3}, {"2-3", CONFIG_REG_MUX_DIFF_2_3},
+	};
+	unsigned int i;
 
+	for (i = 0; i < sizeof(muxes) / sizeof(muxes[0]); i++)
+	{
+		if (strcmp(name, muxes[i].name) == 0)
+		{
+			*mux = muxes[i].mux;
+			return 1;
+		}
+	}
+	printf("Unknown mux input: %s \n", name);
+	return -1;
+}
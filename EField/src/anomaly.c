@@ -0,0 +1,109 @@
+/**
+ * @file anomaly.c
+ * @brief Adaptive excursion thresholds from a rolling quantile baseline.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "anomaly.h"
+
+#define IQR_PER_SIGMA 1.349f   // Rango intercuartílico de una gaussiana de sigma 1
+
+void anomaly_load_env(struct AnomalyConfig *cfg, const struct ExcursionConfig *exc) {
+    const char *sOn = getenv("ANOM");
+    const char *sZ = getenv("ANOM_Z");
+    const char *sPct = getenv("ANOM_PCT");
+    const char *sSigma = getenv("ANOM_MIN_SIGMA_V");
+    const char *sWindow = getenv("ANOM_WINDOW_S");
+    const char *sUpdate = getenv("ANOM_UPDATE_S");
+    long window_s = sWindow ? atol(sWindow) : 600;
+    long update_s = sUpdate ? atol(sUpdate) : 10;
+
+    cfg->enabled = sOn ? atoi(sOn) != 0 : 0;
+    cfg->z = sZ ? strtof(sZ, NULL) : 6.0f;
+    cfg->pct = sPct ? strtof(sPct, NULL) : 0.0f;
+    cfg->min_sigma_v = sSigma ? strtof(sSigma, NULL) : 0.01f;
+    if (cfg->z < 0) cfg->z = 0;
+    if (cfg->pct <= 50 || cfg->pct >= 100) cfg->pct = 0;
+    if (cfg->min_sigma_v < 0) cfg->min_sigma_v = 0;
+    if (window_s < 2) window_s = 2;
+    if (update_s < 1) update_s = 1;
+    if (cfg->z == 0 && cfg->pct == 0) cfg->enabled = 0;
+    cfg->half_ns = (uint64_t)window_s * 500000000ull;
+    cfg->update_ns = (uint64_t)update_s * 1000000000ull;
+    cfg->dwell_ns = exc->dwell_ns;
+    cfg->exc_update_ns = exc->update_ns;
+
+    fprintf(stdout, "[CFG] ANOM=%d ANOM_Z=%.1f ANOM_PCT=%.2f ANOM_MIN_SIGMA_V=%.4f ANOM_WINDOW_S=%ld "
+            "ANOM_UPDATE_S=%ld\n", cfg->enabled, cfg->z, cfg->pct, cfg->min_sigma_v, window_s, update_s);
+}
+
+void anomaly_init(struct AnomalyDetector *d) {
+    memset(d, 0, sizeof(*d));
+    qsketch_reset(&d->half[0]);
+    qsketch_reset(&d->half[1]);
+}
+
+// Resume las dos mitades en mediana, sigma robusta y umbrales
+static void update_baseline(struct AnomalyDetector *d, const struct AnomalyConfig *cfg) {
+    struct QSketch all = d->half[d->cur];
+
+    qsketch_merge(&all, &d->half[d->cur ^ 1]);
+    float median = qsketch_quantile(&all, 0.5f);
+    if (isnan(median)) return;
+    float sigma = (qsketch_quantile(&all, 0.75f) - qsketch_quantile(&all, 0.25f)) / IQR_PER_SIGMA;
+    if (sigma < cfg->min_sigma_v) sigma = cfg->min_sigma_v;
+
+    float high = INFINITY, low = -INFINITY;
+    if (cfg->z > 0) {
+        high = median + cfg->z * sigma;
+        low = median - cfg->z * sigma;
+    }
+    if (cfg->pct > 0) {
+        float ph = qsketch_quantile(&all, cfg->pct / 100.0f);
+        float pl = qsketch_quantile(&all, 1.0f - cfg->pct / 100.0f);
+        // Con los dos criterios manda el más permisivo
+        high = cfg->z > 0 && high > ph ? high : ph;
+        low = cfg->z > 0 && low < pl ? low : pl;
+    }
+
+    d->base = (struct AnomalyBaseline) { 1, median, sigma, low, high };
+    d->exc.v_high_thr = high;
+    d->exc.v_low_thr = low;
+    d->exc.hyst_v = sigma;
+    d->exc.dwell_ns = cfg->dwell_ns;
+    d->exc.update_ns = cfg->exc_update_ns;
+    excursion_scale(&d->exc);
+}
+
+int anomaly_add(struct AnomalyDetector *d, const struct AnomalyConfig *cfg, const struct AdcSample *s,
+                struct ExcursionEvent *ev) {
+    int ret = 0;
+
+    if (!d->started) {
+        d->started = 1;
+        d->half_start_ns = s->t_ns;
+    }
+    if (s->t_ns - d->half_start_ns >= cfg->half_ns) {
+        // Tras un parón de más de media ventana la mitad anterior ya no es reciente
+        d->have_prev = s->t_ns - d->half_start_ns < 2 * cfg->half_ns;
+        d->cur ^= 1;
+        qsketch_reset(&d->half[d->cur]);
+        if (!d->have_prev) qsketch_reset(&d->half[d->cur ^ 1]);
+        d->half_start_ns = s->t_ns;
+    }
+    if (d->have_prev && s->t_ns >= d->next_update_ns) {
+        update_baseline(d, cfg);
+        d->next_update_ns = s->t_ns + cfg->update_ns;
+    }
+
+    if (d->base.valid) ret = excursion_update(&d->tr, &d->exc, s, 0, ev);
+    if (excursion_idle(&d->tr)) qsketch_add(&d->half[d->cur], sample_volts(s));
+    return ret;
+}
+
+float anomaly_z(const struct AnomalyDetector *d, float v) {
+    return d->base.valid && d->base.sigma > 0 ? (v - d->base.median) / d->base.sigma : 0.0f;
+}
@@ -0,0 +1,67 @@
+/**
+ * @file autorange.c
+ * @brief Automatic PGA selection with hysteresis.
+ */
+
+#include <stdlib.h>
+#include "ads1115_rpi.h"
+#include "autorange.h"
+
+/* Ranges from widest to tightest */
+static const unsigned int ranges[] = {
+    CONFIG_REG_PGA_6_144V, CONFIG_REG_PGA_4_096V, CONFIG_REG_PGA_2_048V,
+    CONFIG_REG_PGA_1_024V, CONFIG_REG_PGA_0_512V, CONFIG_REG_PGA_0_256V
+};
+#define NUM_RANGES ((int)(sizeof(ranges) / sizeof(ranges[0])))
+
+static int range_index(unsigned int pga) {
+    for (int i = 0; i < NUM_RANGES; i++)
+        if (ranges[i] == (pga & CONFIG_REG_PGA_MASK)) return i;
+    return NUM_RANGES - 1;   // 0x0A00..0x0E00 are all ±0.256 V
+}
+
+void autorange_init(struct AutoRange *ar, unsigned int pga, int block_len) {
+    ar->pga = ranges[range_index(pga)];
+    ar->block_len = block_len > 0 ? block_len : 1;
+    ar->block_n = 0;
+    ar->block_peak = 0;
+    ar->calm_blocks = 0;
+    ar->switches = 0;
+}
+
+static void set_range(struct AutoRange *ar, int idx) {
+    ar->pga = ranges[idx];
+    ar->block_n = 0;
+    ar->block_peak = 0;
+    ar->calm_blocks = 0;
+    ar->switches++;
+}
+
+int autorange_update(struct AutoRange *ar, int16_t raw) {
+    int idx = range_index(ar->pga);
+    int mag = abs((int)raw);
+
+    if (mag >= (int)(AR_UP_FRACTION * 32768.0f) && idx > 0) {
+        set_range(ar, idx - 1);
+        return 1;
+    }
+
+    if (mag > ar->block_peak) ar->block_peak = mag;
+    if (++ar->block_n < ar->block_len) return 0;
+
+    // Fin de bloque: ¿cabría el pico en el rango más estrecho con margen?
+    int calm = 0;
+    if (idx < NUM_RANGES - 1) {
+        float ratio = pgaFullScale(ranges[idx + 1]) / pgaFullScale(ranges[idx]);
+        calm = ar->block_peak < (int)(AR_DOWN_FRACTION * ratio * 32768.0f);
+    }
+    ar->block_n = 0;
+    ar->block_peak = 0;
+    ar->calm_blocks = calm ? ar->calm_blocks + 1 : 0;
+
+    if (ar->calm_blocks >= AR_CALM_BLOCKS) {
+        set_range(ar, idx + 1);
+        return 1;
+    }
+    return 0;
+}
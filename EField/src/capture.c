@@ -0,0 +1,241 @@
+/**
+ * @file capture.c
+ * @brief Binary capture format helpers shared by the recorder and the tools.
+ */
+
+#include <string.h>
+#include "capture.h"
+
+/* Peor caso de una muestra empaquetada: 4+32 bits de tiempo, 4+17 de valor */
+#define PACK_MAX_SAMPLE_BITS 57
+
+/* CRC-32 (IEEE 802.3, polinomio reflejado 0xEDB88320), precalculada: la usan varios hilos */
+static const uint32_t crc_table[256] = {
+    0x00000000u, 0x77073096u, 0xee0e612cu, 0x990951bau, 0x076dc419u, 0x706af48fu,
+    0xe963a535u, 0x9e6495a3u, 0x0edb8832u, 0x79dcb8a4u, 0xe0d5e91eu, 0x97d2d988u,
+    0x09b64c2bu, 0x7eb17cbdu, 0xe7b82d07u, 0x90bf1d91u, 0x1db71064u, 0x6ab020f2u,
+    0xf3b97148u, 0x84be41deu, 0x1adad47du, 0x6ddde4ebu, 0xf4d4b551u, 0x83d385c7u,
+    0x136c9856u, 0x646ba8c0u, 0xfd62f97au, 0x8a65c9ecu, 0x14015c4fu, 0x63066cd9u,
+    0xfa0f3d63u, 0x8d080df5u, 0x3b6e20c8u, 0x4c69105eu, 0xd56041e4u, 0xa2677172u,
+    0x3c03e4d1u, 0x4b04d447u, 0xd20d85fdu, 0xa50ab56bu, 0x35b5a8fau, 0x42b2986cu,
+    0xdbbbc9d6u, 0xacbcf940u, 0x32d86ce3u, 0x45df5c75u, 0xdcd60dcfu, 0xabd13d59u,
+    0x26d930acu, 0x51de003au, 0xc8d75180u, 0xbfd06116u, 0x21b4f4b5u, 0x56b3c423u,
+    0xcfba9599u, 0xb8bda50fu, 0x2802b89eu, 0x5f058808u, 0xc60cd9b2u, 0xb10be924u,
+    0x2f6f7c87u, 0x58684c11u, 0xc1611dabu, 0xb6662d3du, 0x76dc4190u, 0x01db7106u,
+    0x98d220bcu, 0xefd5102au, 0x71b18589u, 0x06b6b51fu, 0x9fbfe4a5u, 0xe8b8d433u,
+    0x7807c9a2u, 0x0f00f934u, 0x9609a88eu, 0xe10e9818u, 0x7f6a0dbbu, 0x086d3d2du,
+    0x91646c97u, 0xe6635c01u, 0x6b6b51f4u, 0x1c6c6162u, 0x856530d8u, 0xf262004eu,
+    0x6c0695edu, 0x1b01a57bu, 0x8208f4c1u, 0xf50fc457u, 0x65b0d9c6u, 0x12b7e950u,
+    0x8bbeb8eau, 0xfcb9887cu, 0x62dd1ddfu, 0x15da2d49u, 0x8cd37cf3u, 0xfbd44c65u,
+    0x4db26158u, 0x3ab551ceu, 0xa3bc0074u, 0xd4bb30e2u, 0x4adfa541u, 0x3dd895d7u,
+    0xa4d1c46du, 0xd3d6f4fbu, 0x4369e96au, 0x346ed9fcu, 0xad678846u, 0xda60b8d0u,
+    0x44042d73u, 0x33031de5u, 0xaa0a4c5fu, 0xdd0d7cc9u, 0x5005713cu, 0x270241aau,
+    0xbe0b1010u, 0xc90c2086u, 0x5768b525u, 0x206f85b3u, 0xb966d409u, 0xce61e49fu,
+    0x5edef90eu, 0x29d9c998u, 0xb0d09822u, 0xc7d7a8b4u, 0x59b33d17u, 0x2eb40d81u,
+    0xb7bd5c3bu, 0xc0ba6cadu, 0xedb88320u, 0x9abfb3b6u, 0x03b6e20cu, 0x74b1d29au,
+    0xead54739u, 0x9dd277afu, 0x04db2615u, 0x73dc1683u, 0xe3630b12u, 0x94643b84u,
+    0x0d6d6a3eu, 0x7a6a5aa8u, 0xe40ecf0bu, 0x9309ff9du, 0x0a00ae27u, 0x7d079eb1u,
+    0xf00f9344u, 0x8708a3d2u, 0x1e01f268u, 0x6906c2feu, 0xf762575du, 0x806567cbu,
+    0x196c3671u, 0x6e6b06e7u, 0xfed41b76u, 0x89d32be0u, 0x10da7a5au, 0x67dd4accu,
+    0xf9b9df6fu, 0x8ebeeff9u, 0x17b7be43u, 0x60b08ed5u, 0xd6d6a3e8u, 0xa1d1937eu,
+    0x38d8c2c4u, 0x4fdff252u, 0xd1bb67f1u, 0xa6bc5767u, 0x3fb506ddu, 0x48b2364bu,
+    0xd80d2bdau, 0xaf0a1b4cu, 0x36034af6u, 0x41047a60u, 0xdf60efc3u, 0xa867df55u,
+    0x316e8eefu, 0x4669be79u, 0xcb61b38cu, 0xbc66831au, 0x256fd2a0u, 0x5268e236u,
+    0xcc0c7795u, 0xbb0b4703u, 0x220216b9u, 0x5505262fu, 0xc5ba3bbeu, 0xb2bd0b28u,
+    0x2bb45a92u, 0x5cb36a04u, 0xc2d7ffa7u, 0xb5d0cf31u, 0x2cd99e8bu, 0x5bdeae1du,
+    0x9b64c2b0u, 0xec63f226u, 0x756aa39cu, 0x026d930au, 0x9c0906a9u, 0xeb0e363fu,
+    0x72076785u, 0x05005713u, 0x95bf4a82u, 0xe2b87a14u, 0x7bb12baeu, 0x0cb61b38u,
+    0x92d28e9bu, 0xe5d5be0du, 0x7cdcefb7u, 0x0bdbdf21u, 0x86d3d2d4u, 0xf1d4e242u,
+    0x68ddb3f8u, 0x1fda836eu, 0x81be16cdu, 0xf6b9265bu, 0x6fb077e1u, 0x18b74777u,
+    0x88085ae6u, 0xff0f6a70u, 0x66063bcau, 0x11010b5cu, 0x8f659effu, 0xf862ae69u,
+    0x616bffd3u, 0x166ccf45u, 0xa00ae278u, 0xd70dd2eeu, 0x4e048354u, 0x3903b3c2u,
+    0xa7672661u, 0xd06016f7u, 0x4969474du, 0x3e6e77dbu, 0xaed16a4au, 0xd9d65adcu,
+    0x40df0b66u, 0x37d83bf0u, 0xa9bcae53u, 0xdebb9ec5u, 0x47b2cf7fu, 0x30b5ffe9u,
+    0xbdbdf21cu, 0xcabac28au, 0x53b39330u, 0x24b4a3a6u, 0xbad03605u, 0xcdd70693u,
+    0x54de5729u, 0x23d967bfu, 0xb3667a2eu, 0xc4614ab8u, 0x5d681b02u, 0x2a6f2b94u,
+    0xb40bbe37u, 0xc30c8ea1u, 0x5a05df1bu, 0x2d02ef8du
+};
+
+uint32_t capture_crc32(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = data;
+
+    crc = ~crc;
+    while (len--) crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static uint32_t block_crc(const struct CaptureBlock *b) {
+    struct CaptureBlockHeader h = b->h;
+
+    h.crc32 = 0;
+    uint32_t crc = capture_crc32(0, &h, sizeof(h));
+    return capture_crc32(crc, b->samples, sizeof(b->samples));
+}
+
+void capture_block_seal(struct CaptureBlock *b) {
+    b->h.crc32 = block_crc(b);
+}
+
+int capture_block_valid(const struct CaptureBlock *b) {
+    if (b->h.magic != CAP_MAGIC || b->h.version != CAP_VERSION) return 0;
+    if (b->h.header_size != CAP_HEADER_SIZE) return 0;
+    if (b->h.flags & CAP_FLAG_PACKED) {
+        if (b->h.payload_bits > CAP_PAYLOAD_BITS) return 0;
+    } else if (b->h.count > CAP_BLOCK_SAMPLES) {
+        return 0;
+    }
+    return b->h.crc32 == block_crc(b);
+}
+
+static void put_bits(struct CapturePacker *p, uint32_t v, int n) {
+    while (n > 0) {
+        int room = 8 - (int)(p->bits & 7);
+        int take = n < room ? n : room;
+        uint32_t chunk = (v >> (n - take)) & ((1u << take) - 1);
+        p->buf[p->bits >> 3] |= (uint8_t)(chunk << (room - take));
+        p->bits += (uint32_t)take;
+        n -= take;
+    }
+}
+
+static uint32_t get_bits(struct CaptureUnpacker *u, int n) {
+    uint32_t v = 0;
+    while (n > 0) {
+        int room = 8 - (int)(u->bits & 7);
+        int take = n < room ? n : room;
+        uint32_t byte = u->buf[u->bits >> 3];
+        v = (v << take) | ((byte >> (room - take)) & ((1u << take) - 1));
+        u->bits += (uint32_t)take;
+        n -= take;
+    }
+    return v;
+}
+
+static uint32_t zigzag(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t v) {
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+void capture_pack_begin(struct CapturePacker *p, struct CaptureBlock *b, uint64_t t_ns, int16_t raw,
+                        uint32_t tick_ns) {
+    memset(b->samples, 0, sizeof(b->samples));
+    p->buf = (uint8_t *)b->samples;
+    p->bits = 0;
+    p->start_ns = t_ns;
+    p->tick_ns = tick_ns ? tick_ns : 1;
+    p->last_tick = 0;
+    p->last_delta = 0;
+    p->last_raw = raw;
+    put_bits(p, (uint16_t)raw, 16);
+    b->h.flags |= CAP_FLAG_PACKED;
+    b->h.tick_ns = p->tick_ns;
+    b->h.count = 1;
+    b->h.payload_bits = (uint16_t)p->bits;
+}
+
+int capture_pack_append(struct CapturePacker *p, struct CaptureBlock *b, uint64_t t_ns, int16_t raw) {
+    uint64_t tick = (t_ns - p->start_ns + p->tick_ns / 2) / p->tick_ns;
+    int64_t delta = (int64_t)(tick - p->last_tick);
+    int64_t dod = delta - p->last_delta;
+
+    if (p->bits + PACK_MAX_SAMPLE_BITS > CAP_PAYLOAD_BITS || b->h.count == UINT16_MAX) return 0;
+    if (dod < INT32_MIN || dod > INT32_MAX) return 0;
+
+    // Marca de tiempo: delta-of-delta en el cubo más pequeño que la contiene
+    if (dod == 0) {
+        put_bits(p, 0x0, 1);
+    } else if (dod >= -8 && dod <= 7) {
+        put_bits(p, 0x2, 2);
+        put_bits(p, (uint32_t)dod & 0xF, 4);
+    } else if (dod >= -256 && dod <= 255) {
+        put_bits(p, 0x6, 3);
+        put_bits(p, (uint32_t)dod & 0x1FF, 9);
+    } else if (dod >= -2048 && dod <= 2047) {
+        put_bits(p, 0xE, 4);
+        put_bits(p, (uint32_t)dod & 0xFFF, 12);
+    } else {
+        put_bits(p, 0xF, 4);
+        put_bits(p, (uint32_t)dod, 32);
+    }
+
+    // Cuentas: diferencia con la anterior en zigzag
+    uint32_t zz = zigzag((int32_t)raw - p->last_raw);
+    if (zz == 0) {
+        put_bits(p, 0x0, 1);
+    } else if (zz < (1u << 3)) {
+        put_bits(p, 0x2, 2);
+        put_bits(p, zz, 3);
+    } else if (zz < (1u << 6)) {
+        put_bits(p, 0x6, 3);
+        put_bits(p, zz, 6);
+    } else if (zz < (1u << 10)) {
+        put_bits(p, 0xE, 4);
+        put_bits(p, zz, 10);
+    } else {
+        put_bits(p, 0xF, 4);
+        put_bits(p, zz, 17);
+    }
+
+    p->last_tick = tick;
+    p->last_delta = delta;
+    p->last_raw = raw;
+    b->h.count++;
+    b->h.payload_bits = (uint16_t)p->bits;
+    return 1;
+}
+
+// Devuelve el índice del cubo (0..4) leyendo hasta cuatro bits de prefijo
+static int get_bucket(struct CaptureUnpacker *u) {
+    int k = 0;
+    while (k < 4 && get_bits(u, 1)) k++;
+    return k;
+}
+
+static int32_t sign_extend(uint32_t v, int n) {
+    uint32_t m = 1u << (n - 1);
+    return (int32_t)((v ^ m) - m);
+}
+
+void capture_unpack_begin(struct CaptureUnpacker *u, const struct CaptureBlock *b) {
+    u->buf = (const uint8_t *)b->samples;
+    u->bits = 0;
+    u->end_bits = b->h.payload_bits;
+    u->left = b->h.count;
+    u->last_tick = 0;
+    u->last_delta = 0;
+    u->last_raw = 0;
+}
+
+int capture_unpack_next(struct CaptureUnpacker *u, const struct CaptureBlock *b, uint64_t *t_ns, int16_t *raw) {
+    static const int dod_bits[5] = { 0, 4, 9, 12, 32 };
+    static const int val_bits[5] = { 0, 3, 6, 10, 17 };
+    uint16_t i = b->h.count - u->left;
+
+    if (u->left == 0) return 0;
+    u->left--;
+
+    if (!(b->h.flags & CAP_FLAG_PACKED)) {
+        *t_ns = b->h.start_mono_ns + (uint64_t)i * b->h.period_ns;
+        *raw = b->samples[i];
+        return 1;
+    }
+    if (i == 0) {
+        u->last_raw = (int16_t)get_bits(u, 16);
+    } else {
+        int k = get_bucket(u);
+        int64_t dod = k ? sign_extend(get_bits(u, dod_bits[k]), dod_bits[k]) : 0;
+        k = get_bucket(u);
+        int32_t d = k ? unzigzag(get_bits(u, val_bits[k])) : 0;
+
+        u->last_delta += dod;
+        u->last_tick += (uint64_t)u->last_delta;
+        u->last_raw = (int16_t)(u->last_raw + d);
+    }
+    if (u->bits > u->end_bits) return 0;
+    *t_ns = b->h.start_mono_ns + u->last_tick * b->h.tick_ns;
+    *raw = u->last_raw;
+    return 1;
+}
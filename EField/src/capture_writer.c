@@ -0,0 +1,221 @@
+/**
+ * @file capture_writer.c
+ * @brief Binary capture sink (.efb).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "capture_writer.h"
+
+#define NS_PER_MS 1000000ull
+
+void capture_writer_load_env(struct CaptureWriterConfig *cfg) {
+    const char *sCodec = getenv("CAP_CODEC");
+    const char *sTick = getenv("CAP_TICK_NS");
+    const char *sFlush = getenv("CAP_FLUSH_MS");
+    const char *sSync = getenv("CAP_SYNC_MS");
+    const char *sRing = getenv("CAP_RING");
+
+    cfg->packed = !(sCodec && strcmp(sCodec, "raw") == 0);
+    cfg->tick_ns = sTick ? (uint32_t)atol(sTick) : 1000;
+    if (cfg->tick_ns == 0) cfg->tick_ns = 1;
+    cfg->flush_ms = sFlush ? atoi(sFlush) : 5000;
+    cfg->sync_ms = sSync ? atoi(sSync) : 5000;
+    cfg->ring_slots = sRing ? (size_t)atol(sRing) : 256;
+    if (cfg->flush_ms <= 0) cfg->flush_ms = 5000;
+
+    fprintf(stdout, "[CFG] CAP_CODEC=%s CAP_TICK_NS=%u CAP_FLUSH_MS=%d CAP_SYNC_MS=%d CAP_RING=%zu\n",
+            cfg->packed ? "packed" : "raw", cfg->tick_ns, cfg->flush_ms, cfg->sync_ms, cfg->ring_slots);
+}
+
+static void write_out(struct CaptureWriter *w) {
+    const char *p = (const char *)w->out;
+    size_t len = w->out_n * sizeof(struct CaptureBlock);
+
+    while (len > 0) {
+        ssize_t n = write(w->seg.fd, p, len);
+        if (n < 0) {
+            perror("Error escribiendo captura binaria");
+            w->lost_bytes += len;
+            break;
+        }
+        p += n;
+        len -= (size_t)n;
+        w->seg.bytes += (uint64_t)n;
+    }
+    w->blocks_written += w->out_n;
+    w->out_n = 0;
+    w->dirty = 1;
+}
+
+static void maybe_sync(struct CaptureWriter *w, uint64_t now, int force) {
+    if (!w->dirty) return;
+    if (!force && (w->cfg.sync_ms <= 0 || now - w->last_sync_ns < (uint64_t)w->cfg.sync_ms * NS_PER_MS))
+        return;
+    if (fdatasync(w->seg.fd) < 0) perror("Error en fdatasync de la captura");
+    w->last_sync_ns = mono_now_ns();
+    w->dirty = 0;
+}
+
+/* Completes the header of the stream's open block and moves it to the output batch */
+static void close_block(struct CaptureWriter *w, struct CaptureStream *st) {
+    struct CaptureBlock *b = st->block;
+    struct CaptureBlockHeader *h = &b->h;
+
+    if (h->count == 0) return;
+    h->period_ns = h->count > 1 ? (uint32_t)((st->last_ns - h->start_mono_ns) / (h->count - 1u)) : 0;
+    h->start_utc_ns = time_anchor_to_utc_ns(&w->anchor, h->start_mono_ns);
+    h->seq = w->seq++;
+    // Relleno a cero para que el bloque parcial tenga un CRC reproducible
+    if (!(h->flags & CAP_FLAG_PACKED))
+        memset(&b->samples[h->count], 0, (CAP_BLOCK_SAMPLES - h->count) * sizeof(int16_t));
+    capture_block_seal(b);
+    w->samples_written += h->count;
+
+    memcpy(&w->out[w->out_n++], b, sizeof(*b));
+    h->count = 0;
+    if (w->out_n == CAPW_WRITE_BLOCKS) write_out(w);
+}
+
+static void open_block(struct CaptureWriter *w, struct CaptureStream *st, const struct AdcSample *s) {
+    struct CaptureBlockHeader *h = &st->block->h;
+
+    memset(h, 0, sizeof(*h));
+    h->magic = CAP_MAGIC;
+    h->version = CAP_VERSION;
+    h->header_size = CAP_HEADER_SIZE;
+    h->start_mono_ns = s->t_ns;
+    h->channel = s->channel;
+    h->device = s->device;
+    h->pga = s->pga;
+    h->lsb_volts = sample_lsb(s->pga);
+    st->spacing_ns = 0;
+    if (w->cfg.packed) {
+        capture_pack_begin(&st->pk, st->block, s->t_ns, s->raw, w->cfg.tick_ns);
+    } else {
+        st->block->samples[0] = s->raw;
+        h->count = 1;
+    }
+}
+
+static void append_sample(struct CaptureWriter *w, const struct AdcSample *s) {
+    struct CaptureStream *st = &w->streams[(s->device * ACQ_MAX_SCAN + s->channel) % CAPW_MAX_STREAMS];
+    struct CaptureBlockHeader *h = &st->block->h;
+
+    if (h->count > 0) {
+        uint64_t gap = s->t_ns - st->last_ns;
+        // Un bloque solo admite una ganancia; sin empaquetar, además, muestras equiespaciadas
+        int broken = h->pga != s->pga || s->t_ns <= st->last_ns ||
+                     (!w->cfg.packed && st->spacing_ns &&
+                      (gap > st->spacing_ns + st->spacing_ns / 2 || gap < st->spacing_ns / 2));
+        if (broken) close_block(w, st);
+        else if (h->count == 1) st->spacing_ns = gap;
+    }
+    if (h->count == 0) {
+        open_block(w, st, s);
+    } else if (w->cfg.packed) {
+        if (!capture_pack_append(&st->pk, st->block, s->t_ns, s->raw)) {
+            close_block(w, st);
+            open_block(w, st, s);
+        }
+    } else {
+        st->block->samples[h->count++] = s->raw;
+        if (h->count == CAP_BLOCK_SAMPLES) close_block(w, st);
+    }
+    st->last_ns = s->t_ns;
+}
+
+static void close_stale_blocks(struct CaptureWriter *w, uint64_t now, int all) {
+    for (int i = 0; i < CAPW_MAX_STREAMS; i++) {
+        struct CaptureStream *st = &w->streams[i];
+        uint64_t start = st->block->h.start_mono_ns;
+        if (st->block->h.count == 0) continue;
+        if (all || (now > start && now - start >= (uint64_t)w->cfg.flush_ms * NS_PER_MS))
+            close_block(w, st);
+    }
+    if (w->out_n) write_out(w);
+}
+
+static void rotate(struct CaptureWriter *w) {
+    maybe_sync(w, mono_now_ns(), 1);
+    segment_rotate(w->segs, &w->seg, w->prefix, "efb");
+}
+
+static void *writer_task(void *arg) {
+    struct CaptureWriter *w = arg;
+
+    while (atomic_load(&w->running) || ring_occupancy(&w->ring) > 0) {
+        struct SampleBatch *b = ring_wait(&w->ring, w->cfg.flush_ms / 4 + 1);
+        if (b) {
+            for (uint32_t i = 0; i < b->count; i++) append_sample(w, &b->samples[i]);
+            ring_release(&w->ring);
+        }
+        uint64_t now = mono_now_ns();
+        if (now - w->anchor.mono_ns >= TIME_ANCHOR_PERIOD_S * 1000000000ull)
+            time_anchor_capture(&w->anchor);
+        close_stale_blocks(w, now, 0);
+        maybe_sync(w, now, 0);
+        if (segment_due(w->segs, &w->seg, now)) rotate(w);
+    }
+    close_stale_blocks(w, mono_now_ns(), 1);
+    maybe_sync(w, mono_now_ns(), 1);
+    segment_close(w->segs, &w->seg);
+    printf("[INFO] Captura binaria: %lu bloques, %llu muestras, %.2f bits/muestra, %llu bytes perdidos\n",
+           w->blocks_written, w->samples_written,
+           w->samples_written ? w->blocks_written * CAP_BLOCK_SIZE * 8.0 / w->samples_written : 0.0,
+           w->lost_bytes);
+    return NULL;
+}
+
+int capture_writer_open(struct CaptureWriter *w, const struct CaptureWriterConfig *cfg,
+                        struct SegmentIndex *segs, const char *prefix) {
+    memset(w, 0, sizeof(*w));
+    w->cfg = *cfg;
+    w->segs = segs;
+    snprintf(w->prefix, sizeof(w->prefix), "%s", prefix);
+
+    if (segment_open(segs, &w->seg, w->prefix, "efb") < 0) return -1;
+    w->blocks = aligned_alloc(CAP_BLOCK_SIZE, (CAPW_MAX_STREAMS + CAPW_WRITE_BLOCKS) * sizeof(struct CaptureBlock));
+    if (!w->blocks || ring_init(&w->ring, cfg->ring_slots, RING_BATCH_MAX) < 0) {
+        perror("Error reservando los bloques de captura");
+        free(w->blocks);
+        segment_close(segs, &w->seg);
+        return -1;
+    }
+    for (int i = 0; i < CAPW_MAX_STREAMS; i++) {
+        w->streams[i].block = &w->blocks[i];
+        w->blocks[i].h.count = 0;
+    }
+    w->out = &w->blocks[CAPW_MAX_STREAMS];
+    time_anchor_capture(&w->anchor);
+    w->last_sync_ns = mono_now_ns();
+
+    atomic_store(&w->running, 1);
+    if (pthread_create(&w->thread, NULL, writer_task, w) != 0) {
+        perror("Error creando el hilo de captura");
+        ring_destroy(&w->ring);
+        free(w->blocks);
+        segment_close(segs, &w->seg);
+        return -1;
+    }
+    return 0;
+}
+
+void capture_writer_push(struct CaptureWriter *w, const struct AdcSample *s) {
+    ring_push(&w->ring, s);
+    ring_flush(&w->ring, s->t_ns, RING_BATCH_MAX_MS * NS_PER_MS);
+}
+
+void capture_writer_idle(struct CaptureWriter *w, uint64_t now_ns) {
+    ring_flush(&w->ring, now_ns, RING_BATCH_MAX_MS * NS_PER_MS);
+}
+
+void capture_writer_close(struct CaptureWriter *w) {
+    ring_flush(&w->ring, UINT64_MAX, 0);
+    atomic_store(&w->running, 0);
+    pthread_join(w->thread, NULL);
+    ring_destroy(&w->ring);
+    free(w->blocks);
+}
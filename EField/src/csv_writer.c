@@ -0,0 +1,196 @@
+/**
+ * @file csv_writer.c
+ * @brief CSV sink running on its own thread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "csv_writer.h"
+
+#define NS_PER_MS 1000000ull
+#define CSV_STATS_PERIOD_NS (60 * 1000000000ull)
+
+void csv_writer_load_env(struct CsvWriterConfig *cfg) {
+    const char *sBuf = getenv("CSV_BUF_KB");
+    const char *sFlush = getenv("CSV_FLUSH_MS");
+    const char *sSync = getenv("CSV_SYNC_MS");
+    const char *sRing = getenv("CSV_RING");
+
+    cfg->buf_size = (sBuf ? (size_t)atol(sBuf) : 64) * 1024;
+    cfg->flush_ms = sFlush ? atoi(sFlush) : 1000;
+    cfg->sync_ms = sSync ? atoi(sSync) : 1000;
+    cfg->ring_slots = sRing ? (size_t)atol(sRing) : 256;
+    if (cfg->buf_size < 2 * CSV_ROW_MAX) cfg->buf_size = 2 * CSV_ROW_MAX;
+    if (cfg->flush_ms <= 0) cfg->flush_ms = 1000;
+
+    fprintf(stdout, "[CFG] CSV_BUF_KB=%zu CSV_FLUSH_MS=%d CSV_SYNC_MS=%d CSV_RING=%zu\n",
+            cfg->buf_size / 1024, cfg->flush_ms, cfg->sync_ms, cfg->ring_slots);
+}
+
+static int write_all(struct CsvWriter *w, const char *data, size_t len) {
+    uint64_t t0 = mono_now_ns();
+
+    while (len > 0) {
+        ssize_t n = write(w->seg.fd, data, len);
+        if (n < 0) {
+            perror("Error escribiendo CSV");
+            w->lost_bytes += len;
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+        w->bytes += (unsigned long long)n;
+        w->seg.bytes += (uint64_t)n;
+    }
+    w->writes++;
+    w->dirty = 1;
+    w->last_write_ns = mono_now_ns();
+    hist_add(&w->write_lat, w->last_write_ns - t0);
+    return 0;
+}
+
+static void flush_buffer(struct CsvWriter *w) {
+    if (w->len == 0) return;
+    write_all(w, w->buf, w->len);
+    w->len = 0;
+}
+
+static void maybe_sync(struct CsvWriter *w, uint64_t now, int force) {
+    if (!w->dirty) return;
+    if (!force && (w->cfg.sync_ms <= 0 || now - w->last_sync_ns < (uint64_t)w->cfg.sync_ms * NS_PER_MS))
+        return;
+    uint64_t t0 = mono_now_ns();
+    if (fdatasync(w->seg.fd) < 0) perror("Error en fdatasync del CSV");
+    w->last_sync_ns = mono_now_ns();
+    hist_add(&w->write_lat, w->last_sync_ns - t0);
+    w->syncs++;
+    w->dirty = 0;
+}
+
+// Avanza len con lo que devolvió snprintf, sin pasar de lo que realmente cabía
+static void advance(struct CsvWriter *w, int n) {
+    size_t room = w->cfg.buf_size - w->len;
+    if (n > 0) w->len += (size_t)n < room ? (size_t)n : room - 1;
+}
+
+static void append_anchor(struct CsvWriter *w) {
+    char when[32];
+
+    if (w->len + CSV_ROW_MAX > w->cfg.buf_size) flush_buffer(w);
+    time_anchor_capture(&w->anchor);
+    time_format(w->anchor.utc_ns, when, sizeof(when));
+    advance(w, snprintf(w->buf + w->len, w->cfg.buf_size - w->len, "#anchor,%llu,%lld,%s\n",
+                        (unsigned long long)w->anchor.mono_ns, (long long)w->anchor.utc_ns, when));
+}
+
+static void append_batch(struct CsvWriter *w, const struct SampleBatch *b) {
+    for (uint32_t i = 0; i < b->count; i++) {
+        const struct AdcSample *s = &b->samples[i];
+        if (s->t_ns > w->anchor.mono_ns &&
+            s->t_ns - w->anchor.mono_ns >= TIME_ANCHOR_PERIOD_S * 1000000000ull) {
+            append_anchor(w);
+        }
+        // Comprobar después del ancla: la fila tiene que caber entera tras ella
+        if (w->len + CSV_ROW_MAX > w->cfg.buf_size) flush_buffer(w);
+        advance(w, w->format_row(w->buf + w->len, w->cfg.buf_size - w->len, s, w->ctx));
+    }
+}
+
+// Cabecera y ancla al principio de cada segmento para que se pueda leer por separado
+static void start_segment(struct CsvWriter *w) {
+    advance(w, snprintf(w->buf + w->len, w->cfg.buf_size - w->len, "%s\n", w->header));
+    append_anchor(w);
+}
+
+static void rotate(struct CsvWriter *w) {
+    flush_buffer(w);
+    maybe_sync(w, mono_now_ns(), 1);
+    if (segment_rotate(w->segs, &w->seg, w->prefix, "csv") == 0) start_segment(w);
+}
+
+static void print_stats(struct CsvWriter *w) {
+    printf("[STAT] CSV: %llu bytes en %lu write(), %lu fdatasync(), %llu bytes perdidos\n", w->bytes, w->writes,
+           w->syncs, w->lost_bytes);
+    ring_print_stats(&w->ring, "cola CSV");
+    hist_print(&w->write_lat, "latencia escritura CSV");
+}
+
+static void *writer_task(void *arg) {
+    struct CsvWriter *w = arg;
+    uint64_t last_stats = mono_now_ns();
+
+    while (atomic_load(&w->running) || ring_occupancy(&w->ring) > 0) {
+        struct SampleBatch *b = ring_wait(&w->ring, w->cfg.flush_ms);
+        if (b) {
+            append_batch(w, b);
+            ring_release(&w->ring);
+        }
+        uint64_t now = mono_now_ns();
+        if (w->len && now - w->last_write_ns >= (uint64_t)w->cfg.flush_ms * NS_PER_MS)
+            flush_buffer(w);
+        maybe_sync(w, now, 0);
+        if (segment_due(w->segs, &w->seg, now)) rotate(w);
+        if (now - last_stats >= CSV_STATS_PERIOD_NS) {
+            print_stats(w);
+            hist_reset(&w->write_lat);
+            last_stats = now;
+        }
+    }
+    flush_buffer(w);
+    maybe_sync(w, mono_now_ns(), 1);
+    segment_close(w->segs, &w->seg);
+    return NULL;
+}
+
+int csv_writer_open(struct CsvWriter *w, const struct CsvWriterConfig *cfg, struct SegmentIndex *segs,
+                    const char *prefix, const char *header, csv_row_fn format_row, void *ctx) {
+    memset(w, 0, sizeof(*w));
+    w->cfg = *cfg;
+    w->segs = segs;
+    w->format_row = format_row;
+    w->ctx = ctx;
+    snprintf(w->prefix, sizeof(w->prefix), "%s", prefix);
+    snprintf(w->header, sizeof(w->header), "%s", header);
+    hist_reset(&w->write_lat);
+
+    if (segment_open(segs, &w->seg, w->prefix, "csv") < 0) return -1;
+    w->buf = malloc(cfg->buf_size);
+    if (!w->buf || ring_init(&w->ring, cfg->ring_slots, RING_BATCH_MAX) < 0) {
+        perror("Error reservando el buffer del CSV");
+        free(w->buf);
+        segment_close(segs, &w->seg);
+        return -1;
+    }
+    start_segment(w);
+    w->last_write_ns = w->last_sync_ns = mono_now_ns();
+
+    atomic_store(&w->running, 1);
+    if (pthread_create(&w->thread, NULL, writer_task, w) != 0) {
+        perror("Error creando el hilo del CSV");
+        ring_destroy(&w->ring);
+        free(w->buf);
+        segment_close(segs, &w->seg);
+        return -1;
+    }
+    return 0;
+}
+
+void csv_writer_push(struct CsvWriter *w, const struct AdcSample *s) {
+    ring_push(&w->ring, s);
+    ring_flush(&w->ring, s->t_ns, RING_BATCH_MAX_MS * NS_PER_MS);
+}
+
+void csv_writer_idle(struct CsvWriter *w, uint64_t now_ns) {
+    ring_flush(&w->ring, now_ns, RING_BATCH_MAX_MS * NS_PER_MS);
+}
+
+void csv_writer_close(struct CsvWriter *w) {
+    // Publicar el lote parcial y dejar que el hilo vacíe la cola
+    ring_flush(&w->ring, UINT64_MAX, 0);
+    atomic_store(&w->running, 0);
+    pthread_join(w->thread, NULL);
+    ring_destroy(&w->ring);
+    free(w->buf);
+}
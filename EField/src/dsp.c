@@ -0,0 +1,219 @@
+/**
+ * @file dsp.c
+ * @brief Block-based filtering and decimation of one sample stream.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dsp.h"
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define DSP_NEON 1
+#endif
+
+void dsp_load_env(struct DspConfig *cfg, double default_fs_hz) {
+    const char *sOn = getenv("DSP");
+    const char *sFs = getenv("DSP_FS_HZ");
+    const char *sDecim = getenv("DSP_DECIM");
+    const char *sTaps = getenv("DSP_FIR_TAPS");
+    const char *sCut = getenv("DSP_CUTOFF_HZ");
+    const char *sIir = getenv("DSP_IIR_HZ");
+    const char *sNotch = getenv("DSP_NOTCH_HZ");
+    const char *sQ = getenv("DSP_NOTCH_Q");
+
+    cfg->enabled = sOn ? atoi(sOn) != 0 : 0;
+    cfg->fs_hz = sFs ? atof(sFs) : default_fs_hz;
+    cfg->decim = sDecim ? atoi(sDecim) : 8;
+    cfg->fir_taps = sTaps ? atoi(sTaps) : 64;
+    if (cfg->fs_hz <= 0) cfg->enabled = 0;
+    if (cfg->decim < 1) cfg->decim = 1;
+    if (cfg->fir_taps < 0) cfg->fir_taps = 0;
+    if (cfg->fir_taps > DSP_FIR_MAX_TAPS) cfg->fir_taps = DSP_FIR_MAX_TAPS;
+    if (cfg->fir_taps == 0) cfg->decim = 1;   // Sin FIR no hay antialiasing: no se diezma
+    // Por defecto el corte deja margen por debajo del Nyquist de salida
+    cfg->cutoff_hz = sCut ? atof(sCut) : 0.4 * cfg->fs_hz / cfg->decim;
+    cfg->iir_hz = sIir ? atof(sIir) : 0;
+    cfg->notch_hz = sNotch ? atof(sNotch) : 50;
+    cfg->notch_q = sQ ? atof(sQ) : 10;
+    if (cfg->notch_hz >= cfg->fs_hz / 2) cfg->notch_hz = 0;
+    if (cfg->iir_hz >= cfg->fs_hz / 2) cfg->iir_hz = 0;
+
+    if (!cfg->enabled) {
+        fprintf(stdout, "[CFG] DSP=0\n");
+        return;
+    }
+    fprintf(stdout, "[CFG] DSP=1 DSP_FS_HZ=%.1f DSP_DECIM=%d DSP_FIR_TAPS=%d DSP_CUTOFF_HZ=%.2f "
+            "DSP_IIR_HZ=%.2f DSP_NOTCH_HZ=%.1f DSP_NOTCH_Q=%.1f (%s)\n",
+            cfg->fs_hz, cfg->decim, cfg->fir_taps, cfg->cutoff_hz, cfg->iir_hz, cfg->notch_hz, cfg->notch_q,
+#ifdef DSP_NEON
+            "NEON"
+#else
+            "escalar"
+#endif
+            );
+}
+
+void dsp_design_lowpass(float *h, int taps, double fc) {
+    double sum = 0;
+    double mid = (taps - 1) / 2.0;
+
+    for (int i = 0; i < taps; i++) {
+        double x = i - mid;
+        double sinc = x == 0 ? 2 * fc : sin(2 * M_PI * fc * x) / (M_PI * x);
+        double w = taps > 1 ? 0.42 - 0.5 * cos(2 * M_PI * i / (taps - 1)) + 0.08 * cos(4 * M_PI * i / (taps - 1))
+                            : 1.0;
+        h[i] = (float)(sinc * w);
+        sum += h[i];
+    }
+    for (int i = 0; i < taps; i++) h[i] = (float)(h[i] / sum);
+}
+
+// Coeficientes del "Audio EQ Cookbook" (R. Bristow-Johnson), normalizados por a0
+static void biquad_set(struct DspBiquad *bq, double b0, double b1, double b2, double a0, double a1, double a2) {
+    bq->b0 = (float)(b0 / a0);
+    bq->b1 = (float)(b1 / a0);
+    bq->b2 = (float)(b2 / a0);
+    bq->a1 = (float)(a1 / a0);
+    bq->a2 = (float)(a2 / a0);
+    bq->z1 = bq->z2 = 0;
+}
+
+void dsp_biquad_lowpass(struct DspBiquad *bq, double fs_hz, double f0_hz, double q) {
+    double w0 = 2 * M_PI * f0_hz / fs_hz;
+    double alpha = sin(w0) / (2 * q);
+    double c = cos(w0);
+    biquad_set(bq, (1 - c) / 2, 1 - c, (1 - c) / 2, 1 + alpha, -2 * c, 1 - alpha);
+}
+
+void dsp_biquad_notch(struct DspBiquad *bq, double fs_hz, double f0_hz, double q) {
+    double w0 = 2 * M_PI * f0_hz / fs_hz;
+    double alpha = sin(w0) / (2 * q);
+    double c = cos(w0);
+    biquad_set(bq, 1, -2 * c, 1, 1 + alpha, -2 * c, 1 - alpha);
+}
+
+void dsp_biquad_process(struct DspBiquad *bq, float *x, int n) {
+    float z1 = bq->z1, z2 = bq->z2;
+
+    for (int i = 0; i < n; i++) {
+        float in = x[i];
+        float out = bq->b0 * in + z1;
+        z1 = bq->b1 * in - bq->a1 * out + z2;
+        z2 = bq->b2 * in - bq->a2 * out;
+        x[i] = out;
+    }
+    bq->z1 = z1;
+    bq->z2 = z2;
+}
+
+float dsp_dot(const float *a, const float *b, int n) {
+    int i = 0;
+    float sum = 0;
+
+#ifdef DSP_NEON
+    // Cuatro acumuladores independientes para no encadenar la latencia de FMLA
+    float32x4_t acc0 = vdupq_n_f32(0), acc1 = vdupq_n_f32(0);
+    float32x4_t acc2 = vdupq_n_f32(0), acc3 = vdupq_n_f32(0);
+    for (; i + 16 <= n; i += 16) {
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+        acc2 = vfmaq_f32(acc2, vld1q_f32(a + i + 8), vld1q_f32(b + i + 8));
+        acc3 = vfmaq_f32(acc3, vld1q_f32(a + i + 12), vld1q_f32(b + i + 12));
+    }
+    for (; i + 4 <= n; i += 4) acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+    sum = vaddvq_f32(vaddq_f32(vaddq_f32(acc0, acc1), vaddq_f32(acc2, acc3)));
+#else
+    float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    sum = (s0 + s1) + (s2 + s3);
+#endif
+    for (; i < n; i++) sum += a[i] * b[i];
+    return sum;
+}
+
+void dsp_from_counts(float *y, const int16_t *x, int n) {
+    int i = 0;
+
+#ifdef DSP_NEON
+    // Ocho cuentas por carga: ensanchar a 32 bits y convertir cada mitad
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t v = vld1q_s16(x + i);
+        vst1q_f32(y + i, vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))));
+        vst1q_f32(y + i + 4, vcvtq_f32_s32(vmovl_high_s16(v)));
+    }
+#endif
+    for (; i < n; i++) y[i] = (float)x[i];
+}
+
+void dsp_fir_init(struct DspFir *f, const float *h, int taps, int decim) {
+    memset(f, 0, sizeof(*f));
+    f->taps = taps > DSP_FIR_MAX_TAPS ? DSP_FIR_MAX_TAPS : taps;
+    f->decim = decim > 0 ? decim : 1;
+    // Invertidos: la convolución queda como producto escalar con la línea de retardo
+    for (int i = 0; i < f->taps; i++) f->h[i] = h[f->taps - 1 - i];
+}
+
+int dsp_fir_process(struct DspFir *f, const float *x, int n, float *y, int *idx) {
+    int out = 0;
+
+    for (int i = 0; i < n; i++) {
+        // La muestra más reciente queda en pos + taps y las taps últimas, contiguas desde pos + 1
+        f->pos = f->pos + 1 < f->taps ? f->pos + 1 : 0;
+        f->delay[f->pos] = f->delay[f->pos + f->taps] = x[i];
+        if (++f->phase < f->decim) continue;
+        f->phase = 0;
+        y[out] = dsp_dot(f->h, &f->delay[f->pos + 1], f->taps);
+        if (idx) idx[out] = i;
+        out++;
+    }
+    return out;
+}
+
+void dsp_chain_init(struct DspChain *ch, const struct DspConfig *cfg) {
+    memset(ch, 0, sizeof(*ch));
+    if (cfg->notch_hz > 0) dsp_biquad_notch(&ch->bq[ch->nbq++], cfg->fs_hz, cfg->notch_hz, cfg->notch_q);
+    if (cfg->iir_hz > 0) dsp_biquad_lowpass(&ch->bq[ch->nbq++], cfg->fs_hz, cfg->iir_hz, M_SQRT1_2);
+    if (cfg->fir_taps > 0) {
+        float h[DSP_FIR_MAX_TAPS];
+        dsp_design_lowpass(h, cfg->fir_taps, cfg->cutoff_hz / cfg->fs_hz);
+        dsp_fir_init(&ch->fir, h, cfg->fir_taps, cfg->decim);
+        ch->use_fir = 1;
+        ch->delay_ns = (uint64_t)((cfg->fir_taps - 1) / 2.0 / cfg->fs_hz * 1e9);
+    }
+}
+
+void dsp_chain_reset(struct DspChain *ch) {
+    for (int i = 0; i < ch->nbq; i++) ch->bq[i].z1 = ch->bq[i].z2 = 0;
+    memset(ch->fir.delay, 0, sizeof(ch->fir.delay));
+    ch->fir.phase = 0;
+    ch->fir.pos = 0;
+}
+
+int dsp_chain_process(struct DspChain *ch, const int16_t *x, const uint64_t *t_ns, int n,
+                      float *y, uint64_t *t_out) {
+    float buf[DSP_BLOCK_MAX];
+    int idx[DSP_BLOCK_MAX];
+
+    if (n > DSP_BLOCK_MAX) n = DSP_BLOCK_MAX;
+    dsp_from_counts(buf, x, n);
+    for (int i = 0; i < ch->nbq; i++) dsp_biquad_process(&ch->bq[i], buf, n);
+    if (!ch->use_fir) {
+        memcpy(y, buf, (size_t)n * sizeof(float));
+        memcpy(t_out, t_ns, (size_t)n * sizeof(uint64_t));
+        return n;
+    }
+    int m = dsp_fir_process(&ch->fir, buf, n, y, idx);
+    for (int k = 0; k < m; k++) {
+        uint64_t t = t_ns[idx[k]];
+        t_out[k] = t > ch->delay_ns ? t - ch->delay_ns : 0;
+    }
+    return m;
+}
@@ -0,0 +1,397 @@
+/**
+ * @file evcapture.c
+ * @brief Pre/post-trigger event capture at the full sample rate.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include "acquisition.h"
+#include "timebase.h"
+#include "evcapture.h"
+
+#define NS_PER_S      1000000000ull
+#define EVCAP_TICK_NS 1000     // Resolución de las marcas de tiempo empaquetadas
+#define EVCAP_STREAMS (ACQ_MAX_DEVICES * ACQ_MAX_SCAN)
+
+_Static_assert(EVCAP_STREAMS <= 64, "stream mask");
+
+void evcap_load_env(struct EventCaptureConfig *cfg) {
+    const char *sOn = getenv("EVCAP");
+    const char *sPre = getenv("EVCAP_PRE_S");
+    const char *sPost = getenv("EVCAP_POST_S");
+    const char *sMax = getenv("EVCAP_MAX_S");
+    const char *sTrans = getenv("EVCAP_TRANSIENT");
+    double pre_s = sPre ? atof(sPre) : 10;
+    double post_s = sPost ? atof(sPost) : 10;
+    double max_s = sMax ? atof(sMax) : 30;
+
+    if (pre_s < 0) pre_s = 0;
+    if (post_s < 0) post_s = 0;
+    if (max_s < post_s) max_s = post_s;
+    cfg->enabled = sOn ? atoi(sOn) != 0 : 0;
+    cfg->pre_ns = (uint64_t)(pre_s * NS_PER_S);
+    cfg->post_ns = (uint64_t)(post_s * NS_PER_S);
+    cfg->max_ns = (uint64_t)(max_s * NS_PER_S);
+    cfg->on_transient = sTrans ? atoi(sTrans) != 0 : 0;
+
+    fprintf(stdout, "[CFG] EVCAP=%d EVCAP_PRE_S=%.1f EVCAP_POST_S=%.1f EVCAP_MAX_S=%.1f EVCAP_TRANSIENT=%d\n",
+            cfg->enabled, pre_s, post_s, max_s, cfg->on_transient);
+}
+
+/* ---- Hilo de adquisición ---- */
+
+static int64_t take_chunk(struct EventCapture *c) {
+    uint32_t idx;
+
+    if (c->nfree == 0) {
+        // Recoge los trozos que el escritor ya ha terminado
+        unsigned int tail = atomic_load_explicit(&c->rel_tail, memory_order_relaxed);
+        unsigned int head = atomic_load_explicit(&c->rel_head, memory_order_acquire);
+        while (tail != head) c->free_stack[c->nfree++] = c->rel[tail++ & c->rel_mask];
+        atomic_store_explicit(&c->rel_tail, tail, memory_order_release);
+    }
+    if (c->nfree) {
+        idx = c->free_stack[--c->nfree];
+    } else if (c->hist_n) {
+        // Escritor atrasado: se acorta el historial antes que perder muestras
+        idx = c->hist[(c->hist_head + c->hist_cap - c->hist_n) % c->hist_cap];
+        c->hist_n--;
+    } else {
+        return -1;
+    }
+    c->pool[idx].count = 0;
+    return idx;
+}
+
+static void hist_add(struct EventCapture *c, uint32_t idx) {
+    if (c->hist_n == c->hist_cap) {
+        c->free_stack[c->nfree++] = c->hist[(c->hist_head + c->hist_cap - c->hist_n) % c->hist_cap];
+        c->hist_n--;
+    }
+    c->hist[c->hist_head] = idx;
+    c->hist_head = (c->hist_head + 1) % c->hist_cap;
+    c->hist_n++;
+}
+
+static void publish(struct EventCapture *c) {
+    uint64_t one = 1;
+
+    c->open->info.end_mono_ns = c->post_end_ns;
+    atomic_store_explicit(&c->ev_head, atomic_load_explicit(&c->ev_head, memory_order_relaxed) + 1,
+                          memory_order_release);
+    c->open = NULL;
+    if (write(c->efd, &one, sizeof(one)) < 0) perror("eventfd write");
+}
+
+static void append_open(struct EventCapture *c, uint32_t idx) {
+    struct EvDescriptor *d = c->open;
+
+    d->chunks[d->nchunks++] = idx;
+    // Ventana llena antes de tiempo (reactivaciones continuas): se entrega recortada
+    if (d->nchunks == c->max_chunks) publish(c);
+}
+
+void evcap_push(struct EventCapture *c, const struct AdcSample *s) {
+    if (c->cur < 0 && (c->cur = take_chunk(c)) < 0) {
+        c->dropped_samples++;
+        return;
+    }
+    struct EvChunk *ch = &c->pool[c->cur];
+    ch->s[ch->count++] = *s;
+
+    if (c->open && s->t_ns >= c->post_end_ns) {
+        append_open(c, (uint32_t)c->cur);
+        if (c->open) publish(c);
+        c->cur = -1;
+    } else if (ch->count == EVCAP_CHUNK_SAMPLES) {
+        if (c->open) append_open(c, (uint32_t)c->cur);
+        else hist_add(c, (uint32_t)c->cur);
+        c->cur = -1;
+    }
+}
+
+void evcap_trigger(struct EventCapture *c, uint64_t t_ns, int source, const struct AdcSample *s, int side,
+                   float value) {
+    if (c->open) {
+        // Reactivación dentro de la ventana: se alarga, hasta EVCAP_MAX_S tras el primer disparo
+        uint64_t end = t_ns + c->cfg.post_ns;
+        uint64_t limit = c->open->info.trigger_mono_ns + c->cfg.max_ns;
+        if (end > limit) end = limit;
+        if (end > c->post_end_ns) c->post_end_ns = end;
+        if (c->open->info.triggers < UINT16_MAX) c->open->info.triggers++;
+        return;
+    }
+    unsigned int head = atomic_load_explicit(&c->ev_head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&c->ev_tail, memory_order_acquire);
+    if (head - tail >= EVCAP_EVENT_SLOTS) {
+        c->dropped_triggers++;
+        return;
+    }
+    struct EvDescriptor *d = &c->ev[head & (EVCAP_EVENT_SLOTS - 1)];
+    memset(&d->info, 0, sizeof(d->info));
+    d->info.trigger_mono_ns = t_ns;
+    d->info.triggers = 1;
+    d->info.source = (uint8_t)source;
+    d->info.side = (uint8_t)side;
+    d->info.value = value;
+    d->info.pre_ms = (uint32_t)(c->cfg.pre_ns / 1000000);
+    d->info.post_ms = (uint32_t)(c->cfg.post_ns / 1000000);
+    d->start_ns = t_ns > c->cfg.pre_ns ? t_ns - c->cfg.pre_ns : 0;
+    d->device = s->device;
+    d->channel = s->channel;
+
+    // El historial pasa a la ventana por índice; el trozo en curso se añadirá al llenarse
+    d->nchunks = 0;
+    while (c->hist_n) {
+        d->chunks[d->nchunks++] = c->hist[(c->hist_head + c->hist_cap - c->hist_n) % c->hist_cap];
+        c->hist_n--;
+    }
+    c->open = d;
+    c->post_end_ns = t_ns + c->cfg.post_ns;
+}
+
+/* ---- Hilo escritor ---- */
+
+struct EvWriter {
+    struct EventCapture *c;
+    struct Segment seg;
+    struct TimeAnchor anchor;
+    uint64_t off;
+    uint32_t seq;
+    uint32_t samples;
+    uint64_t last_ns;
+};
+
+static void put_block(struct EvWriter *w, struct CaptureBlock *b, uint64_t off) {
+    capture_block_seal(b);
+    if (pwrite(w->seg.fd, b, sizeof(*b), (off_t)off) != (ssize_t)sizeof(*b))
+        perror("Error escribiendo captura de evento");
+}
+
+static void close_data_block(struct EvWriter *w, struct CaptureBlock *b, uint64_t last_ns) {
+    struct CaptureBlockHeader *h = &b->h;
+
+    if (h->count == 0) return;
+    h->period_ns = h->count > 1 ? (uint32_t)((last_ns - h->start_mono_ns) / (h->count - 1u)) : 0;
+    h->start_utc_ns = time_anchor_to_utc_ns(&w->anchor, h->start_mono_ns);
+    h->seq = w->seq++;
+    put_block(w, b, w->off);
+    w->off += CAP_BLOCK_SIZE;
+    w->samples += h->count;
+    h->count = 0;
+}
+
+static void open_data_block(struct CaptureBlock *b, struct CapturePacker *pk, const struct AdcSample *s) {
+    struct CaptureBlockHeader *h = &b->h;
+
+    memset(h, 0, sizeof(*h));
+    h->magic = CAP_MAGIC;
+    h->version = CAP_VERSION;
+    h->header_size = CAP_HEADER_SIZE;
+    h->start_mono_ns = s->t_ns;
+    h->channel = s->channel;
+    h->device = s->device;
+    h->pga = s->pga;
+    h->lsb_volts = sample_lsb(s->pga);
+    capture_pack_begin(pk, b, s->t_ns, s->raw, EVCAP_TICK_NS);
+}
+
+// Empaqueta las muestras de una entrada dentro de la ventana, recorriendo los trozos en orden
+static void write_stream(struct EvWriter *w, const struct EvDescriptor *d, int stream) {
+    struct CaptureBlock *b = &w->c->blocks[1];
+    struct CapturePacker pk;
+    uint64_t last = 0;
+
+    b->h.count = 0;
+    for (uint32_t k = 0; k < d->nchunks; k++) {
+        const struct EvChunk *ch = &w->c->pool[d->chunks[k]];
+        for (uint32_t i = 0; i < ch->count; i++) {
+            const struct AdcSample *s = &ch->s[i];
+            if ((s->device * ACQ_MAX_SCAN + s->channel) % EVCAP_STREAMS != stream) continue;
+            if (s->t_ns < d->start_ns || s->t_ns > d->info.end_mono_ns) continue;
+            if (b->h.count && (b->h.pga != s->pga || s->t_ns <= last)) close_data_block(w, b, last);
+            if (b->h.count == 0) {
+                open_data_block(b, &pk, s);
+            } else if (!capture_pack_append(&pk, b, s->t_ns, s->raw)) {
+                close_data_block(w, b, last);
+                open_data_block(b, &pk, s);
+            }
+            last = s->t_ns;
+            if (last > w->last_ns) w->last_ns = last;
+        }
+    }
+    close_data_block(w, b, last);
+}
+
+static void write_event(struct EventCapture *c, struct EvDescriptor *d) {
+    struct EvWriter w = { .c = c, .off = CAP_BLOCK_SIZE, .seq = 1 };
+    uint64_t mask = 0;
+
+    if (segment_open(c->segs, &w.seg, c->prefix, "efb") < 0) return;
+    time_anchor_capture(&w.anchor);
+    for (uint32_t k = 0; k < d->nchunks; k++) {
+        const struct EvChunk *ch = &c->pool[d->chunks[k]];
+        for (uint32_t i = 0; i < ch->count; i++)
+            mask |= 1ull << ((ch->s[i].device * ACQ_MAX_SCAN + ch->s[i].channel) % EVCAP_STREAMS);
+    }
+    for (int st = 0; st < EVCAP_STREAMS; st++) {
+        if (mask & (1ull << st)) write_stream(&w, d, st);
+    }
+
+    // Bloque de descripción al principio: el fichero se interpreta sin nada más
+    struct CaptureBlock *b = &c->blocks[0];
+    memset(b, 0, sizeof(*b));
+    b->h.magic = CAP_MAGIC;
+    b->h.version = CAP_VERSION;
+    b->h.header_size = CAP_HEADER_SIZE;
+    b->h.start_mono_ns = d->start_ns;
+    b->h.start_utc_ns = time_anchor_to_utc_ns(&w.anchor, d->start_ns);
+    b->h.device = d->device;
+    b->h.channel = d->channel;
+    b->h.flags = CAP_FLAG_EVENT;
+    d->info.trigger_utc_ns = time_anchor_to_utc_ns(&w.anchor, d->info.trigger_mono_ns);
+    d->info.end_mono_ns = w.last_ns ? w.last_ns : d->info.end_mono_ns;
+    d->info.samples = w.samples;
+    memcpy(b->samples, &d->info, sizeof(d->info));
+    put_block(&w, b, 0);
+
+    if (fdatasync(w.seg.fd) < 0) perror("Error en fdatasync de la captura de evento");
+    w.seg.bytes = w.off;
+    c->files++;
+
+    unsigned int head = atomic_load_explicit(&c->done_head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&c->done_tail, memory_order_acquire);
+    if (head - tail < EVCAP_DONE_SLOTS) {
+        struct EvCaptureDone *done = &c->done[head & (EVCAP_DONE_SLOTS - 1)];
+        memcpy(done->name, w.seg.name, sizeof(done->name));
+        done->info = d->info;
+        done->start_utc_ns = b->h.start_utc_ns;
+        done->bytes = w.off;
+        done->device = d->device;
+        done->channel = d->channel;
+        atomic_store_explicit(&c->done_head, head + 1, memory_order_release);
+    } else {
+        c->done_dropped++;
+    }
+    segment_close(c->segs, &w.seg);
+}
+
+static void *writer_task(void *arg) {
+    struct EventCapture *c = arg;
+
+    while (1) {
+        unsigned int tail = atomic_load_explicit(&c->ev_tail, memory_order_relaxed);
+        unsigned int head = atomic_load_explicit(&c->ev_head, memory_order_acquire);
+        if (tail == head) {
+            if (!atomic_load(&c->running)) break;
+            struct pollfd pfd = { .fd = c->efd, .events = POLLIN };
+            if (poll(&pfd, 1, 500) > 0) {
+                uint64_t n;
+                if (read(c->efd, &n, sizeof(n)) < 0) perror("eventfd read");
+            }
+            continue;
+        }
+        struct EvDescriptor *d = &c->ev[tail & (EVCAP_EVENT_SLOTS - 1)];
+        write_event(c, d);
+
+        // Devuelve los trozos al hilo de adquisición y libera el descriptor
+        unsigned int rh = atomic_load_explicit(&c->rel_head, memory_order_relaxed);
+        for (uint32_t k = 0; k < d->nchunks; k++) c->rel[rh++ & c->rel_mask] = d->chunks[k];
+        atomic_store_explicit(&c->rel_head, rh, memory_order_release);
+        atomic_store_explicit(&c->ev_tail, tail + 1, memory_order_release);
+    }
+    return NULL;
+}
+
+int evcap_open(struct EventCapture *c, const struct EventCaptureConfig *cfg, struct SegmentIndex *segs,
+               const char *prefix, double sps) {
+    memset(c, 0, sizeof(*c));
+    c->cfg = *cfg;
+    c->segs = segs;
+    c->cur = -1;
+    c->efd = -1;
+    snprintf(c->prefix, sizeof(c->prefix), "%s", prefix);
+
+    // Trozos por segundo con un 25 % de margen sobre la tasa nominal
+    double cps = (sps > 1 ? sps : 1) * 1.25 / EVCAP_CHUNK_SAMPLES;
+    c->hist_cap = (uint32_t)(cfg->pre_ns * 1e-9 * cps) + 1;
+    c->max_chunks = c->hist_cap + (uint32_t)(cfg->max_ns * 1e-9 * cps) + 2;
+    c->pool_n = c->hist_cap + 2 * c->max_chunks + 2;
+    uint32_t rel_cap = 1;
+    while (rel_cap < c->pool_n) rel_cap <<= 1;
+    c->rel_mask = rel_cap - 1;
+
+    c->pool = malloc((size_t)c->pool_n * sizeof(struct EvChunk));
+    c->free_stack = malloc((size_t)c->pool_n * sizeof(uint32_t));
+    c->hist = malloc((size_t)c->hist_cap * sizeof(uint32_t));
+    c->rel = malloc((size_t)rel_cap * sizeof(uint32_t));
+    c->blocks = aligned_alloc(CAP_BLOCK_SIZE, 2 * sizeof(struct CaptureBlock));
+    int ok = c->pool && c->free_stack && c->hist && c->rel && c->blocks;
+    for (int i = 0; ok && i < EVCAP_EVENT_SLOTS; i++)
+        ok = (c->ev[i].chunks = malloc((size_t)c->max_chunks * sizeof(uint32_t))) != NULL;
+    if (ok) c->efd = eventfd(0, EFD_CLOEXEC);
+    if (!ok || c->efd < 0) {
+        perror("Error reservando la captura de eventos");
+        goto fail;
+    }
+    for (uint32_t i = 0; i < c->pool_n; i++) c->free_stack[i] = c->pool_n - 1 - i;
+    c->nfree = c->pool_n;
+
+    atomic_store(&c->running, 1);
+    if (pthread_create(&c->thread, NULL, writer_task, c) != 0) {
+        perror("Error creando el hilo de captura de eventos");
+        goto fail;
+    }
+    printf("[INFO] Captura de eventos: %u trozos de %d muestras (%.1f MB), %u por ventana\n", c->pool_n,
+           EVCAP_CHUNK_SAMPLES, c->pool_n * sizeof(struct EvChunk) / 1048576.0, c->max_chunks);
+    return 0;
+
+fail:
+    if (c->efd >= 0) close(c->efd);
+    for (int i = 0; i < EVCAP_EVENT_SLOTS; i++) free(c->ev[i].chunks);
+    free(c->pool);
+    free(c->free_stack);
+    free(c->hist);
+    free(c->rel);
+    free(c->blocks);
+    return -1;
+}
+
+int evcap_done_pop(struct EventCapture *c, struct EvCaptureDone *d) {
+    unsigned int tail = atomic_load_explicit(&c->done_tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&c->done_head, memory_order_acquire);
+
+    if (head == tail) return 0;
+    *d = c->done[tail & (EVCAP_DONE_SLOTS - 1)];
+    atomic_store_explicit(&c->done_tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+void evcap_print_stats(struct EventCapture *c) {
+    printf("[STAT] Captura de eventos: %lu ficheros, %lu disparos perdidos, %lu muestras perdidas\n",
+           c->files, c->dropped_triggers, c->dropped_samples);
+}
+
+void evcap_close(struct EventCapture *c) {
+    uint64_t one = 1;
+
+    if (c->open) {
+        if (c->cur >= 0) append_open(c, (uint32_t)c->cur);
+        if (c->open) publish(c);
+        c->cur = -1;
+    }
+    atomic_store(&c->running, 0);
+    if (write(c->efd, &one, sizeof(one)) < 0) perror("eventfd write");
+    pthread_join(c->thread, NULL);
+    close(c->efd);
+    for (int i = 0; i < EVCAP_EVENT_SLOTS; i++) free(c->ev[i].chunks);
+    free(c->pool);
+    free(c->free_stack);
+    free(c->hist);
+    free(c->rel);
+    free(c->blocks);
+}
@@ -0,0 +1,163 @@
+/**
+ * @file excursion.c
+ * @brief Threshold excursion tracking with hysteresis and minimum dwell.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "excursion.h"
+
+enum {
+    ST_IDLE,
+    ST_PENDING,
+    ST_ACTIVE,
+    ST_CLEARING
+};
+
+void excursion_load_env(struct ExcursionConfig *cfg, float v_high_thr, float v_low_thr) {
+    const char *sHyst = getenv("EXC_HYST_V");
+    const char *sDwell = getenv("EXC_DWELL_MS");
+    const char *sUpdate = getenv("EXC_UPDATE_MS");
+    long dwell_ms = sDwell ? atol(sDwell) : 10;
+    long update_ms = sUpdate ? atol(sUpdate) : 0;
+
+    cfg->v_high_thr = v_high_thr;
+    cfg->v_low_thr = v_low_thr;
+    cfg->hyst_v = sHyst ? strtof(sHyst, NULL) : 0.05f;
+    if (cfg->hyst_v < 0) cfg->hyst_v = 0;
+    cfg->dwell_ns = (uint64_t)(dwell_ms > 0 ? dwell_ms : 0) * 1000000ull;
+    cfg->update_ns = (uint64_t)(update_ms > 0 ? update_ms : 0) * 1000000ull;
+    fprintf(stdout, "[CFG] EXC_HYST_V=%.3f V, EXC_DWELL_MS=%ld, EXC_UPDATE_MS=%ld\n",
+            cfg->hyst_v, dwell_ms, update_ms);
+    excursion_scale(cfg);
+}
+
+// Nivel en cuentas, fuera del rango de 16 bits si esa ganancia no lo alcanza
+static int32_t clamp_counts(double c) {
+    return c > 65536 ? 65536 : c < -65536 ? -65536 : (int32_t)c;
+}
+
+void excursion_scale(struct ExcursionConfig *cfg) {
+    for (int g = 0; g < 8; g++) {
+        double lsb = sample_lsb((uint8_t)g);
+        // raw >= high_counts equivale a raw * lsb >= v_high_thr (y al revés para el bajo)
+        cfg->high_counts[g] = clamp_counts(ceil(cfg->v_high_thr / lsb));
+        cfg->low_counts[g] = clamp_counts(floor(cfg->v_low_thr / lsb));
+        cfg->hyst_counts[g] = clamp_counts(round(cfg->hyst_v / lsb));
+    }
+}
+
+// Cuántas cuentas queda la muestra más allá del umbral del lado de la excursión (negativo = dentro)
+static int32_t beyond(const struct ExcursionConfig *cfg, int side, const struct AdcSample *s) {
+    return side == EXC_HIGH ? s->raw - cfg->high_counts[s->pga & 7] : cfg->low_counts[s->pga & 7] - s->raw;
+}
+
+static void accumulate(struct ExcursionTracker *tr, const struct ExcursionConfig *cfg, const struct AdcSample *s) {
+    float v = sample_volts(s);
+    float b = tr->side == EXC_HIGH ? v - cfg->v_high_thr : cfg->v_low_thr - v;
+
+    // Área por rectángulos: cada muestra cuenta hasta la siguiente
+    if (b > 0 && s->t_ns > tr->last_ns) tr->area_vs += b * ((s->t_ns - tr->last_ns) * 1e-9);
+    if (tr->side == EXC_HIGH ? v > tr->peak_v : v < tr->peak_v) tr->peak_v = v;
+    tr->last_ns = s->t_ns;
+}
+
+static void fill_event(const struct ExcursionTracker *tr, const struct AdcSample *s, int phase,
+                       uint64_t end_ns, struct ExcursionEvent *ev) {
+    ev->t_ns = s->t_ns;
+    ev->start_ns = tr->start_ns;
+    ev->duration_ns = end_ns - tr->start_ns;
+    ev->peak_v = tr->peak_v;
+    ev->area_vs = (float)tr->area_vs;
+    ev->raw = s->raw;
+    ev->pga = s->pga;
+    ev->device = s->device;
+    ev->channel = s->channel;
+    ev->phase = (uint8_t)phase;
+    ev->side = (uint8_t)tr->side;
+}
+
+int excursion_update(struct ExcursionTracker *tr, const struct ExcursionConfig *cfg,
+                     const struct AdcSample *s, int hw_trip, struct ExcursionEvent *ev) {
+    int g = s->pga & 7;
+    int side = s->raw >= cfg->high_counts[g] ? EXC_HIGH : s->raw <= cfg->low_counts[g] ? EXC_LOW : 0;
+
+    // El comparador del ADS1115 puede disparar con la muestra ya casi en el umbral
+    if (!side && hw_trip) side = 2 * s->raw >= cfg->high_counts[g] + cfg->low_counts[g] ? EXC_HIGH : EXC_LOW;
+
+    switch (tr->state) {
+    case ST_IDLE:
+        if (!side) return 0;
+        tr->state = ST_PENDING;
+        tr->side = side;
+        tr->start_ns = tr->last_ns = s->t_ns;
+        tr->peak_v = sample_volts(s);
+        tr->area_vs = 0;
+        // Con EXC_DWELL_MS=0 la primera muestra ya es el inicio
+        // fall through
+    case ST_PENDING:
+        if (side != tr->side) {
+            // Cruce demasiado breve: se olvida (o empieza otro del lado contrario)
+            tr->state = ST_IDLE;
+            return side ? excursion_update(tr, cfg, s, hw_trip, ev) : 0;
+        }
+        accumulate(tr, cfg, s);
+        if (s->t_ns - tr->start_ns < cfg->dwell_ns) return 0;
+        tr->state = ST_ACTIVE;
+        tr->update_ns = s->t_ns;
+        fill_event(tr, s, EXC_ONSET, s->t_ns, ev);
+        return 1;
+    case ST_ACTIVE:
+        accumulate(tr, cfg, s);
+        if (beyond(cfg, tr->side, s) < -cfg->hyst_counts[g]) {
+            tr->state = ST_CLEARING;
+            tr->release_ns = s->t_ns;
+            return 0;
+        }
+        if (cfg->update_ns && s->t_ns - tr->update_ns >= cfg->update_ns) {
+            tr->update_ns = s->t_ns;
+            fill_event(tr, s, EXC_UPDATE, s->t_ns, ev);
+            return 1;
+        }
+        return 0;
+    case ST_CLEARING:
+        accumulate(tr, cfg, s);
+        if (beyond(cfg, tr->side, s) >= -cfg->hyst_counts[g]) {
+            tr->state = ST_ACTIVE;   // Vuelve a pasar el nivel de liberación: la misma excursión sigue
+            return 0;
+        }
+        if (s->t_ns - tr->release_ns < cfg->dwell_ns) return 0;
+        tr->state = ST_IDLE;
+        fill_event(tr, s, EXC_END, tr->release_ns, ev);
+        return 1;
+    }
+    return 0;
+}
+
+int excursion_idle(const struct ExcursionTracker *tr) {
+    return tr->state == ST_IDLE;
+}
+
+int excursion_queue_push(struct ExcursionQueue *q, const struct ExcursionEvent *ev) {
+    unsigned int head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+
+    if (head - tail >= EXC_QUEUE_SLOTS) {
+        q->dropped++;
+        return -1;
+    }
+    q->slots[head & (EXC_QUEUE_SLOTS - 1)] = *ev;
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return 0;
+}
+
+int excursion_queue_pop(struct ExcursionQueue *q, struct ExcursionEvent *ev) {
+    unsigned int tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&q->head, memory_order_acquire);
+
+    if (head == tail) return 0;
+    *ev = q->slots[tail & (EXC_QUEUE_SLOTS - 1)];
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return 1;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file histogram.c
+ * @brief Log2-bucketed latency histogram.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "histogram.h"
+
+void hist_reset(struct LatencyHist *h) {
+    memset(h, 0, sizeof(*h));
+}
+
+void hist_add(struct LatencyHist *h, uint64_t ns) {
+    uint64_t us = ns / 1000;
+    int b = 0;
+
+    while (us && b < HIST_BUCKETS - 1) {
+        us >>= 1;
+        b++;
+    }
+    h->buckets[b]++;
+    h->count++;
+    h->sum_ns += ns;
+    if (ns > h->max_ns) h->max_ns = ns;
+}
+
+uint64_t hist_quantile(const struct LatencyHist *h, double q) {
+    unsigned long target = (unsigned long)(q * (double)h->count);
+    unsigned long acc = 0;
+
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        acc += h->buckets[b];
+        if (acc > target) return (1ull << b) * 1000ull;
+    }
+    return h->max_ns;
+}
+
+void hist_print(const struct LatencyHist *h, const char *label) {
+    if (!h->count) return;
+    printf("[STAT] %s: n=%lu media %.1f us p50<%llu us p99<%llu us máx %.1f us\n", label, h->count,
+           (double)h->sum_ns / (double)h->count / 1e3,
+           (unsigned long long)(hist_quantile(h, 0.50) / 1000),
+           (unsigned long long)(hist_quantile(h, 0.99) / 1000),
+           (double)h->max_ns / 1e3);
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        if (!h->buckets[b]) continue;
+        printf("[STAT]   <%8llu us: %lu\n", 1ull << b, h->buckets[b]);
+    }
+}
@@ -1,20 +1,75 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <time.h>
 #include <pthread.h>
 #include "ads1115_rpi.h"
+#include "acquisition.h"
+#include "timebase.h"
+#include "ringbuf.h"
+#include "csv_writer.h"
+#include "capture_writer.h"
+#include "segments.h"
+#include "histogram.h"
 #include "mqtt_client.h"
+#include "mqtt_batch.h"
+#include "excursion.h"
+#include "dsp.h"
+#include "winstats.h"
+#include "storm.h"
+#include "transient.h"
+#include "anomaly.h"
+#include "evcapture.h"
 
-#define BUFFER_SIZE 500
-float adc_buffer[BUFFER_SIZE];
-volatile int head = 0;
-volatile int tail = 0;
+static struct SpscRing mqtt_ring;   // adquisición -> hilo MQTT
+static struct MqttBatchConfig batch_cfg;
+static unsigned long mqtt_batches = 0;
 
-pthread_mutex_t buffer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct AcqConfig acq_cfg;
+static int scan_tagged = 0;   // 1 si hay varias entradas del scan o varios ADC
+static int csv_with_range = 0; // 1 si la ganancia cambia muestra a muestra (autorango)
 
-FILE *csv_file = NULL;
-char csv_filename[64];
+static struct CsvWriter csv_writer;
+static struct CaptureWriter cap_writer;
+static int store_csv = 1;      // STORE_FORMAT=csv|bin|both
+static int store_bin = 0;
+static struct SegmentIndex segments;
+
+static struct EventCaptureConfig evcap_cfg;
+static struct EventCapture evcap;   // adquisición -> escritor de eventos -> hilo MQTT
+
+static struct ExcursionConfig exc_cfg;
+static struct ExcursionTracker exc_trackers[ACQ_MAX_DEVICES * ACQ_MAX_SCAN];
+static struct ExcursionQueue exc_queue;   // adquisición -> hilo MQTT
+
+static struct TransientConfig trans_cfg;
+static struct TransientDetector trans_detectors[ACQ_MAX_DEVICES * ACQ_MAX_SCAN];
+static struct TransientQueue trans_queue;  // adquisición -> hilo MQTT
+
+// Cadena de filtrado por ADC y entrada; corre en el hilo MQTT, por bloques
+struct DspStream {
+    struct DspChain chain;
+    int16_t x[DSP_BLOCK_MAX];
+    uint64_t t[DSP_BLOCK_MAX];
+    int n;
+    uint8_t pga;
+    uint64_t last_ns;
+    uint64_t gap_ns;
+    struct ReadingBatch out;
+};
+static struct DspConfig dsp_cfg;
+static struct DspStream dsp_streams[ACQ_MAX_DEVICES * ACQ_MAX_SCAN];
+
+static struct StatsConfig stats_cfg;
+static struct WinStats win_stats[ACQ_MAX_DEVICES * ACQ_MAX_SCAN];
+
+static struct StormConfig storm_cfg;
+static struct StormDetector storms[ACQ_MAX_DEVICES * ACQ_MAX_SCAN];
+
+// Umbrales adaptativos por ADC y entrada; corren en el hilo MQTT
+static struct AnomalyConfig anom_cfg;
+static struct AnomalyDetector anomalies[ACQ_MAX_DEVICES * ACQ_MAX_SCAN];
 
 static float V_HIGH_THR = 4.0f;   // V
 static float V_LOW_THR  = 1.0f;   // V
@@ -27,41 +82,380 @@ static void load_env_thresholds(void) {
     fprintf(stdout, "[CFG] V_HIGH_THR=%.3f V, V_LOW_THR=%.3f V\n", V_HIGH_THR, V_LOW_THR);
 }
 
-void buffer_push(float value) {
-    pthread_mutex_lock(&buffer_mutex);
-    adc_buffer[head] = value;
-    head = (head + 1) % BUFFER_SIZE;
-    if (head == tail) {
-        // Overflow: avanzar tail para no bloquear
-        tail = (tail + 1) % BUFFER_SIZE;
+static void load_env_ring(size_t *capacity, size_t *batch) {
+    const char *sCap = getenv("RING_CAPACITY");
+    const char *sBatch = getenv("RING_BATCH");
+    *capacity = sCap ? (size_t)atol(sCap) : RING_DEFAULT_SLOTS;
+    *batch = sBatch ? (size_t)atol(sBatch) : 32;
+    fprintf(stdout, "[CFG] RING_CAPACITY=%zu lotes, RING_BATCH=%zu muestras\n", *capacity, *batch);
+}
+
+static void load_env_store(void) {
+    const char *sFmt = getenv("STORE_FORMAT");
+    if (sFmt && strcmp(sFmt, "bin") == 0) {
+        store_csv = 0;
+        store_bin = 1;
+    } else if (sFmt && strcmp(sFmt, "both") == 0) {
+        store_bin = 1;
+    } else if (sFmt && strcmp(sFmt, "none") == 0) {
+        store_csv = 0;   // Solo capturas de eventos
+    }
+    fprintf(stdout, "[CFG] STORE_FORMAT=%s\n",
+            store_csv ? (store_bin ? "both" : "csv") : (store_bin ? "bin" : "none"));
+}
+
+// Etiqueta "ch<entrada>" o "adc<addr>/ch<entrada>" de una muestra en modo etiquetado
+static void sample_tag(const struct AdcSample *s, char *buf, size_t n) {
+    char ch[8];
+    if (acq_cfg.mode == ACQ_MODE_SCAN)
+        snprintf(ch, sizeof(ch), "%s", acq_cfg.scan[s->channel].label);
+    else
+        snprintf(ch, sizeof(ch), "%d", acq_cfg.channel);
+    if (acq_cfg.num_devices > 1)
+        snprintf(buf, n, "adc%02x/ch%s", acq_cfg.addrs[s->device], ch);
+    else
+        snprintf(buf, n, "ch%s", ch);
+}
+
+static void send_reading_batch(struct ReadingBatch *b, const struct TimeAnchor *anchor) {
+    static char payload[MQTT_BATCH_MAX * 16 + PAYLOAD_MAX_SIZE];
+    char tag[32], filtered[48];
+    const char *topic_tag = NULL;
+    struct AdcSample first = { .device = b->device, .channel = b->channel };
+
+    if (scan_tagged) {
+        sample_tag(&first, tag, sizeof(tag));
+        topic_tag = tag;
+    }
+    if (b->filtered) {
+        snprintf(filtered, sizeof(filtered), topic_tag ? "filtered/%s" : "filtered", topic_tag);
+        topic_tag = filtered;
+    }
+    int len = reading_batch_take(b, &batch_cfg, anchor, payload, sizeof(payload));
+    if (len > 0) {
+        mqtt_send_batch(topic_tag, payload, len);
+        mqtt_batches++;
+    }
+}
+
+// Publica un evento de excursión; se ejecuta en el hilo MQTT, nunca en el de adquisición
+static void send_excursion(const struct ExcursionEvent *ev, const struct TimeAnchor *anchor) {
+    static const char *phases[] = { "", "onset", "update", "end" };
+    int64_t t_utc = time_anchor_to_utc_ns(anchor, ev->t_ns);
+    int64_t start_utc = time_anchor_to_utc_ns(anchor, ev->start_ns);
+    // Solo el inicio es urgente; actualizaciones y resumen van por el carril de eventos
+    int lane = ev->phase == EXC_ONSET ? MQTT_LANE_ALERT : MQTT_LANE_EVENT;
+
+    if (batch_cfg.binary) {
+        struct PayloadAlert alert = {
+            .t_utc_ns = t_utc,
+            .lsb_volts = sample_lsb(ev->pga),
+            .raw = ev->raw,
+            .device = ev->device,
+            .channel = ev->channel,
+            .trigger = ev->side,
+            .phase = ev->phase,
+            .start_utc_ns = start_utc,
+            .duration_ms = (uint32_t)(ev->duration_ns / 1000000),
+            .peak_v = ev->peak_v,
+            .area_vs = ev->area_vs,
+        };
+        uint8_t msg[PAYLOAD_HEADER_SIZE + 48];
+        int len = payload_encode_alert(&alert, msg, sizeof(msg));
+        if (len > 0) mqtt_send_alert(lane, msg, len);
+        return;
+    }
+    char timestamp[32], start[32];
+    time_format(t_utc, timestamp, sizeof(timestamp));
+    time_format(start_utc, start, sizeof(start));
+    char json[384];
+    snprintf(json, sizeof(json),
+             "{\"timestamp\":\"%s\",\"phase\":\"%s\",\"v\":%.5f,"
+             "\"v_high_thr\":%.5f,\"v_low_thr\":%.5f,"
+             "\"trigger\":\"%s\",\"start\":\"%s\",\"duration_ms\":%llu,"
+             "\"peak_v\":%.5f,\"area_vs\":%.6f}",
+             timestamp,
+             phases[ev->phase],
+             ev->raw * sample_lsb(ev->pga),
+             V_HIGH_THR,
+             V_LOW_THR,
+             (ev->side == EXC_HIGH ? "HIGH" : "LOW"),
+             start,
+             (unsigned long long)(ev->duration_ns / 1000000),
+             ev->peak_v,
+             ev->area_vs);
+
+    mqtt_send_alert_json(lane, json);
+}
+
+// Publica una fase de una excursión sobre los umbrales adaptativos del flujo i, como send_excursion
+static void send_anomaly(int i, const struct ExcursionEvent *ev, const struct TimeAnchor *anchor) {
+    static const char *phases[] = { "", "onset", "update", "end" };
+    const struct AnomalyBaseline *base = &anomalies[i].base;
+    int64_t t_utc = time_anchor_to_utc_ns(anchor, ev->t_ns);
+    int64_t start_utc = time_anchor_to_utc_ns(anchor, ev->start_ns);
+    float z = anomaly_z(&anomalies[i], ev->peak_v);
+    int lane = ev->phase == EXC_ONSET ? MQTT_LANE_ALERT : MQTT_LANE_EVENT;
+
+    if (batch_cfg.binary) {
+        struct PayloadAnomaly an = {
+            .t_utc_ns = t_utc, .start_utc_ns = start_utc, .duration_ms = (uint32_t)(ev->duration_ns / 1000000),
+            .voltage = ev->raw * sample_lsb(ev->pga), .peak_v = ev->peak_v, .z = z, .median_v = base->median,
+            .sigma_v = base->sigma, .thr_low = base->thr_low, .thr_high = base->thr_high,
+            .device = ev->device, .channel = ev->channel, .phase = ev->phase, .trigger = ev->side,
+        };
+        uint8_t msg[PAYLOAD_HEADER_SIZE + 64];
+        int len = payload_encode_anomaly(&an, msg, sizeof(msg));
+        if (len > 0) mqtt_send_alert(lane, msg, len);
+        return;
     }
-    pthread_mutex_unlock(&buffer_mutex);
+    char timestamp[32], start[32];
+    time_format(t_utc, timestamp, sizeof(timestamp));
+    time_format(start_utc, start, sizeof(start));
+    char json[448];
+    snprintf(json, sizeof(json),
+             "{\"timestamp\":\"%s\",\"source\":\"adaptive\",\"phase\":\"%s\",\"device\":%u,"
+             "\"channel\":%u,\"v\":%.5f,\"trigger\":\"%s\",\"start\":\"%s\",\"duration_ms\":%llu,"
+             "\"peak_v\":%.5f,\"z\":%.2f,\"median_v\":%.5f,\"sigma_v\":%.5f,"
+             "\"v_low_thr\":%.5f,\"v_high_thr\":%.5f}",
+             timestamp, phases[ev->phase], ev->device, ev->channel, ev->raw * sample_lsb(ev->pga),
+             (ev->side == EXC_HIGH ? "HIGH" : "LOW"), start, (unsigned long long)(ev->duration_ns / 1000000),
+             ev->peak_v, z, base->median, base->sigma, base->thr_low, base->thr_high);
+    mqtt_send_alert_json(lane, json);
 }
 
-int buffer_pop(float *value) {
-    pthread_mutex_lock(&buffer_mutex);
-    if (head == tail) {
-        pthread_mutex_unlock(&buffer_mutex);
-        return 0; // Buffer vacío
+// Resumen de un fichero de captura de evento en EVENT_TOPIC/capture
+static void send_capture(const struct EvCaptureDone *d) {
+    const struct CaptureEventInfo *ev = &d->info;
+    uint32_t duration_ms = (uint32_t)((ev->end_mono_ns - (ev->trigger_mono_ns - ev->pre_ms * 1000000ull)) / 1000000);
+    char msg[384];
+    int len;
+
+    if (batch_cfg.binary) {
+        struct PayloadCapture pc = {
+            .trigger_utc_ns = ev->trigger_utc_ns, .start_utc_ns = d->start_utc_ns, .duration_ms = duration_ms,
+            .samples = ev->samples, .bytes = (uint32_t)d->bytes, .value = ev->value, .triggers = ev->triggers,
+            .source = ev->source, .device = d->device, .channel = d->channel,
+        };
+        snprintf(pc.name, sizeof(pc.name), "%s", d->name);
+        len = payload_encode_capture(&pc, (uint8_t *)msg, sizeof(msg));
+    } else {
+        len = snprintf(msg, sizeof(msg),
+                       "{\"file\":\"%s\",\"source\":\"%s\",\"trigger_ns\":%lld,\"start_ns\":%lld,"
+                       "\"duration_ms\":%u,\"samples\":%u,\"triggers\":%u,\"value\":%.5f,\"bytes\":%llu}",
+                       d->name, ev->source == CAP_EVENT_TRANSIENT ? "transient" : "excursion",
+                       (long long)ev->trigger_utc_ns, (long long)d->start_utc_ns, duration_ms, ev->samples,
+                       ev->triggers, ev->value, (unsigned long long)d->bytes);
+    }
+    if (len > 0 && len < (int)sizeof(msg)) mqtt_send_event("capture", msg, len);
+}
+
+// Publica un escalón de campo en EVENT_TOPIC/transient[/<etiqueta>]
+static void send_transient(const struct TransientEvent *ev, const struct TimeAnchor *anchor) {
+    struct AdcSample first = { .device = ev->device, .channel = ev->channel };
+    char tag[32], topic[48], msg[256];
+    int64_t t_utc = time_anchor_to_utc_ns(anchor, ev->t_ns);
+    uint32_t gap_us = (uint32_t)((ev->t_ns - ev->prev_ns) / 1000);
+    int len;
+
+    if (scan_tagged) {
+        sample_tag(&first, tag, sizeof(tag));
+        snprintf(topic, sizeof(topic), "transient/%s", tag);
+    } else {
+        snprintf(topic, sizeof(topic), "transient");
+    }
+    if (batch_cfg.binary) {
+        struct PayloadTransient pt = {
+            .t_utc_ns = t_utc, .gap_us = gap_us, .amplitude_v = ev->amplitude_v, .jump_v = ev->jump_v,
+            .noise_v = ev->noise_v, .level_v = ev->level_v, .device = ev->device, .channel = ev->channel,
+            .pga = ev->pga, .sign = ev->sign,
+        };
+        len = payload_encode_transient(&pt, (uint8_t *)msg, sizeof(msg));
+    } else {
+        len = snprintf(msg, sizeof(msg),
+                       "{\"t_ns\":%lld,\"gap_us\":%u,\"amplitude_v\":%.5f,\"sign\":%d,"
+                       "\"jump_v\":%.5f,\"noise_v\":%.5f,\"level_v\":%.5f}",
+                       (long long)t_utc, gap_us, ev->amplitude_v, ev->sign, ev->jump_v, ev->noise_v,
+                       ev->level_v);
+    }
+    if (len > 0 && len < (int)sizeof(msg)) mqtt_send_event(topic, msg, len);
+}
+
+// Pasa el bloque acumulado por la cadena y encola las muestras filtradas
+static void dsp_flush(struct DspStream *ds, const struct TimeAnchor *anchor) {
+    float y[DSP_BLOCK_MAX];
+    uint64_t t[DSP_BLOCK_MAX];
+
+    int m = dsp_chain_process(&ds->chain, ds->x, ds->t, ds->n, y, t);
+    ds->n = 0;
+    for (int k = 0; k < m; k++) {
+        struct AdcSample s = { .t_ns = t[k], .device = ds->out.device, .channel = ds->out.channel,
+                               .pga = ds->pga };
+        if (reading_batch_breaks(&ds->out, &s)) send_reading_batch(&ds->out, anchor);
+        if (reading_batch_add_filtered(&ds->out, &s, y[k], &batch_cfg)) send_reading_batch(&ds->out, anchor);
+    }
+}
+
+static void dsp_push(const struct AdcSample *s, const struct TimeAnchor *anchor) {
+    struct DspStream *ds = &dsp_streams[(s->device * ACQ_MAX_SCAN + s->channel) % (ACQ_MAX_DEVICES * ACQ_MAX_SCAN)];
+
+    // Un cambio de ganancia o un hueco (más de dos periodos del propio flujo) invalidan los filtros
+    if (ds->last_ns && (s->pga != ds->pga || s->t_ns - ds->last_ns > ds->gap_ns)) {
+        if (ds->n) dsp_flush(ds, anchor);
+        dsp_chain_reset(&ds->chain);
+    }
+    ds->out.device = s->device;
+    ds->out.channel = s->channel;
+    ds->pga = s->pga;
+    ds->last_ns = s->t_ns;
+    ds->x[ds->n] = s->raw;
+    ds->t[ds->n] = s->t_ns;
+    if (++ds->n == DSP_BLOCK_MAX) dsp_flush(ds, anchor);
+}
+
+// Publica el resumen de cada ventana del flujo i en EVENT_TOPIC/stats/<ventana>[/<etiqueta>]
+static void send_stats(int i, const struct TimeAnchor *anchor) {
+    struct AdcSample first = { .device = (uint8_t)(i / ACQ_MAX_SCAN), .channel = (uint8_t)(i % ACQ_MAX_SCAN) };
+    char tag[32] = "", subtopic[64], msg[320];
+
+    if (scan_tagged) {
+        tag[0] = '/';
+        sample_tag(&first, tag + 1, sizeof(tag) - 1);
+    }
+    for (int w = 0; w < stats_cfg.nwin; w++) {
+        struct StatsSummary st;
+        if (!stats_summary(&win_stats[i], &stats_cfg, w, &st)) continue;
+        snprintf(subtopic, sizeof(subtopic), "stats/%gs%s", st.window_ms / 1000.0, tag);
+        int64_t t_end = time_anchor_to_utc_ns(anchor, st.t_end_ns);
+        int len;
+        if (batch_cfg.binary) {
+            struct PayloadStats ps = {
+                .t_end_utc_ns = t_end, .window_ms = st.window_ms, .n = st.n,
+                .device = first.device, .channel = first.channel,
+                .mean = st.mean, .rms = st.rms, .min = st.min, .max = st.max, .std = st.std, .slope = st.slope,
+            };
+            len = payload_encode_stats(&ps, (uint8_t *)msg, sizeof(msg));
+        } else {
+            len = snprintf(msg, sizeof(msg),
+                           "{\"t_end_ns\":%lld,\"window_ms\":%u,\"n\":%u,\"mean\":%.6f,\"rms\":%.6f,"
+                           "\"min\":%.6f,\"max\":%.6f,\"std\":%.6f,\"slope\":%.6f}",
+                           (long long)t_end, st.window_ms, st.n, st.mean, st.rms, st.min, st.max, st.std,
+                           st.slope);
+        }
+        if (len > 0 && len < (int)sizeof(msg)) mqtt_send_event(subtopic, msg, len);
+    }
+}
+
+// Informe del detector de tormenta del flujo i en EVENT_TOPIC/storm[/<etiqueta>];
+// las subidas a warning o alert van por el carril de alertas
+static void send_storm(int i, const struct StormReport *rep, const struct TimeAnchor *anchor) {
+    struct AdcSample first = { .device = (uint8_t)(i / ACQ_MAX_SCAN), .channel = (uint8_t)(i % ACQ_MAX_SCAN) };
+    char tag[32], topic[48], msg[320];
+    int64_t t_utc = time_anchor_to_utc_ns(anchor, rep->t_ns);
+    int len;
+
+    if (scan_tagged) {
+        sample_tag(&first, tag, sizeof(tag));
+        snprintf(topic, sizeof(topic), "storm/%s", tag);
+    } else {
+        snprintf(topic, sizeof(topic), "storm");
+    }
+    if (batch_cfg.binary) {
+        struct PayloadStorm ps = {
+            .t_utc_ns = t_utc, .confidence = rep->confidence,
+            .device = first.device, .channel = first.channel,
+            .level = (uint8_t)rep->level, .polarity = (int8_t)rep->polarity,
+            .flags = (uint8_t)((rep->reversal ? PAYLOAD_STORM_REVERSAL : 0) |
+                               (rep->level_changed ? PAYLOAD_STORM_CHANGED : 0)),
+            .nscales = (uint8_t)rep->nscales,
+        };
+        for (int k = 0; k < rep->nscales; k++) ps.slope_v_min[k] = rep->slope_v_min[k];
+        len = payload_encode_storm(&ps, (uint8_t *)msg, sizeof(msg));
+    } else {
+        len = snprintf(msg, sizeof(msg),
+                       "{\"t_ns\":%lld,\"level\":\"%s\",\"changed\":%s,\"confidence\":%.3f,"
+                       "\"polarity\":%d,\"reversal\":%s,\"slopes_v_min\":[",
+                       (long long)t_utc, storm_level_name(rep->level), rep->level_changed ? "true" : "false",
+                       rep->confidence, rep->polarity, rep->reversal ? "true" : "false");
+        for (int k = 0; k < rep->nscales && len < (int)sizeof(msg); k++)
+            len += snprintf(msg + len, sizeof(msg) - (size_t)len, "%s%.4f", k ? "," : "", rep->slope_v_min[k]);
+        if (len < (int)sizeof(msg)) len += snprintf(msg + len, sizeof(msg) - (size_t)len, "]}");
+    }
+    if (len <= 0 || len >= (int)sizeof(msg)) return;
+    if (rep->level_changed && rep->level >= STORM_WARNING) {
+        mqtt_send_alert(MQTT_LANE_ALERT, msg, len);
+        printf("[INFO] Tormenta: nivel %s (confianza %.2f)\n", storm_level_name(rep->level), rep->confidence);
+    } else {
+        mqtt_send_event(topic, msg, len);
     }
-    *value = adc_buffer[tail];
-    tail = (tail + 1) % BUFFER_SIZE;
-    pthread_mutex_unlock(&buffer_mutex);
-    return 1;
 }
 
 void *mqtt_task(void *arg) {
     mqtt_init();
+    if (batch_cfg.binary) {
+        // En binario los umbrales no viajan en cada alerta: se publican una vez, retenidos
+        struct PayloadThresholds thr = { V_HIGH_THR, V_LOW_THR };
+        uint8_t msg[PAYLOAD_HEADER_SIZE + 16];
+        int len = payload_encode_thresholds(&thr, msg, sizeof(msg));
+        if (len > 0) mqtt_send_alert_config(msg, len);
+    }
+    // Un lote en curso por ADC y entrada
+    static struct ReadingBatch batches[ACQ_MAX_DEVICES * ACQ_MAX_SCAN];
+    struct TimeAnchor anchor;
+    time_anchor_capture(&anchor);
+    uint64_t last_stats = mono_now_ns();
+    int wait_ms = batch_cfg.max_ms < 1000 ? batch_cfg.max_ms / 2 + 1 : 1000;
+
+    int backlog = 0;
 
     while (1) {
-        float value;
-        if (buffer_pop(&value)) {
-            mqtt_send(value);
-            // Opcional: sleep breve para no saturar red
-            usleep(5000);
-        } else {
-            // Esperar si no hay datos
-            usleep(1000);
+        // Se duerme en el eventfd del ring hasta que hay un lote (sin dormir si hay spool que vaciar)
+        struct SampleBatch *batch = ring_wait(&mqtt_ring, backlog ? 0 : wait_ms);
+        struct ExcursionEvent ev;
+        while (excursion_queue_pop(&exc_queue, &ev)) send_excursion(&ev, &anchor);
+        struct TransientEvent tev;
+        while (transient_queue_pop(&trans_queue, &tev)) send_transient(&tev, &anchor);
+        struct EvCaptureDone cap;
+        while (evcap_cfg.enabled && evcap_done_pop(&evcap, &cap)) send_capture(&cap);
+        if (batch) {
+            for (uint32_t i = 0; i < batch->count; i++) {
+                const struct AdcSample *value = &batch->samples[i];
+                struct ReadingBatch *b = &batches[(value->device * ACQ_MAX_SCAN + value->channel) %
+                                                  (ACQ_MAX_DEVICES * ACQ_MAX_SCAN)];
+                if (reading_batch_breaks(b, value)) send_reading_batch(b, &anchor);
+                if (reading_batch_add(b, value, &batch_cfg)) send_reading_batch(b, &anchor);
+                if (dsp_cfg.enabled) dsp_push(value, &anchor);
+                int si = (value->device * ACQ_MAX_SCAN + value->channel) % (ACQ_MAX_DEVICES * ACQ_MAX_SCAN);
+                if (stats_cfg.nwin && stats_add(&win_stats[si], &stats_cfg, value->t_ns, sample_volts(value)))
+                    send_stats(si, &anchor);
+                struct StormReport rep;
+                if (storm_cfg.enabled && storm_add(&storms[si], &storm_cfg, value->t_ns, sample_volts(value), &rep))
+                    send_storm(si, &rep, &anchor);
+                if (anom_cfg.enabled && anomaly_add(&anomalies[si], &anom_cfg, value, &ev))
+                    send_anomaly(si, &ev, &anchor);
+            }
+            ring_release(&mqtt_ring);
+            // Bloques de un lote del ring: la latencia añadida es la del propio lote
+            for (size_t i = 0; dsp_cfg.enabled && i < sizeof(dsp_streams) / sizeof(dsp_streams[0]); i++) {
+                if (dsp_streams[i].n) dsp_flush(&dsp_streams[i], &anchor);
+            }
+        }
+        uint64_t now = mono_now_ns();
+        for (size_t i = 0; i < sizeof(batches) / sizeof(batches[0]); i++) {
+            if (reading_batch_due(&batches[i], &batch_cfg, now)) send_reading_batch(&batches[i], &anchor);
+            if (reading_batch_due(&dsp_streams[i].out, &batch_cfg, now)) send_reading_batch(&dsp_streams[i].out, &anchor);
+            if (stats_cfg.nwin && stats_roll(&win_stats[i], &stats_cfg, now)) send_stats((int)i, &anchor);
+        }
+        backlog = mqtt_service();
+        if (now - last_stats >= 10000000000ull) {
+            printf("[STAT] MQTT: %.1f mensajes/s\n", mqtt_batches * 1e9 / (double)(now - last_stats));
+            ring_print_stats(&mqtt_ring, "cola MQTT");
+            if (exc_queue.dropped) printf("[STAT] Alertas perdidas por cola llena: %lu\n", exc_queue.dropped);
+            if (trans_queue.dropped) printf("[STAT] Transitorios perdidos por cola llena: %lu\n", trans_queue.dropped);
+            mqtt_print_stats();
+            mqtt_batches = 0;
+            time_anchor_capture(&anchor);
+            last_stats = now;
         }
     }
 
@@ -69,70 +463,152 @@ void *mqtt_task(void *arg) {
     return NULL;
 }
 
-void generate_csv_filename() {
-    int i = 1;
-    while (1) {
-        snprintf(csv_filename, sizeof(csv_filename), "datos_adc_%d.csv", i);
-        FILE *f = fopen(csv_filename, "r");
-        if (f == NULL) {
-            break; // Archivo no existe → usar este
-        }
-        fclose(f);
-        i++;
-    }
+static void csv_header(char *buf, size_t n) {
+    snprintf(buf, n, "t_ns%s,voltaje%s", scan_tagged ? ",canal" : "", csv_with_range ? ",rango" : "");
 }
 
-static inline void wallclock(char* buf, size_t n) {
-    time_t rawtime = time(NULL);
-    struct tm *timeinfo = localtime(&rawtime);
-    strftime(buf, n, "%Y-%m-%d %H:%M:%S", timeinfo);
+// Formatea una fila; se ejecuta en el hilo del CSV, no en el de adquisición
+static int csv_format_sample(char *dst, size_t n, const struct AdcSample *s, void *ctx) {
+    char tag[32] = "";
+    if (scan_tagged) {
+        tag[0] = ',';
+        sample_tag(s, tag + 1, sizeof(tag) - 1);
+    }
+    if (csv_with_range) {
+        // Con autorango los rangos estrechos dan resolución por debajo del mV
+        return snprintf(dst, n, "%llu%s,%.6f,%.3f\n", (unsigned long long)s->t_ns, tag, sample_volts(s),
+                        pgaFullScale((unsigned int)s->pga << 9));
+    }
+    return snprintf(dst, n, "%llu%s,%.3f\n", (unsigned long long)s->t_ns, tag, sample_volts(s));
 }
 
 int main(void) {
-    if (openI2CBus("/dev/i2c-1") == -1) return EXIT_FAILURE;
-    setI2CSlave(0x48);
-
     load_env_thresholds();
 
-    generate_csv_filename();
-    csv_file = fopen(csv_filename, "w");
-    if (!csv_file) {
-        perror("Error creando archivo CSV");
+    struct AcqState acq;
+    if (acq_load_env(&acq_cfg) < 0) return EXIT_FAILURE;
+    acq_cfg.v_high_thr = V_HIGH_THR;
+    acq_cfg.v_low_thr = V_LOW_THR;
+    excursion_load_env(&exc_cfg, V_HIGH_THR, V_LOW_THR);
+    transient_load_env(&trans_cfg);
+    anomaly_load_env(&anom_cfg, &exc_cfg);
+    for (size_t i = 0; anom_cfg.enabled && i < sizeof(anomalies) / sizeof(anomalies[0]); i++)
+        anomaly_init(&anomalies[i]);
+    if (acq_init(&acq, &acq_cfg) < 0) return EXIT_FAILURE;
+
+    load_env_store();
+    struct SegmentPolicy seg_policy;
+    segment_policy_load_env(&seg_policy);
+    if (segment_index_open(&segments, &seg_policy) < 0) return EXIT_FAILURE;
+    scan_tagged = (acq_cfg.mode == ACQ_MODE_SCAN || acq_cfg.num_devices > 1);
+    csv_with_range = acq_cfg.autorange;
+    if (store_csv) {
+        struct CsvWriterConfig csv_cfg;
+        char header[64];
+        csv_writer_load_env(&csv_cfg);
+        csv_header(header, sizeof(header));
+        if (csv_writer_open(&csv_writer, &csv_cfg, &segments, "datos_adc", header, csv_format_sample, NULL) < 0)
+            return EXIT_FAILURE;
+    }
+    if (store_bin) {
+        struct CaptureWriterConfig cap_cfg;
+        capture_writer_load_env(&cap_cfg);
+        if (capture_writer_open(&cap_writer, &cap_cfg, &segments, "datos_adc") < 0)
+            return EXIT_FAILURE;
+    }
+    evcap_load_env(&evcap_cfg);
+    if (evcap_cfg.enabled &&
+        evcap_open(&evcap, &evcap_cfg, &segments, "evento",
+                   (double)dataRateSps(acq_cfg.data_rate) * acq_cfg.num_devices) < 0)
         return EXIT_FAILURE;
+
+    size_t ring_capacity, ring_batch;
+    load_env_ring(&ring_capacity, &ring_batch);
+    if (ring_init(&mqtt_ring, ring_capacity, ring_batch) < 0) return EXIT_FAILURE;
+    mqtt_batch_load_env(&batch_cfg);
+    batch_cfg.decimals = csv_with_range ? 6 : 3;
+    // Cada cadena filtra un solo ADC/entrada: en modo scan va a la velocidad de una pasada
+    dsp_load_env(&dsp_cfg, acq_input_rate(&acq_cfg));
+    stats_load_env(&stats_cfg);
+    storm_load_env(&storm_cfg, (V_HIGH_THR + V_LOW_THR) / 2);
+    for (size_t i = 0; storm_cfg.enabled && i < sizeof(storms) / sizeof(storms[0]); i++)
+        storm_init(&storms[i], &storm_cfg);
+    for (size_t i = 0; dsp_cfg.enabled && i < sizeof(dsp_streams) / sizeof(dsp_streams[0]); i++) {
+        dsp_chain_init(&dsp_streams[i].chain, &dsp_cfg);
+        dsp_streams[i].gap_ns = (uint64_t)(2e9 / dsp_cfg.fs_hz);
+        dsp_streams[i].out.filtered = 1;
     }
-    fprintf(csv_file, "timestamp,voltaje\n");
-    printf("[INFO] Guardando CSV en: %s\n", csv_filename);
 
     pthread_t mqtt_thread;
     pthread_create(&mqtt_thread, NULL, mqtt_task, NULL);
 
+    struct LatencyHist loop_lat;
+    hist_reset(&loop_lat);
+    uint64_t last_stats = mono_now_ns();
+
     while (1) {
-        float voltage = readVoltage(0);
-        
-        char timestamp[32];
-        wallclock(timestamp, sizeof(timestamp));
-        // Guardar en CSV
-        fprintf(csv_file, "%s,%.3f\n", timestamp, voltage);
-        fflush(csv_file);
-
-        buffer_push(voltage);
-
-        if (voltage >= V_HIGH_THR || voltage <= V_LOW_THR) {
-            char json[256];
-            snprintf(json, sizeof(json),
-                     "{\"timestamp\":\"%s\",\"v\":%.5f,"
-                     "\"v_high_thr\":%.5f,\"v_low_thr\":%.5f,"
-                     "\"trigger\":\"%s\"}",
-                     timestamp,
-                     voltage,
-                     V_HIGH_THR,
-                     V_LOW_THR,
-                     (voltage >= V_HIGH_THR ? "HIGH" : "LOW"));
-
-            mqtt_send_alert_json(json);
+        struct AdcSample sample;
+        int acq_ret = acq_read(&acq, &sample);
+        if (acq_ret < 0) {
+            uint64_t now = mono_now_ns();
+            ring_flush(&mqtt_ring, now, RING_BATCH_MAX_MS * 1000000ull);
+            if (store_csv) csv_writer_idle(&csv_writer, now);
+            if (store_bin) capture_writer_idle(&cap_writer, now);
+            continue;
+        }
+        // Guardar en CSV / binario (cada formato lo escribe su propio hilo)
+        if (store_csv) csv_writer_push(&csv_writer, &sample);
+        if (store_bin) capture_writer_push(&cap_writer, &sample);
+        if (evcap_cfg.enabled) evcap_push(&evcap, &sample);
+
+        ring_push(&mqtt_ring, &sample);
+        ring_flush(&mqtt_ring, sample.t_ns, RING_BATCH_MAX_MS * 1000000ull);
+
+        // En modo ventana la comparación la hace el ADS1115 y llega latcheada por ALERT
+        struct ExcursionEvent ev;
+        struct ExcursionTracker *tr = &exc_trackers[(sample.device * ACQ_MAX_SCAN + sample.channel) %
+                                                    (ACQ_MAX_DEVICES * ACQ_MAX_SCAN)];
+        if (excursion_update(tr, &exc_cfg, &sample, acq_ret == ACQ_EXCURSION, &ev)) {
+            // El hilo MQTT la publica; el lote parcial se entrega ya para despertarlo
+            excursion_queue_push(&exc_queue, &ev);
+            ring_flush(&mqtt_ring, sample.t_ns, 0);
+            if (evcap_cfg.enabled && ev.phase == EXC_ONSET)
+                evcap_trigger(&evcap, ev.start_ns, CAP_EVENT_EXCURSION, &sample, ev.side, sample_volts(&sample));
+        }
+        struct TransientEvent tev;
+        if (trans_cfg.enabled &&
+            transient_update(&trans_detectors[(sample.device * ACQ_MAX_SCAN + sample.channel) %
+                                              (ACQ_MAX_DEVICES * ACQ_MAX_SCAN)], &trans_cfg, &sample, &tev)) {
+            transient_queue_push(&trans_queue, &tev);
+            ring_flush(&mqtt_ring, sample.t_ns, 0);
+            if (evcap_cfg.enabled && evcap_cfg.on_transient)
+                evcap_trigger(&evcap, tev.t_ns, CAP_EVENT_TRANSIENT, &sample, tev.sign, tev.amplitude_v);
+        }
+
+        // Fin de conversión -> muestra entregada: el jitter que vería el muestreo
+        uint64_t now = mono_now_ns();
+        hist_add(&loop_lat, now - sample.t_ns);
+        if (now - last_stats >= 60 * 1000000000ull) {
+            hist_print(&loop_lat, "latencia adquisición");
+            if (evcap_cfg.enabled) evcap_print_stats(&evcap);
+            if (trans_cfg.enabled) {
+                unsigned long steps = 0, spikes = 0;
+                for (size_t i = 0; i < sizeof(trans_detectors) / sizeof(trans_detectors[0]); i++) {
+                    steps += trans_detectors[i].steps;
+                    spikes += trans_detectors[i].spikes;
+                }
+                printf("[STAT] Transitorios: %lu escalones, %lu picos descartados\n", steps, spikes);
+            }
+            hist_reset(&loop_lat);
+            last_stats = now;
         }
     }
 
-    fclose(csv_file);
+    acq_cleanup(&acq);
+    ring_destroy(&mqtt_ring);
+    if (store_csv) csv_writer_close(&csv_writer);
+    if (store_bin) capture_writer_close(&cap_writer);
+    if (evcap_cfg.enabled) evcap_close(&evcap);
+    segment_index_close(&segments);
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,120 @@
+/**
+ * @file mqtt_batch.c
+ * @brief Groups the sample stream into one MQTT message per batch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mqtt_batch.h"
+
+#define NS_PER_MS 1000000ull
+
+void mqtt_batch_load_env(struct MqttBatchConfig *cfg) {
+    const char *sN = getenv("MQTT_BATCH_N");
+    const char *sMs = getenv("MQTT_BATCH_MS");
+    const char *sFmt = getenv("MQTT_FORMAT");
+    const char *sLz = getenv("MQTT_LZ");
+
+    cfg->max_samples = sN ? atoi(sN) : 200;
+    cfg->max_ms = sMs ? atoi(sMs) : 250;
+    if (cfg->max_samples < 1) cfg->max_samples = 1;
+    if (cfg->max_samples > MQTT_BATCH_MAX) cfg->max_samples = MQTT_BATCH_MAX;
+    if (cfg->max_ms < 1) cfg->max_ms = 1;
+    cfg->binary = sFmt && strcmp(sFmt, "bin") == 0;
+    cfg->lz = sLz ? atoi(sLz) != 0 : 1;
+
+    fprintf(stdout, "[CFG] MQTT_BATCH_N=%d muestras, MQTT_BATCH_MS=%d, MQTT_FORMAT=%s, MQTT_LZ=%d\n",
+            cfg->max_samples, cfg->max_ms, cfg->binary ? "bin" : "json", cfg->lz);
+}
+
+int reading_batch_breaks(const struct ReadingBatch *b, const struct AdcSample *s) {
+    if (b->count == 0) return 0;
+    if (s->pga != b->pga || s->t_ns <= b->last_ns) return 1;
+    if (!b->spacing_ns) return 0;
+
+    uint64_t gap = s->t_ns - b->last_ns;
+    return gap > b->spacing_ns + b->spacing_ns / 2 || gap < b->spacing_ns / 2;
+}
+
+// Abre la tanda con la primera muestra o anota el periodo con la segunda
+static void batch_track(struct ReadingBatch *b, const struct AdcSample *s) {
+    if (b->count == 0) {
+        b->start_ns = s->t_ns;
+        b->spacing_ns = 0;
+        b->device = s->device;
+        b->channel = s->channel;
+        b->pga = s->pga;
+    } else if (b->count == 1) {
+        b->spacing_ns = s->t_ns - b->last_ns;
+    }
+    b->last_ns = s->t_ns;
+}
+
+int reading_batch_add(struct ReadingBatch *b, const struct AdcSample *s, const struct MqttBatchConfig *cfg) {
+    batch_track(b, s);
+    b->raw[b->count++] = s->raw;
+    return b->count >= (uint32_t)cfg->max_samples;
+}
+
+int reading_batch_add_filtered(struct ReadingBatch *b, const struct AdcSample *s, float counts,
+                               const struct MqttBatchConfig *cfg) {
+    batch_track(b, s);
+    b->v[b->count++] = counts;
+    return b->count >= (uint32_t)cfg->max_samples;
+}
+
+int reading_batch_due(const struct ReadingBatch *b, const struct MqttBatchConfig *cfg, uint64_t now_ns) {
+    return b->count > 0 && now_ns > b->start_ns && now_ns - b->start_ns >= (uint64_t)cfg->max_ms * NS_PER_MS;
+}
+
+int reading_batch_take(struct ReadingBatch *b, const struct MqttBatchConfig *cfg,
+                       const struct TimeAnchor *anchor, char *buf, size_t n) {
+    uint64_t period = b->count > 1 ? (b->last_ns - b->start_ns) / (b->count - 1) : 0;
+    float lsb = sample_lsb(b->pga);
+
+    if (cfg->binary && b->filtered) {
+        struct PayloadSeries sr;
+        sr.seq = b->seq;
+        sr.t0_utc_ns = time_anchor_to_utc_ns(anchor, b->start_ns);
+        sr.dt_ns = (uint32_t)period;
+        sr.device = b->device;
+        sr.channel = b->channel;
+        sr.n = (uint16_t)b->count;
+        for (uint32_t i = 0; i < b->count; i++) b->v[i] *= lsb;
+        int len = payload_encode_series(&sr, b->v, (uint8_t *)buf, n);
+        b->count = 0;
+        b->seq++;
+        return len;
+    }
+    if (cfg->binary) {
+        struct PayloadReadings r;
+        r.seq = b->seq;
+        r.t0_utc_ns = time_anchor_to_utc_ns(anchor, b->start_ns);
+        r.dt_ns = (uint32_t)period;
+        r.lsb_volts = lsb;
+        r.device = b->device;
+        r.channel = b->channel;
+        r.pga = b->pga;
+        r.n = (uint16_t)b->count;
+        int len = payload_encode_readings(&r, b->raw, cfg->lz, (uint8_t *)buf, n);
+        b->count = 0;
+        b->seq++;
+        return len;
+    }
+
+    size_t len = (size_t)snprintf(buf, n, "{\"seq\":%u,\"t0_ns\":%lld,\"dt_ns\":%llu,\"n\":%u,\"v\":[",
+                                  b->seq, (long long)time_anchor_to_utc_ns(anchor, b->start_ns),
+                                  (unsigned long long)period, b->count);
+
+    int decimals = cfg->decimals + (b->filtered ? 2 : 0);
+    for (uint32_t i = 0; i < b->count && len < n; i++) {
+        float v = (b->filtered ? b->v[i] : b->raw[i]) * lsb;
+        len += (size_t)snprintf(buf + len, n - len, "%s%.*f", i ? "," : "", decimals, v);
+    }
+    if (len < n) len += (size_t)snprintf(buf + len, n - len, "]}");
+
+    b->count = 0;
+    b->seq++;
+    return len < n ? (int)len : -1;
+}
@@ -1,80 +1,529 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <pthread.h>
-#include "MQTTClient.h"
+#include "MQTTAsync.h"
 #include "mqtt_client.h"
+#include "timebase.h"
+#include "histogram.h"
+#include "spool.h"
 
 // Configuración MQTT
 #define ADDRESS     "tcp://broker.hivemq.com:1883"
 #define CLIENTID    "RaspiFieldSensor0"
 #define TOPIC       "ThunderSystem/eField/reading"
 #define ALERT_TOPIC "ThunderSystem/alert/electrostatic"
+#define EVENT_TOPIC "ThunderSystem/eField"
 #define QOS         1
 #define TIMEOUT     10000L
 
-MQTTClient client;
+#define INFLIGHT_DEFAULT 16
+#define INFLIGHT_MAX     64
+#define PAYLOAD_MAX      SPOOL_PAYLOAD_MAX   // Mayor mensaje que se puede encolar
+#define DRAIN_BUDGET_MS  50      // Tiempo máximo de reenvío del spool por llamada a mqtt_service()
+#define SPOOL_SYNC_MS    1000    // Cada cuánto se fuerza a disco lo escrito en el spool
+#define RETRY_MIN_MS     1000
+#define RETRY_MAX_MS     60000   // MQTT_RETRY_MAX_S
+
+// Mensaje esperando turno en un carril; el buffer se intercambia con el de la ranura al enviarlo
+struct OutMsg {
+    int qos;
+    int retained;
+    int len;
+    uint64_t enq_ns;
+    char topic[SPOOL_TOPIC_MAX];
+    char *payload;
+};
+
+// Cola FIFO de un carril de prioridad, con sus métricas desde la última estadística
+struct Lane {
+    const char *name;
+    int slots;
+    struct OutMsg *q;
+    unsigned int head, tail;
+    unsigned long queued, spilled;
+    int depth_max;
+    struct LatencyHist lat;   // encolado -> confirmación del broker
+};
+
+// Mensaje publicado y aún sin confirmar; el buffer se libera en el callback de entrega
+struct InFlight {
+    int busy;
+    int lane;         // -1 si viene del spool
+    int qos;
+    int retained;
+    int len;
+    uint64_t enq_ns;
+    uint64_t sent_ns;
+    char topic[SPOOL_TOPIC_MAX];
+    char *payload;
+};
+
+static MQTTAsync client;
 static pthread_mutex_t mqtt_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mqtt_cond = PTHREAD_COND_INITIALIZER;   // hueco libre en la ventana
+static pthread_mutex_t pump_mutex = PTHREAD_MUTEX_INITIALIZER; // un solo planificador a la vez
+static int qos_reading = QOS;   // MQTT_QOS_READING
+static int qos_alert = QOS;     // MQTT_QOS_ALERT
+
+static struct OutMsg lane_alert_q[16], lane_event_q[16], lane_bulk_q[32];
+static struct Lane lanes[MQTT_LANES] = {
+    [MQTT_LANE_ALERT] = { "alertas", 16, lane_alert_q },
+    [MQTT_LANE_EVENT] = { "eventos", 16, lane_event_q },
+    [MQTT_LANE_BULK] = { "lecturas", 32, lane_bulk_q },
+};
+
+static struct InFlight window[INFLIGHT_MAX];
+static int window_size = INFLIGHT_DEFAULT;   // MQTT_INFLIGHT
+static int window_shared = INFLIGHT_DEFAULT; // Ranuras que pueden usar eventos, lecturas y spool
+static int in_flight = 0;
+
+// Estado de la conexión; la reconexión la lleva mqtt_service() con backoff exponencial
+static int connected = 0;
+static int connecting = 0;
+static long retry_ms = RETRY_MIN_MS;
+static long retry_max_ms = RETRY_MAX_MS;
+static uint64_t next_retry_ns = 0;
+
+static struct Spool spool;   // Mensajes pendientes mientras el broker no está disponible
+static uint64_t last_sync_ns = 0;
+
+static unsigned long sent = 0, acked = 0, failed = 0, spooled = 0, dropped = 0;
+static int in_flight_max = 0;
+static struct LatencyHist ack_lat;   // publicación -> confirmación del broker
+
+static void pump(int wait);
+
+static int env_qos(const char *name, int def) {
+    const char *s = getenv(name);
+    int q = s ? atoi(s) : def;
+    return (q < 0 || q > 2) ? def : q;
+}
+
+// Deadline absoluto en CLOCK_REALTIME para pthread_cond_timedwait
+static void deadline_in(struct timespec *ts, long ms) {
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+// Guarda en disco un mensaje que no se ha podido entregar; sin spool se pierde
+static void spool_or_drop(const char *topic, const void *payload, int len, int qos, int retained) {
+    int rc = spool_append(&spool, topic, payload, len, qos, retained);
+    pthread_mutex_lock(&mqtt_mutex);
+    if (rc == 0) spooled++;
+    else dropped++;
+    pthread_mutex_unlock(&mqtt_mutex);
+}
+
+static void release_slot(struct InFlight *f) {
+    pthread_mutex_lock(&mqtt_mutex);
+    f->busy = 0;
+    in_flight--;
+    pthread_cond_broadcast(&mqtt_cond);
+    pthread_mutex_unlock(&mqtt_mutex);
+}
+
+static void on_delivered(void *context, MQTTAsync_successData *response) {
+    struct InFlight *f = context;
+    uint64_t now = mono_now_ns();
+    pthread_mutex_lock(&mqtt_mutex);
+    acked++;
+    hist_add(&ack_lat, now - f->sent_ns);
+    if (f->lane >= 0) hist_add(&lanes[f->lane].lat, now - f->enq_ns);
+    pthread_mutex_unlock(&mqtt_mutex);
+    release_slot(f);
+    pump(0);   // La ranura liberada se ocupa ya con lo más prioritario
+}
+
+static void on_delivery_failed(void *context, MQTTAsync_failureData *response) {
+    struct InFlight *f = context;
+    fprintf(stderr, "[ERROR] Publicación en %s no confirmada (codigo %d), se guarda en el spool\n",
+            f->topic, response ? response->code : -1);
+    pthread_mutex_lock(&mqtt_mutex);
+    failed++;
+    pthread_mutex_unlock(&mqtt_mutex);
+    spool_or_drop(f->topic, f->payload, f->len, f->qos, f->retained);
+    release_slot(f);
+    pump(0);
+}
+
+static void on_connected(void *context, MQTTAsync_successData *response) {
+    pthread_mutex_lock(&mqtt_mutex);
+    connected = 1;
+    connecting = 0;
+    retry_ms = RETRY_MIN_MS;
+    pthread_mutex_unlock(&mqtt_mutex);
+    printf("Conectado a MQTT broker en %s\n", ADDRESS);
+    pump(0);
+}
+
+static void on_connect_failed(void *context, MQTTAsync_failureData *response) {
+    pthread_mutex_lock(&mqtt_mutex);
+    connecting = 0;
+    next_retry_ns = mono_now_ns() + (uint64_t)retry_ms * 1000000ull;
+    fprintf(stderr, "Error al conectar con el broker MQTT. Código: %d, reintento en %ld ms\n",
+            response ? response->code : -1, retry_ms);
+    retry_ms = retry_ms * 2 < retry_max_ms ? retry_ms * 2 : retry_max_ms;
+    pthread_mutex_unlock(&mqtt_mutex);
+}
+
+static void on_connection_lost(void *context, char *cause) {
+    pthread_mutex_lock(&mqtt_mutex);
+    connected = 0;
+    next_retry_ns = mono_now_ns() + (uint64_t)retry_ms * 1000000ull;
+    pthread_mutex_unlock(&mqtt_mutex);
+    fprintf(stderr, "[ERROR] Conexión MQTT perdida: %s\n", cause ? cause : "desconocida");
+}
+
+static void start_connect(void) {
+    MQTTAsync_connectOptions conn_opts = MQTTAsync_connectOptions_initializer;
+
+    // Sesión persistente: los QoS 1 en vuelo al caer la conexión se reenvían al reconectar
+    conn_opts.cleansession = 0;
+    conn_opts.maxInflight = window_size;
+    conn_opts.onSuccess = on_connected;
+    conn_opts.onFailure = on_connect_failed;
+
+    pthread_mutex_lock(&mqtt_mutex);
+    connecting = 1;
+    pthread_mutex_unlock(&mqtt_mutex);
+    int rc = MQTTAsync_connect(client, &conn_opts);
+    if (rc != MQTTASYNC_SUCCESS) {
+        MQTTAsync_failureData fail = { 0 };
+        fail.code = rc;
+        on_connect_failed(NULL, &fail);
+    }
+}
+
+static char *alloc_payload(void) {
+    char *p = malloc(PAYLOAD_MAX);
+    if (!p) {
+        perror("Error reservando la cola MQTT");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
 
 void mqtt_init(void) {
-    MQTTClient_connectOptions conn_opts = MQTTClient_connectOptions_initializer;
+    const char *sInflight = getenv("MQTT_INFLIGHT");
+    const char *sRetry = getenv("MQTT_RETRY_MAX_S");
+    struct SpoolConfig spool_cfg;
 
-    MQTTClient_create(&client, ADDRESS, CLIENTID, MQTTCLIENT_PERSISTENCE_NONE, NULL);
+    qos_reading = env_qos("MQTT_QOS_READING", QOS);
+    qos_alert = env_qos("MQTT_QOS_ALERT", QOS);
+    if (sInflight) window_size = atoi(sInflight);
+    if (window_size < 1 || window_size > INFLIGHT_MAX) window_size = INFLIGHT_DEFAULT;
+    // Una ranura de la ventana queda siempre libre para las alertas
+    window_shared = window_size > 1 ? window_size - 1 : 1;
+    if (sRetry && atol(sRetry) > 0) retry_max_ms = atol(sRetry) * 1000;
+    fprintf(stdout, "[CFG] MQTT_QOS_READING=%d MQTT_QOS_ALERT=%d MQTT_INFLIGHT=%d MQTT_RETRY_MAX_S=%ld\n",
+            qos_reading, qos_alert, window_size, retry_max_ms / 1000);
 
-    int rc = MQTTClient_connect(client, &conn_opts);
-    if (rc != MQTTCLIENT_SUCCESS) {
-        fprintf(stderr, "Error al conectar con el broker MQTT. Código: %d\n", rc);
+    for (int i = 0; i < window_size; i++) window[i].payload = alloc_payload();
+    for (int l = 0; l < MQTT_LANES; l++) {
+        for (int i = 0; i < lanes[l].slots; i++) lanes[l].q[i].payload = alloc_payload();
+        hist_reset(&lanes[l].lat);
+    }
+    hist_reset(&ack_lat);
+
+    spool_load_env(&spool_cfg);
+    if (spool_open(&spool, &spool_cfg) < 0) {
+        fprintf(stderr, "[ERROR] Spool MQTT no disponible: sin broker los mensajes se pierden\n");
+        spool_cfg.max_bytes = 0;
+        spool_open(&spool, &spool_cfg);
+    }
+
+    int rc = MQTTAsync_create(&client, ADDRESS, CLIENTID, MQTTCLIENT_PERSISTENCE_NONE, NULL);
+    if (rc != MQTTASYNC_SUCCESS) {
+        fprintf(stderr, "[ERROR] No se pudo crear el cliente MQTT (rc=%d)\n", rc);
         exit(EXIT_FAILURE);
     }
+    // setCallbacks() rechaza un messageArrived nulo; sin este aviso no habría reconexión
+    rc = MQTTAsync_setConnectionLostCallback(client, NULL, on_connection_lost);
+    if (rc != MQTTASYNC_SUCCESS) {
+        fprintf(stderr, "[ERROR] No se pudo registrar la pérdida de conexión MQTT (rc=%d)\n", rc);
+        exit(EXIT_FAILURE);
+    }
+    // Sin broker no se sale: se sigue midiendo y guardando en el spool hasta que conecte
+    start_connect();
+}
 
-    printf("Conectado a MQTT broker en %s\n", ADDRESS);
+// Ranura libre si hay menos de limit mensajes en vuelo; llamar con mqtt_mutex tomado
+static struct InFlight *take_slot(int limit) {
+    if (in_flight >= limit) return NULL;
+    struct InFlight *f = NULL;
+    for (int i = 0; i < window_size && !f; i++) {
+        if (!window[i].busy) f = &window[i];
+    }
+    f->busy = 1;
+    in_flight++;
+    if (in_flight > in_flight_max) in_flight_max = in_flight;
+    return f;
+}
+
+// Espera como mucho wait_ms a que quede un hueco en la parte compartida de la ventana
+static struct InFlight *acquire_shared_slot(long wait_ms) {
+    struct timespec deadline;
+    deadline_in(&deadline, wait_ms);
+
+    pthread_mutex_lock(&mqtt_mutex);
+    struct InFlight *f;
+    while ((f = take_slot(window_shared)) == NULL) {
+        if (wait_ms <= 0 || pthread_cond_timedwait(&mqtt_cond, &mqtt_mutex, &deadline) != 0) break;
+    }
+    pthread_mutex_unlock(&mqtt_mutex);
+    return f;
 }
 
-void mqtt_send(float value) {
-    char payload[50];
-    snprintf(payload, sizeof(payload), "%.3f", value);
+// Publica el mensaje ya copiado en la ranura; si no se puede, vuelve al spool
+static int send_slot(struct InFlight *f) {
+    MQTTAsync_message pubmsg = MQTTAsync_message_initializer;
+    MQTTAsync_responseOptions opts = MQTTAsync_responseOptions_initializer;
 
-    MQTTClient_message pubmsg = MQTTClient_message_initializer;
-    MQTTClient_deliveryToken token;
+    pubmsg.payload = f->payload;
+    pubmsg.payloadlen = f->len;
+    pubmsg.qos = f->qos;
+    pubmsg.retained = f->retained;
+    opts.onSuccess = on_delivered;
+    opts.onFailure = on_delivery_failed;
+    opts.context = f;
+    f->sent_ns = mono_now_ns();
 
-    pubmsg.payload = payload;
-    pubmsg.payloadlen = (int)strlen(payload);
-    pubmsg.qos = QOS;
-    pubmsg.retained = 0;
+    int rc = MQTTAsync_sendMessage(client, f->topic, &pubmsg, &opts);
+    if (rc != MQTTASYNC_SUCCESS) {
+        fprintf(stderr, "[ERROR] Error al publicar en %s (codigo %d)\n", f->topic, rc);
+        spool_or_drop(f->topic, f->payload, f->len, f->qos, f->retained);
+        release_slot(f);
+        return rc;
+    }
+    pthread_mutex_lock(&mqtt_mutex);
+    sent++;
+    pthread_mutex_unlock(&mqtt_mutex);
+    return 0;
+}
 
-    printf("[TRACE] Enviando mensaje: %s\n", payload);
+// Pasa el primer mensaje del carril más prioritario con cola a una ranura libre
+static struct InFlight *dispatch_one(void) {
+    struct InFlight *f = NULL;
 
     pthread_mutex_lock(&mqtt_mutex);
-    int rc = MQTTClient_publishMessage(client, TOPIC, &pubmsg, &token);
-    if (rc != MQTTCLIENT_SUCCESS) {
-        fprintf(stderr, "[ERROR] Error al publicar el mensaje (codigo %d)\n", rc);
+    for (int l = 0; connected && l < MQTT_LANES && !f; l++) {
+        struct Lane *ln = &lanes[l];
+        if (ln->head == ln->tail) continue;
+        // Prioridad estricta: si el carril no cabe en la ventana, los de detrás tampoco
+        f = take_slot(l == MQTT_LANE_ALERT ? window_size : window_shared);
+        if (!f) break;
+        struct OutMsg *m = &ln->q[ln->tail % (unsigned int)ln->slots];
+        char *payload = f->payload;
+        f->payload = m->payload;
+        m->payload = payload;
+        f->lane = l;
+        f->qos = m->qos;
+        f->retained = m->retained;
+        f->len = m->len;
+        f->enq_ns = m->enq_ns;
+        memcpy(f->topic, m->topic, sizeof(f->topic));
+        ln->tail++;
+    }
+    pthread_mutex_unlock(&mqtt_mutex);
+    return f;
+}
+
+// Planificador: llena la ventana desde los carriles en orden de prioridad.
+// Desde los callbacks no espera: si otro hilo está planificando, ya lo hará él
+static void pump(int wait) {
+    if (wait) pthread_mutex_lock(&pump_mutex);
+    else if (pthread_mutex_trylock(&pump_mutex) != 0) return;
+
+    struct InFlight *f;
+    while ((f = dispatch_one()) != NULL) send_slot(f);
+    pthread_mutex_unlock(&pump_mutex);
+}
+
+static int lanes_empty(void) {
+    for (int l = 0; l < MQTT_LANES; l++) {
+        if (lanes[l].head != lanes[l].tail) return 0;
+    }
+    return 1;
+}
+
+static int enqueue(int lane, const char *topic, const void *payload, int len, int qos, int retained) {
+    if (len > PAYLOAD_MAX || strlen(topic) >= SPOOL_TOPIC_MAX) {
+        fprintf(stderr, "[ERROR] Mensaje de %d bytes demasiado grande para %s\n", len, topic);
+        return -1;
+    }
+    // Las lecturas no adelantan al backlog del spool: detrás de él conservan el orden
+    int behind_spool = (lane == MQTT_LANE_BULK) && spool_pending(&spool);
+    struct Lane *ln = &lanes[lane];
+
+    pthread_mutex_lock(&mqtt_mutex);
+    int spill = behind_spool || ln->head - ln->tail >= (unsigned int)ln->slots;
+    if (spill) {
+        ln->spilled++;
     } else {
-        MQTTClient_waitForCompletion(client, token, TIMEOUT);
+        struct OutMsg *m = &ln->q[ln->head % (unsigned int)ln->slots];
+        snprintf(m->topic, sizeof(m->topic), "%s", topic);
+        memcpy(m->payload, payload, (size_t)len);
+        m->len = len;
+        m->qos = qos;
+        m->retained = retained;
+        m->enq_ns = mono_now_ns();
+        ln->head++;
+        ln->queued++;
+        int depth = (int)(ln->head - ln->tail);
+        if (depth > ln->depth_max) ln->depth_max = depth;
     }
     pthread_mutex_unlock(&mqtt_mutex);
+
+    if (spill) spool_or_drop(topic, payload, len, qos, retained);
+    else pump(1);
+    return 0;
+}
+
+int mqtt_send_batch(const char *tag, const char *payload, int len) {
+    char topic[96];
+    if (tag)
+        snprintf(topic, sizeof(topic), "%s/%s", TOPIC, tag);
+    else
+        snprintf(topic, sizeof(topic), "%s", TOPIC);
+    return enqueue(MQTT_LANE_BULK, topic, payload, len, qos_reading, 0);
+}
+
+int mqtt_send_alert(int lane, const void *payload, int len) {
+    return enqueue(lane, ALERT_TOPIC, payload, len, qos_alert, 0);
 }
 
-int mqtt_send_alert_json(const char* json) {
+int mqtt_send_alert_json(int lane, const char* json) {
     if (!json) return -1;
+    return mqtt_send_alert(lane, json, (int)strlen(json));
+}
 
-    MQTTClient_message pubmsg = MQTTClient_message_initializer;
-    MQTTClient_deliveryToken token;
+int mqtt_send_alert_config(const void *payload, int len) {
+    // Retenido: un suscriptor nuevo recibe los umbrales al suscribirse
+    return enqueue(MQTT_LANE_EVENT, ALERT_TOPIC "/config", payload, len, qos_alert, 1);
+}
 
-    pubmsg.payload = (void*)json;
-    pubmsg.payloadlen = (int)strlen(json);
-    pubmsg.qos = QOS;
-    pubmsg.retained = 0;
+int mqtt_send_event(const char *subtopic, const void *payload, int len) {
+    char topic[SPOOL_TOPIC_MAX];
+    snprintf(topic, sizeof(topic), "%s/%s", EVENT_TOPIC, subtopic);
+    return enqueue(MQTT_LANE_EVENT, topic, payload, len, qos_reading, 0);
+}
 
-    int rc = MQTTClient_publishMessage(client, ALERT_TOPIC, &pubmsg, &token);
-    if (rc != MQTTCLIENT_SUCCESS) {
-        fprintf(stderr, "Error al publicar alerta en %s (codigo %d)\n", ALERT_TOPIC, rc);
-        return rc;
+static int is_connected(void) {
+    pthread_mutex_lock(&mqtt_mutex);
+    int c = connected;
+    pthread_mutex_unlock(&mqtt_mutex);
+    return c;
+}
+
+int mqtt_service(void) {
+    uint64_t now = mono_now_ns();
+
+    pthread_mutex_lock(&mqtt_mutex);
+    int reconnect = !connected && !connecting && now >= next_retry_ns;
+    pthread_mutex_unlock(&mqtt_mutex);
+    if (reconnect) start_connect();
+
+    pump(1);
+
+    // El spool va detrás de todos los carriles y sin tocar la ranura reservada a las alertas,
+    // sin acaparar el hilo más de DRAIN_BUDGET_MS
+    uint64_t deadline = now + DRAIN_BUDGET_MS * 1000000ull;
+    while (is_connected() && mono_now_ns() < deadline) {
+        pthread_mutex_lock(&mqtt_mutex);
+        int idle = lanes_empty();
+        pthread_mutex_unlock(&mqtt_mutex);
+        if (!idle) break;   // Los carriles se vacían al ir llegando las confirmaciones
+        struct InFlight *f = acquire_shared_slot(DRAIN_BUDGET_MS);
+        if (!f) break;
+        f->lane = -1;
+        if (!spool_next(&spool, f->topic, f->payload, PAYLOAD_MAX, &f->len, &f->qos, &f->retained)) {
+            release_slot(f);
+            break;
+        }
+        send_slot(f);
     }
-    MQTTClient_waitForCompletion(client, token, TIMEOUT);
-    return 0;
+    if (mono_now_ns() - last_sync_ns >= SPOOL_SYNC_MS * 1000000ull) {
+        spool_sync(&spool);
+        last_sync_ns = mono_now_ns();
+    }
+    return is_connected() && spool_pending(&spool);
+}
+
+void mqtt_print_stats(void) {
+    struct LatencyHist lat, lane_lat[MQTT_LANES];
+    char label[64];
+
+    pthread_mutex_lock(&mqtt_mutex);
+    printf("[STAT] MQTT %s: %lu enviados, %lu confirmados, %lu fallidos, %lu al spool, %lu perdidos, "
+           "en vuelo %d (máx %d de %d)\n",
+           connected ? "conectado" : "desconectado", sent, acked, failed, spooled, dropped,
+           in_flight, in_flight_max, window_size);
+    for (int l = 0; l < MQTT_LANES; l++) {
+        struct Lane *ln = &lanes[l];
+        printf("[STAT] MQTT carril %s: %lu encolados, %u en cola (máx %d de %d), %lu al spool\n",
+               ln->name, ln->queued, ln->head - ln->tail, ln->depth_max, ln->slots, ln->spilled);
+        lane_lat[l] = ln->lat;
+        hist_reset(&ln->lat);
+        ln->queued = ln->spilled = 0;
+        ln->depth_max = (int)(ln->head - ln->tail);
+    }
+    lat = ack_lat;
+    hist_reset(&ack_lat);
+    in_flight_max = in_flight;
+    pthread_mutex_unlock(&mqtt_mutex);
+    hist_print(&lat, "latencia confirmación MQTT");
+    for (int l = 0; l < MQTT_LANES; l++) {
+        snprintf(label, sizeof(label), "latencia carril %s (encolado -> confirmación)", lanes[l].name);
+        hist_print(&lane_lat[l], label);
+    }
+    spool_print_stats(&spool);
 }
 
 void mqtt_cleanup(void) {
-    MQTTClient_disconnect(client, 10000);
-    MQTTClient_destroy(&client);
+    MQTTAsync_disconnectOptions disc_opts = MQTTAsync_disconnectOptions_initializer;
+    struct timespec deadline;
+
+    // Dar tiempo a que salgan las colas y se confirme lo que queda en vuelo
+    deadline_in(&deadline, TIMEOUT);
+    pump(1);
+    pthread_mutex_lock(&mqtt_mutex);
+    while (in_flight > 0 || (connected && !lanes_empty())) {
+        pthread_mutex_unlock(&mqtt_mutex);
+        pump(1);
+        pthread_mutex_lock(&mqtt_mutex);
+        if (pthread_cond_timedwait(&mqtt_cond, &mqtt_mutex, &deadline) != 0) break;
+    }
+    // Lo que no ha salido se guarda para la próxima ejecución
+    for (int l = 0; l < MQTT_LANES; l++) {
+        struct Lane *ln = &lanes[l];
+        while (ln->head != ln->tail) {
+            struct OutMsg *m = &ln->q[ln->tail++ % (unsigned int)ln->slots];
+            pthread_mutex_unlock(&mqtt_mutex);
+            spool_or_drop(m->topic, m->payload, m->len, m->qos, m->retained);
+            pthread_mutex_lock(&mqtt_mutex);
+        }
+    }
+    pthread_mutex_unlock(&mqtt_mutex);
+
+    disc_opts.timeout = 10000;
+    MQTTAsync_disconnect(client, &disc_opts);
+    MQTTAsync_destroy(&client);
+    spool_close(&spool);
+    for (int i = 0; i < window_size; i++) {
+        free(window[i].payload);
+        window[i].payload = NULL;
+    }
+    for (int l = 0; l < MQTT_LANES; l++) {
+        for (int i = 0; i < lanes[l].slots; i++) {
+            free(lanes[l].q[i].payload);
+            lanes[l].q[i].payload = NULL;
+        }
+    }
 }
@@ -0,0 +1,491 @@
+/**
+ * @file payload.c
+ * @brief Compact binary MQTT payloads and their decoder.
+ */
+
+#include <string.h>
+#include "payload.h"
+
+#define LZ_MIN_MATCH    4
+#define LZ_LAST_LITERALS 5    // Los últimos 5 bytes van siempre como literales
+#define LZ_MF_LIMIT     12    // Ninguna coincidencia empieza en los últimos 12 bytes
+#define LZ_HASH_BITS    12
+#define LZ_MAX_OFFSET   65535
+
+static void put_u16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static void put_u64(uint8_t *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static void put_f32(uint8_t *p, float f) {
+    uint32_t v;
+    memcpy(&v, &f, sizeof(v));
+    put_u32(p, v);
+}
+
+static uint16_t get_u16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static uint64_t get_u64(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static float get_f32(const uint8_t *p) {
+    uint32_t v = get_u32(p);
+    float f;
+    memcpy(&f, &v, sizeof(f));
+    return f;
+}
+
+/* ---- LZ4 block ---- */
+
+static uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static int put_length(uint8_t **op, const uint8_t *oend, int len) {
+    while (len >= 255) {
+        if (*op >= oend) return -1;
+        *(*op)++ = 255;
+        len -= 255;
+    }
+    if (*op >= oend) return -1;
+    *(*op)++ = (uint8_t)len;
+    return 0;
+}
+
+static int emit_sequence(uint8_t **op, const uint8_t *oend, const uint8_t *lit, int lit_len,
+                         int offset, int match_len) {
+    uint8_t *token = (*op)++;
+    if (token >= oend) return -1;
+
+    int ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+    *token = (uint8_t)(((lit_len < 15 ? lit_len : 15) << 4) | (ml < 15 ? ml : 15));
+    if (lit_len >= 15 && put_length(op, oend, lit_len - 15) < 0) return -1;
+    if (*op + lit_len > oend) return -1;
+    memcpy(*op, lit, (size_t)lit_len);
+    *op += lit_len;
+    if (!match_len) return 0;
+
+    if (*op + 2 > oend) return -1;
+    put_u16(*op, (uint16_t)offset);
+    *op += 2;
+    if (ml >= 15 && put_length(op, oend, ml - 15) < 0) return -1;
+    return 0;
+}
+
+int payload_lz_compress(const uint8_t *src, int n, uint8_t *dst, int cap) {
+    int32_t table[1 << LZ_HASH_BITS];
+    uint8_t *op = dst;
+    const uint8_t *oend = dst + cap;
+    int ip = 0, anchor = 0;
+
+    for (int i = 0; i < (1 << LZ_HASH_BITS); i++) table[i] = -1;
+
+    while (ip < n - LZ_MF_LIMIT) {
+        uint32_t seq = read32(src + ip);
+        uint32_t h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+        int ref = table[h];
+        table[h] = ip;
+
+        if (ref < 0 || ip - ref > LZ_MAX_OFFSET || read32(src + ref) != seq) {
+            ip++;
+            continue;
+        }
+        int len = LZ_MIN_MATCH;
+        while (ip + len < n - LZ_LAST_LITERALS && src[ref + len] == src[ip + len]) len++;
+        if (emit_sequence(&op, oend, src + anchor, ip - anchor, ip - ref, len) < 0) return -1;
+        ip += len;
+        anchor = ip;
+    }
+    if (emit_sequence(&op, oend, src + anchor, n - anchor, 0, 0) < 0) return -1;
+    return (int)(op - dst);
+}
+
+static int get_length(const uint8_t **ip, const uint8_t *iend, int *len) {
+    uint8_t b;
+    do {
+        if (*ip >= iend) return -1;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+int payload_lz_decompress(const uint8_t *src, int n, uint8_t *dst, int cap) {
+    const uint8_t *ip = src, *iend = src + n;
+    uint8_t *op = dst, *oend = dst + cap;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+        int lit = token >> 4;
+        if (lit == 15 && get_length(&ip, iend, &lit) < 0) return -1;
+        if (ip + lit > iend || op + lit > oend) return -1;
+        memcpy(op, ip, (size_t)lit);
+        ip += lit;
+        op += lit;
+        if (ip == iend) break;   // Última secuencia: solo literales
+
+        if (ip + 2 > iend) return -1;
+        int offset = get_u16(ip);
+        ip += 2;
+        int len = token & 0x0F;
+        if (len == 15 && get_length(&ip, iend, &len) < 0) return -1;
+        len += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op - dst || op + len > oend) return -1;
+        // Copia byte a byte: la coincidencia puede solaparse con la salida
+        for (const uint8_t *m = op - offset; len > 0; len--) *op++ = *m++;
+    }
+    return (int)(op - dst);
+}
+
+/* ---- Mensajes ---- */
+
+static int finish(uint8_t type, uint8_t flags, const uint8_t *body, int len, int lz, uint8_t *out, size_t cap) {
+    if (cap < PAYLOAD_HEADER_SIZE + (size_t)len) return -1;
+    out[0] = PAYLOAD_MAGIC;
+    out[1] = PAYLOAD_VERSION;
+    out[2] = type;
+    out[3] = flags;
+    put_u16(out + 4, (uint16_t)len);
+    put_u16(out + 6, 0);
+
+    if (lz) {
+        int clen = payload_lz_compress(body, len, out + PAYLOAD_HEADER_SIZE, len - 1);
+        if (clen > 0) {
+            out[3] |= PAYLOAD_FLAG_LZ;
+            return PAYLOAD_HEADER_SIZE + clen;
+        }
+    }
+    memcpy(out + PAYLOAD_HEADER_SIZE, body, (size_t)len);
+    return PAYLOAD_HEADER_SIZE + len;
+}
+
+int payload_encode_readings(const struct PayloadReadings *r, const int16_t *raw, int lz,
+                            uint8_t *out, size_t cap) {
+    uint8_t body[26 + 2 * PAYLOAD_MAX_SAMPLES];
+
+    if (r->n > PAYLOAD_MAX_SAMPLES) return -1;
+    put_u32(body, r->seq);
+    put_u64(body + 4, (uint64_t)r->t0_utc_ns);
+    put_u32(body + 12, r->dt_ns);
+    put_f32(body + 16, r->lsb_volts);
+    body[20] = r->device;
+    body[21] = r->channel;
+    body[22] = r->pga;
+    body[23] = 0;
+    put_u16(body + 24, r->n);
+    uint16_t prev = 0;
+    for (uint16_t i = 0; i < r->n; i++) {
+        put_u16(body + 26 + 2 * i, (uint16_t)((uint16_t)raw[i] - (lz ? prev : 0)));
+        prev = (uint16_t)raw[i];
+    }
+    return finish(PAYLOAD_READINGS, lz ? PAYLOAD_FLAG_DELTA : 0, body, 26 + 2 * r->n, lz, out, cap);
+}
+
+int payload_encode_alert(const struct PayloadAlert *a, uint8_t *out, size_t cap) {
+    uint8_t body[40] = { 0 };
+
+    put_u64(body, (uint64_t)a->t_utc_ns);
+    put_f32(body + 8, a->lsb_volts);
+    put_u16(body + 12, (uint16_t)a->raw);
+    body[14] = a->device;
+    body[15] = a->channel;
+    body[16] = a->trigger;
+    body[17] = a->phase;
+    put_u64(body + 20, (uint64_t)a->start_utc_ns);
+    put_u32(body + 28, a->duration_ms);
+    put_f32(body + 32, a->peak_v);
+    put_f32(body + 36, a->area_vs);
+    return finish(PAYLOAD_ALERT, 0, body, sizeof(body), 0, out, cap);
+}
+
+int payload_encode_thresholds(const struct PayloadThresholds *t, uint8_t *out, size_t cap) {
+    uint8_t body[8];
+
+    put_f32(body, t->v_high_thr);
+    put_f32(body + 4, t->v_low_thr);
+    return finish(PAYLOAD_THRESHOLDS, 0, body, sizeof(body), 0, out, cap);
+}
+
+int payload_encode_stats(const struct PayloadStats *st, uint8_t *out, size_t cap) {
+    uint8_t body[44] = { 0 };
+
+    put_u64(body, (uint64_t)st->t_end_utc_ns);
+    put_u32(body + 8, st->window_ms);
+    put_u32(body + 12, st->n);
+    body[16] = st->device;
+    body[17] = st->channel;
+    put_f32(body + 20, st->mean);
+    put_f32(body + 24, st->rms);
+    put_f32(body + 28, st->min);
+    put_f32(body + 32, st->max);
+    put_f32(body + 36, st->std);
+    put_f32(body + 40, st->slope);
+    return finish(PAYLOAD_STATS, 0, body, sizeof(body), 0, out, cap);
+}
+
+int payload_encode_storm(const struct PayloadStorm *st, uint8_t *out, size_t cap) {
+    uint8_t body[20 + 4 * PAYLOAD_STORM_SCALES] = { 0 };
+
+    if (st->nscales > PAYLOAD_STORM_SCALES) return -1;
+    put_u64(body, (uint64_t)st->t_utc_ns);
+    put_f32(body + 8, st->confidence);
+    body[12] = st->device;
+    body[13] = st->channel;
+    body[14] = st->level;
+    body[15] = (uint8_t)st->polarity;
+    body[16] = st->flags;
+    body[17] = st->nscales;
+    for (int k = 0; k < st->nscales; k++) put_f32(body + 20 + 4 * k, st->slope_v_min[k]);
+    return finish(PAYLOAD_STORM, 0, body, 20 + 4 * st->nscales, 0, out, cap);
+}
+
+int payload_encode_transient(const struct PayloadTransient *tr, uint8_t *out, size_t cap) {
+    uint8_t body[32];
+
+    put_u64(body, (uint64_t)tr->t_utc_ns);
+    put_u32(body + 8, tr->gap_us);
+    put_f32(body + 12, tr->amplitude_v);
+    put_f32(body + 16, tr->jump_v);
+    put_f32(body + 20, tr->noise_v);
+    put_f32(body + 24, tr->level_v);
+    body[28] = tr->device;
+    body[29] = tr->channel;
+    body[30] = tr->pga;
+    body[31] = (uint8_t)tr->sign;
+    return finish(PAYLOAD_TRANSIENT, 0, body, sizeof(body), 0, out, cap);
+}
+
+int payload_encode_anomaly(const struct PayloadAnomaly *an, uint8_t *out, size_t cap) {
+    uint8_t body[52];
+
+    put_u64(body, (uint64_t)an->t_utc_ns);
+    put_u64(body + 8, (uint64_t)an->start_utc_ns);
+    put_u32(body + 16, an->duration_ms);
+    put_f32(body + 20, an->voltage);
+    put_f32(body + 24, an->peak_v);
+    put_f32(body + 28, an->z);
+    put_f32(body + 32, an->median_v);
+    put_f32(body + 36, an->sigma_v);
+    put_f32(body + 40, an->thr_low);
+    put_f32(body + 44, an->thr_high);
+    body[48] = an->device;
+    body[49] = an->channel;
+    body[50] = an->phase;
+    body[51] = an->trigger;
+    return finish(PAYLOAD_ANOMALY, 0, body, sizeof(body), 0, out, cap);
+}
+
+int payload_encode_capture(const struct PayloadCapture *pc, uint8_t *out, size_t cap) {
+    uint8_t body[40 + PAYLOAD_NAME_MAX] = { 0 };
+    size_t nlen = strnlen(pc->name, PAYLOAD_NAME_MAX - 1);
+
+    put_u64(body, (uint64_t)pc->trigger_utc_ns);
+    put_u64(body + 8, (uint64_t)pc->start_utc_ns);
+    put_u32(body + 16, pc->duration_ms);
+    put_u32(body + 20, pc->samples);
+    put_u32(body + 24, pc->bytes);
+    put_f32(body + 28, pc->value);
+    put_u16(body + 32, pc->triggers);
+    body[34] = pc->source;
+    body[35] = pc->device;
+    body[36] = pc->channel;
+    body[37] = (uint8_t)nlen;
+    memcpy(body + 40, pc->name, nlen);
+    return finish(PAYLOAD_CAPTURE, 0, body, 40 + nlen, 0, out, cap);
+}
+
+int payload_encode_series(const struct PayloadSeries *s, const float *v, uint8_t *out, size_t cap) {
+    uint8_t body[20 + 4 * PAYLOAD_MAX_SAMPLES];
+
+    if (s->n > PAYLOAD_MAX_SAMPLES) return -1;
+    put_u32(body, s->seq);
+    put_u64(body + 4, (uint64_t)s->t0_utc_ns);
+    put_u32(body + 12, s->dt_ns);
+    body[16] = s->device;
+    body[17] = s->channel;
+    put_u16(body + 18, s->n);
+    for (uint16_t i = 0; i < s->n; i++) put_f32(body + 20 + 4 * i, v[i]);
+    // Los float casi no se repiten byte a byte: LZ no compensa
+    return finish(PAYLOAD_SERIES, 0, body, 20 + 4 * s->n, 0, out, cap);
+}
+
+int payload_decode(const uint8_t *msg, size_t len, struct PayloadMessage *out) {
+    uint8_t buf[20 + 4 * PAYLOAD_MAX_SAMPLES];
+    const uint8_t *body = msg + PAYLOAD_HEADER_SIZE;
+
+    if (len < PAYLOAD_HEADER_SIZE || msg[0] != PAYLOAD_MAGIC || msg[1] != PAYLOAD_VERSION) return -1;
+    int blen = get_u16(msg + 4);
+    if (blen > (int)sizeof(buf)) return -1;
+    if (msg[3] & PAYLOAD_FLAG_LZ) {
+        if (payload_lz_decompress(body, (int)(len - PAYLOAD_HEADER_SIZE), buf, blen) != blen) return -1;
+        body = buf;
+    } else if (len - PAYLOAD_HEADER_SIZE < (size_t)blen) {
+        return -1;
+    }
+
+    out->type = msg[2];
+    switch (out->type) {
+    case PAYLOAD_READINGS: {
+        struct PayloadReadings *r = &out->u.readings;
+        if (blen < 26) return -1;
+        r->seq = get_u32(body);
+        r->t0_utc_ns = (int64_t)get_u64(body + 4);
+        r->dt_ns = get_u32(body + 12);
+        r->lsb_volts = get_f32(body + 16);
+        r->device = body[20];
+        r->channel = body[21];
+        r->pga = body[22];
+        r->n = get_u16(body + 24);
+        if (r->n > PAYLOAD_MAX_SAMPLES || blen < 26 + 2 * r->n) return -1;
+        uint16_t prev = 0;
+        for (uint16_t i = 0; i < r->n; i++) {
+            uint16_t v = get_u16(body + 26 + 2 * i);
+            if (msg[3] & PAYLOAD_FLAG_DELTA) v = (uint16_t)(v + prev);
+            r->raw[i] = (int16_t)v;
+            prev = v;
+        }
+        return 0;
+    }
+    case PAYLOAD_ALERT: {
+        struct PayloadAlert *a = &out->u.alert;
+        if (blen < 40) return -1;
+        a->t_utc_ns = (int64_t)get_u64(body);
+        a->lsb_volts = get_f32(body + 8);
+        a->raw = (int16_t)get_u16(body + 12);
+        a->device = body[14];
+        a->channel = body[15];
+        a->trigger = body[16];
+        a->phase = body[17];
+        a->start_utc_ns = (int64_t)get_u64(body + 20);
+        a->duration_ms = get_u32(body + 28);
+        a->peak_v = get_f32(body + 32);
+        a->area_vs = get_f32(body + 36);
+        return 0;
+    }
+    case PAYLOAD_THRESHOLDS:
+        if (blen < 8) return -1;
+        out->u.thresholds.v_high_thr = get_f32(body);
+        out->u.thresholds.v_low_thr = get_f32(body + 4);
+        return 0;
+    case PAYLOAD_STATS: {
+        struct PayloadStats *st = &out->u.stats;
+        if (blen < 44) return -1;
+        st->t_end_utc_ns = (int64_t)get_u64(body);
+        st->window_ms = get_u32(body + 8);
+        st->n = get_u32(body + 12);
+        st->device = body[16];
+        st->channel = body[17];
+        st->mean = get_f32(body + 20);
+        st->rms = get_f32(body + 24);
+        st->min = get_f32(body + 28);
+        st->max = get_f32(body + 32);
+        st->std = get_f32(body + 36);
+        st->slope = get_f32(body + 40);
+        return 0;
+    }
+    case PAYLOAD_STORM: {
+        struct PayloadStorm *st = &out->u.storm;
+        if (blen < 20) return -1;
+        st->t_utc_ns = (int64_t)get_u64(body);
+        st->confidence = get_f32(body + 8);
+        st->device = body[12];
+        st->channel = body[13];
+        st->level = body[14];
+        st->polarity = (int8_t)body[15];
+        st->flags = body[16];
+        st->nscales = body[17];
+        if (st->nscales > PAYLOAD_STORM_SCALES || blen < 20 + 4 * st->nscales) return -1;
+        for (int k = 0; k < st->nscales; k++) st->slope_v_min[k] = get_f32(body + 20 + 4 * k);
+        return 0;
+    }
+    case PAYLOAD_TRANSIENT: {
+        struct PayloadTransient *tr = &out->u.transient;
+        if (blen < 32) return -1;
+        tr->t_utc_ns = (int64_t)get_u64(body);
+        tr->gap_us = get_u32(body + 8);
+        tr->amplitude_v = get_f32(body + 12);
+        tr->jump_v = get_f32(body + 16);
+        tr->noise_v = get_f32(body + 20);
+        tr->level_v = get_f32(body + 24);
+        tr->device = body[28];
+        tr->channel = body[29];
+        tr->pga = body[30];
+        tr->sign = (int8_t)body[31];
+        return 0;
+    }
+    case PAYLOAD_ANOMALY: {
+        struct PayloadAnomaly *an = &out->u.anomaly;
+        if (blen < 52) return -1;
+        an->t_utc_ns = (int64_t)get_u64(body);
+        an->start_utc_ns = (int64_t)get_u64(body + 8);
+        an->duration_ms = get_u32(body + 16);
+        an->voltage = get_f32(body + 20);
+        an->peak_v = get_f32(body + 24);
+        an->z = get_f32(body + 28);
+        an->median_v = get_f32(body + 32);
+        an->sigma_v = get_f32(body + 36);
+        an->thr_low = get_f32(body + 40);
+        an->thr_high = get_f32(body + 44);
+        an->device = body[48];
+        an->channel = body[49];
+        an->phase = body[50];
+        an->trigger = body[51];
+        return 0;
+    }
+    case PAYLOAD_CAPTURE: {
+        struct PayloadCapture *pc = &out->u.capture;
+        if (blen < 40) return -1;
+        int nlen = body[37];
+        if (nlen >= PAYLOAD_NAME_MAX || blen < 40 + nlen) return -1;
+        pc->trigger_utc_ns = (int64_t)get_u64(body);
+        pc->start_utc_ns = (int64_t)get_u64(body + 8);
+        pc->duration_ms = get_u32(body + 16);
+        pc->samples = get_u32(body + 20);
+        pc->bytes = get_u32(body + 24);
+        pc->value = get_f32(body + 28);
+        pc->triggers = get_u16(body + 32);
+        pc->source = body[34];
+        pc->device = body[35];
+        pc->channel = body[36];
+        memcpy(pc->name, body + 40, (size_t)nlen);
+        pc->name[nlen] = '\0';
+        return 0;
+    }
+    case PAYLOAD_SERIES: {
+        struct PayloadSeries *sr = &out->u.series;
+        if (blen < 20) return -1;
+        sr->seq = get_u32(body);
+        sr->t0_utc_ns = (int64_t)get_u64(body + 4);
+        sr->dt_ns = get_u32(body + 12);
+        sr->device = body[16];
+        sr->channel = body[17];
+        sr->n = get_u16(body + 18);
+        if (sr->n > PAYLOAD_MAX_SAMPLES || blen < 20 + 4 * sr->n) return -1;
+        for (uint16_t i = 0; i < sr->n; i++) sr->v[i] = get_f32(body + 20 + 4 * i);
+        return 0;
+    }
+    default:
+        return -1;
+    }
+}
@@ -0,0 +1,120 @@
+/**
+ * @file quantile.c
+ * @brief Streaming quantile sketch (merging t-digest) with fixed memory.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include "quantile.h"
+
+#define PI_F 3.14159265f
+
+void qsketch_reset(struct QSketch *s) {
+    s->nc = 0;
+    s->nbuf = 0;
+    s->total = 0;
+    s->min = INFINITY;
+    s->max = -INFINITY;
+}
+
+static int cmp_float(const void *a, const void *b) {
+    float x = *(const float *)a, y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+// Rango máximo (0..1) que puede cubrir un centroide que empieza en q0
+static double q_limit(double q0) {
+    double k = QS_COMPRESSION / (2 * PI_F) * asin(2 * q0 - 1) + 1;
+    if (k >= QS_COMPRESSION / 4.0) return 1.0;
+    return (sin(k * 2 * PI_F / QS_COMPRESSION) + 1) / 2;
+}
+
+// Fusiona los centroides con @p add (ordenados por media) y vuelve a comprimir
+static void compress(struct QSketch *s, const struct QsCentroid *add, int nadd) {
+    struct QsCentroid all[QS_MAX_CENTROIDS * 2 + QS_BUFFER];
+    int n = 0, i = 0, j = 0;
+
+    while (i < s->nc || j < nadd) {
+        if (j >= nadd || (i < s->nc && s->c[i].mean <= add[j].mean)) all[n++] = s->c[i++];
+        else all[n++] = add[j++];
+    }
+    double total = 0;
+    for (int k = 0; k < n; k++) total += all[k].weight;
+    if (n == 0) return;
+
+    struct QsCentroid cur = all[0];
+    double done = 0;
+    double limit = q_limit(0) * total;
+    s->nc = 0;
+    for (int k = 1; k < n; k++) {
+        // El último hueco absorbe lo que quede aunque supere el límite
+        if (done + cur.weight + all[k].weight <= limit || s->nc == QS_MAX_CENTROIDS - 1) {
+            double w = (double)cur.weight + all[k].weight;
+            cur.mean = (float)(cur.mean + (all[k].mean - cur.mean) * (all[k].weight / w));
+            cur.weight = (float)w;
+        } else {
+            s->c[s->nc++] = cur;
+            done += cur.weight;
+            limit = q_limit(done / total) * total;
+            cur = all[k];
+        }
+    }
+    s->c[s->nc++] = cur;
+}
+
+static void flush(struct QSketch *s) {
+    struct QsCentroid add[QS_BUFFER];
+
+    if (s->nbuf == 0) return;
+    qsort(s->buf, (size_t)s->nbuf, sizeof(float), cmp_float);
+    for (int i = 0; i < s->nbuf; i++) add[i] = (struct QsCentroid) { s->buf[i], 1.0f };
+    int n = s->nbuf;
+    s->nbuf = 0;
+    compress(s, add, n);
+}
+
+void qsketch_add(struct QSketch *s, float v) {
+    if (isnan(v)) return;
+    if (v < s->min) s->min = v;
+    if (v > s->max) s->max = v;
+    s->total += 1;
+    s->buf[s->nbuf++] = v;
+    if (s->nbuf == QS_BUFFER) flush(s);
+}
+
+void qsketch_merge(struct QSketch *dst, const struct QSketch *src) {
+    struct QSketch tmp = *src;
+
+    flush(&tmp);
+    flush(dst);
+    if (tmp.nc == 0) return;
+    compress(dst, tmp.c, tmp.nc);
+    dst->total += tmp.total;
+    if (tmp.min < dst->min) dst->min = tmp.min;
+    if (tmp.max > dst->max) dst->max = tmp.max;
+}
+
+float qsketch_quantile(struct QSketch *s, float q) {
+    flush(s);
+    if (s->nc == 0) return NAN;
+    if (q <= 0) return s->min;
+    if (q >= 1) return s->max;
+
+    // Cada centroide representa su media en el centro de su rango; entre centros se interpola
+    double rank = q * s->total;
+    double left = 0;
+    float prev_mean = s->min;
+    double prev_rank = 0;
+    for (int i = 0; i < s->nc; i++) {
+        double center = left + s->c[i].weight / 2.0;
+        if (rank < center) {
+            double f = (rank - prev_rank) / (center - prev_rank);
+            return (float)(prev_mean + f * (s->c[i].mean - prev_mean));
+        }
+        prev_mean = s->c[i].mean;
+        prev_rank = center;
+        left += s->c[i].weight;
+    }
+    double f = (rank - prev_rank) / (s->total - prev_rank);
+    return (float)(prev_mean + f * (s->max - prev_mean));
+}
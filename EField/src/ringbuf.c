@@ -0,0 +1,136 @@
+/**
+ * @file ringbuf.c
+ * @brief Lock-free SPSC ring of sample batches with eventfd wakeup.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include "ringbuf.h"
+#include "timebase.h"
+
+int ring_init(struct SpscRing *r, size_t capacity, size_t batch_size) {
+    size_t cap = 2;
+
+    memset(r, 0, sizeof(*r));
+    while (cap < capacity) cap <<= 1;
+    if (batch_size == 0 || batch_size > RING_BATCH_MAX) batch_size = RING_BATCH_MAX;
+
+    r->slots = aligned_alloc(RING_CACHE_LINE, cap * sizeof(struct SampleBatch));
+    if (!r->slots) {
+        perror("Error reservando el ring buffer");
+        return -1;
+    }
+    r->efd = eventfd(0, EFD_CLOEXEC);
+    if (r->efd < 0) {
+        perror("Error creando eventfd");
+        free(r->slots);
+        r->slots = NULL;
+        return -1;
+    }
+    r->capacity = cap;
+    r->mask = cap - 1;
+    r->batch_size = batch_size;
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    atomic_init(&r->waiting, 0);
+    return 0;
+}
+
+static void publish(struct SpscRing *r) {
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+
+    r->open->publish_ns = mono_now_ns();
+    r->open->seq = r->next_seq++;
+    r->open = NULL;
+    r->pstats.published++;
+    if (head + 1 - tail > r->pstats.high_water) r->pstats.high_water = head + 1 - tail;
+
+    // seq_cst emparejado con el del consumidor: o ve el nuevo head, o nosotros vemos waiting
+    atomic_store(&r->head, head + 1);
+    if (atomic_load(&r->waiting)) {
+        uint64_t one = 1;
+        if (write(r->efd, &one, sizeof(one)) < 0) perror("eventfd write");
+    }
+}
+
+void ring_push(struct SpscRing *r, const struct AdcSample *s) {
+    if (!r->open) {
+        size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+        size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+        if (head - tail == r->capacity) {
+            // Lleno: se pierde esta muestra, nunca se bloquea la adquisición
+            r->pstats.dropped_samples++;
+            return;
+        }
+        r->open = &r->slots[head & r->mask];
+        r->open->count = 0;
+    }
+    r->open->samples[r->open->count++] = *s;
+    if (r->open->count == r->batch_size) publish(r);
+}
+
+void ring_flush(struct SpscRing *r, uint64_t now_ns, uint64_t max_age_ns) {
+    if (!r->open || r->open->count == 0) return;
+    if (now_ns - r->open->samples[0].t_ns < max_age_ns) return;
+    publish(r);
+}
+
+struct SampleBatch *ring_wait(struct SpscRing *r, int timeout_ms) {
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+    if (atomic_load_explicit(&r->head, memory_order_acquire) == tail) {
+        atomic_store(&r->waiting, 1);
+        if (atomic_load(&r->head) == tail) {
+            struct pollfd pfd = { .fd = r->efd, .events = POLLIN };
+            if (poll(&pfd, 1, timeout_ms) > 0) {
+                uint64_t n;
+                if (read(r->efd, &n, sizeof(n)) < 0) perror("eventfd read");
+            }
+        }
+        atomic_store(&r->waiting, 0);
+        if (atomic_load_explicit(&r->head, memory_order_acquire) == tail) return NULL;
+    }
+
+    struct SampleBatch *b = &r->slots[tail & r->mask];
+    uint64_t now = mono_now_ns();
+    uint64_t queued = now - b->publish_ns;
+    r->cstats.consumed++;
+    r->cstats.queue_ns_sum += queued;
+    if (queued > r->cstats.queue_ns_max) r->cstats.queue_ns_max = queued;
+    if (b->count && now - b->samples[0].t_ns > r->cstats.age_ns_max)
+        r->cstats.age_ns_max = now - b->samples[0].t_ns;
+    return b;
+}
+
+void ring_release(struct SpscRing *r) {
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+}
+
+size_t ring_occupancy(struct SpscRing *r) {
+    return atomic_load(&r->head) - atomic_load(&r->tail);
+}
+
+void ring_print_stats(struct SpscRing *r, const char *label) {
+    const struct RingProducerStats *ps = &r->pstats;
+    const struct RingConsumerStats *cs = &r->cstats;
+    double mean_ms = cs->consumed ? (double)cs->queue_ns_sum / (double)cs->consumed / 1e6 : 0.0;
+
+    printf("[STAT] %s: %zu/%zu lotes (máx %zu), publicados %lu, muestras perdidas %lu, "
+           "cola media %.2f ms máx %.2f ms, edad máx %.2f ms\n",
+           label, ring_occupancy(r), r->capacity, ps->high_water, ps->published,
+           ps->dropped_samples, mean_ms, (double)cs->queue_ns_max / 1e6,
+           (double)cs->age_ns_max / 1e6);
+}
+
+void ring_destroy(struct SpscRing *r) {
+    if (r->efd >= 0) close(r->efd);
+    free(r->slots);
+    r->slots = NULL;
+    r->efd = -1;
+}
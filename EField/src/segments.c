@@ -0,0 +1,224 @@
+/**
+ * @file segments.c
+ * @brief Rolling capture files with a manifest and a retention policy.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "timebase.h"
+#include "segments.h"
+
+#define NS_PER_S 1000000000ll
+
+void segment_policy_load_env(struct SegmentPolicy *pol) {
+    const char *sDir = getenv("SEG_DIR");
+    const char *sMax = getenv("SEG_MAX_MB");
+    const char *sSecs = getenv("SEG_MAX_S");
+    const char *sKeep = getenv("SEG_KEEP_MB");
+    const char *sKeepH = getenv("SEG_KEEP_H");
+
+    snprintf(pol->dir, sizeof(pol->dir), "%s", sDir ? sDir : ".");
+    pol->max_bytes = (sMax ? (uint64_t)atol(sMax) : 64) * 1024 * 1024;
+    pol->max_s = sSecs ? atoi(sSecs) : 3600;
+    pol->keep_bytes = (sKeep ? (uint64_t)atol(sKeep) : 0) * 1024 * 1024;
+    pol->keep_h = sKeepH ? atoi(sKeepH) : 0;
+
+    fprintf(stdout, "[CFG] SEG_DIR=%s SEG_MAX_MB=%llu SEG_MAX_S=%d SEG_KEEP_MB=%llu SEG_KEEP_H=%d\n",
+            pol->dir, (unsigned long long)(pol->max_bytes >> 20), pol->max_s,
+            (unsigned long long)(pol->keep_bytes >> 20), pol->keep_h);
+}
+
+static void seg_path(const struct SegmentIndex *idx, const char *name, char *buf, size_t n) {
+    snprintf(buf, n, "%s/%s", idx->pol.dir, name);
+}
+
+static int append_entry(struct SegmentIndex *idx, const struct SegmentEntry *ent) {
+    if (idx->n == idx->cap) {
+        size_t cap = idx->cap ? idx->cap * 2 : 64;
+        struct SegmentEntry *e = realloc(idx->e, cap * sizeof(*e));
+        if (!e) return -1;
+        idx->e = e;
+        idx->cap = cap;
+    }
+    idx->e[idx->n++] = *ent;
+    if (!ent->open) idx->total_bytes += ent->bytes;
+    return 0;
+}
+
+// Reescribe el manifiesto completo (tmp + rename): solo ocurre al abrir o cerrar segmentos
+static void write_manifest(struct SegmentIndex *idx) {
+    char path[SEG_DIR_MAX + 32], tmp[SEG_DIR_MAX + 32];
+    seg_path(idx, SEG_MANIFEST, path, sizeof(path));
+    seg_path(idx, SEG_MANIFEST ".tmp", tmp, sizeof(tmp));
+
+    FILE *f = fopen(tmp, "w");
+    if (!f) {
+        perror("Error escribiendo el manifiesto de segmentos");
+        return;
+    }
+    fprintf(f, "# nombre inicio_utc_ns bytes\n");
+    for (size_t i = 0; i < idx->n; i++) {
+        const struct SegmentEntry *e = &idx->e[i];
+        fprintf(f, "%s %lld %lld\n", e->name, (long long)e->start_utc_ns,
+                e->open ? -1ll : (long long)e->bytes);
+    }
+    fflush(f);
+    fdatasync(fileno(f));
+    fclose(f);
+    if (rename(tmp, path) < 0) perror("Error renombrando el manifiesto de segmentos");
+}
+
+// Borra los segmentos cerrados más antiguos; los abiertos se saltan sin detener la poda
+static void prune(struct SegmentIndex *idx) {
+    int64_t now = utc_now_ns();
+    size_t keep = 0;
+
+    for (size_t i = 0; i < idx->n; i++) {
+        const struct SegmentEntry *e = &idx->e[i];
+        int over_size = idx->pol.keep_bytes && idx->total_bytes > idx->pol.keep_bytes;
+        int over_age = idx->pol.keep_h && now - e->start_utc_ns > idx->pol.keep_h * 3600 * NS_PER_S;
+        if (e->open || (!over_size && !over_age)) {
+            if (keep != i) idx->e[keep] = *e;
+            keep++;
+            continue;
+        }
+
+        char path[SEG_DIR_MAX + SEG_NAME_MAX + 2];
+        seg_path(idx, e->name, path, sizeof(path));
+        if (unlink(path) < 0 && errno != ENOENT) perror("Error borrando segmento antiguo");
+        else printf("[INFO] Segmento eliminado por retención: %s\n", e->name);
+        idx->total_bytes -= e->bytes;
+        idx->pruned++;
+    }
+    idx->n = keep;
+}
+
+int segment_index_open(struct SegmentIndex *idx, const struct SegmentPolicy *pol) {
+    memset(idx, 0, sizeof(*idx));
+    idx->pol = *pol;
+    pthread_mutex_init(&idx->lock, NULL);
+
+    if (mkdir(pol->dir, 0755) < 0 && errno != EEXIST) {
+        perror("Error creando el directorio de segmentos");
+        return -1;
+    }
+
+    char path[SEG_DIR_MAX + 32];
+    seg_path(idx, SEG_MANIFEST, path, sizeof(path));
+    FILE *f = fopen(path, "r");
+    if (f) {
+        char line[SEG_NAME_MAX + 64];
+        while (fgets(line, sizeof(line), f)) {
+            struct SegmentEntry e = { 0 };
+            long long start, bytes;
+            if (line[0] == '#') continue;
+            if (sscanf(line, "%63s %lld %lld", e.name, &start, &bytes) != 3) continue;
+            e.start_utc_ns = start;
+            if (bytes < 0) {
+                // Segmento que quedó abierto en la ejecución anterior: su tamaño real
+                char seg[SEG_DIR_MAX + SEG_NAME_MAX + 2];
+                struct stat st;
+                seg_path(idx, e.name, seg, sizeof(seg));
+                if (stat(seg, &st) < 0) continue;
+                bytes = st.st_size;
+            }
+            e.bytes = (uint64_t)bytes;
+            if (append_entry(idx, &e) < 0) break;
+        }
+        fclose(f);
+    }
+    prune(idx);
+    write_manifest(idx);
+    printf("[INFO] Segmentos en %s: %zu (%llu MB)\n", pol->dir, idx->n,
+           (unsigned long long)(idx->total_bytes >> 20));
+    return 0;
+}
+
+int segment_open(struct SegmentIndex *idx, struct Segment *seg, const char *prefix, const char *ext) {
+    struct SegmentEntry e = { 0 };
+    char stamp[32], path[SEG_DIR_MAX + SEG_NAME_MAX + 2];
+    struct tm tm;
+
+    e.start_utc_ns = utc_now_ns();
+    time_t secs = (time_t)(e.start_utc_ns / NS_PER_S);
+    localtime_r(&secs, &tm);
+    strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", &tm);
+
+    // Dos rotaciones en el mismo segundo: sufijo _1, _2...
+    seg->fd = -1;
+    for (int k = 0; k < 100 && seg->fd < 0; k++) {
+        if (k == 0) snprintf(e.name, sizeof(e.name), "%s_%s.%s", prefix, stamp, ext);
+        else snprintf(e.name, sizeof(e.name), "%s_%s_%d.%s", prefix, stamp, k, ext);
+        seg_path(idx, e.name, path, sizeof(path));
+        seg->fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (seg->fd < 0 && errno != EEXIST) break;
+    }
+    if (seg->fd < 0) {
+        perror("Error creando segmento");
+        return -1;
+    }
+    memcpy(seg->name, e.name, sizeof(seg->name));
+    seg->bytes = 0;
+    seg->opened_ns = mono_now_ns();
+    seg->retry_ns = 0;
+    e.open = 1;
+
+    pthread_mutex_lock(&idx->lock);
+    append_entry(idx, &e);
+    write_manifest(idx);
+    pthread_mutex_unlock(&idx->lock);
+    printf("[INFO] Nuevo segmento: %s\n", path);
+    return 0;
+}
+
+int segment_due(const struct SegmentIndex *idx, const struct Segment *seg, uint64_t now_ns) {
+    if (now_ns < seg->retry_ns) return 0;
+    if (idx->pol.max_bytes && seg->bytes >= idx->pol.max_bytes) return 1;
+    return idx->pol.max_s > 0 && now_ns - seg->opened_ns >= (uint64_t)idx->pol.max_s * NS_PER_S;
+}
+
+int segment_rotate(struct SegmentIndex *idx, struct Segment *seg, const char *prefix, const char *ext) {
+    struct Segment next;
+
+    // El segmento actual sigue abierto hasta que exista el siguiente
+    if (segment_open(idx, &next, prefix, ext) < 0) {
+        seg->retry_ns = mono_now_ns() + SEG_RETRY_S * (uint64_t)NS_PER_S;
+        fprintf(stderr, "[WARN] Se sigue escribiendo en %s; nuevo intento en %d s\n", seg->name, SEG_RETRY_S);
+        return -1;
+    }
+    segment_close(idx, seg);
+    *seg = next;
+    return 0;
+}
+
+void segment_close(struct SegmentIndex *idx, struct Segment *seg) {
+    close(seg->fd);
+    seg->fd = -1;
+
+    pthread_mutex_lock(&idx->lock);
+    for (size_t i = idx->n; i-- > 0;) {
+        struct SegmentEntry *e = &idx->e[i];
+        if (e->open && strcmp(e->name, seg->name) == 0) {
+            e->open = 0;
+            e->bytes = seg->bytes;
+            idx->total_bytes += seg->bytes;
+            break;
+        }
+    }
+    prune(idx);
+    write_manifest(idx);
+    pthread_mutex_unlock(&idx->lock);
+}
+
+void segment_index_close(struct SegmentIndex *idx) {
+    pthread_mutex_destroy(&idx->lock);
+    free(idx->e);
+    idx->e = NULL;
+    idx->n = idx->cap = 0;
+}
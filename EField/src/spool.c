@@ -0,0 +1,271 @@
+/**
+ * @file spool.c
+ * @brief Disk-backed store-and-forward queue for outbound MQTT messages.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "capture.h"
+#include "spool.h"
+
+#define REC_HEADER 8    // longitud + CRC
+#define REC_META   4    // qos, retained, longitud del topic, reservado
+
+void spool_load_env(struct SpoolConfig *cfg) {
+    const char *sDir = getenv("SPOOL_DIR");
+    const char *sMax = getenv("SPOOL_MAX_MB");
+    const char *sSeg = getenv("SPOOL_SEG_KB");
+
+    snprintf(cfg->dir, sizeof(cfg->dir), "%s", sDir ? sDir : "spool");
+    cfg->max_bytes = (sMax ? (uint64_t)atol(sMax) : 64) * 1024 * 1024;
+    cfg->seg_bytes = (sSeg ? (uint64_t)atol(sSeg) : 1024) * 1024;
+    if (cfg->seg_bytes < 64 * 1024) cfg->seg_bytes = 64 * 1024;
+
+    fprintf(stdout, "[CFG] SPOOL_DIR=%s SPOOL_MAX_MB=%llu SPOOL_SEG_KB=%llu\n", cfg->dir,
+            (unsigned long long)(cfg->max_bytes >> 20), (unsigned long long)(cfg->seg_bytes >> 10));
+}
+
+static void seg_path(const struct Spool *sp, uint32_t seg, char *buf, size_t n) {
+    snprintf(buf, n, "%s/spool_%010u.log", sp->cfg.dir, seg);
+}
+
+static uint64_t seg_size(const struct Spool *sp, uint32_t seg) {
+    char path[SPOOL_DIR_MAX + 32];
+    struct stat st;
+    seg_path(sp, seg, path, sizeof(path));
+    return stat(path, &st) == 0 ? (uint64_t)st.st_size : 0;
+}
+
+static int open_writer(struct Spool *sp) {
+    char path[SPOOL_DIR_MAX + 32];
+    seg_path(sp, sp->last_seg, path, sizeof(path));
+    sp->wfd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (sp->wfd < 0) {
+        perror("Error abriendo segmento del spool");
+        return -1;
+    }
+    sp->woff = (uint64_t)lseek(sp->wfd, 0, SEEK_END);
+    return 0;
+}
+
+// Borra el segmento más antiguo (ya reproducido o descartado por presupuesto)
+static void remove_first(struct Spool *sp) {
+    char path[SPOOL_DIR_MAX + 32];
+
+    if (sp->rfd >= 0) {
+        close(sp->rfd);
+        sp->rfd = -1;
+    }
+    uint64_t size = seg_size(sp, sp->first_seg);
+    seg_path(sp, sp->first_seg, path, sizeof(path));
+    if (unlink(path) < 0 && errno != ENOENT) perror("Error borrando segmento del spool");
+    sp->total_bytes -= size < sp->total_bytes ? size : sp->total_bytes;
+    sp->first_seg++;
+    sp->roff = 0;
+}
+
+int spool_open(struct Spool *sp, const struct SpoolConfig *cfg) {
+    memset(sp, 0, sizeof(*sp));
+    sp->cfg = *cfg;
+    sp->wfd = sp->rfd = -1;
+    pthread_mutex_init(&sp->lock, NULL);
+    if (cfg->max_bytes == 0) return 0;
+
+    if (mkdir(cfg->dir, 0755) < 0 && errno != EEXIST) {
+        perror("Error creando el directorio del spool");
+        return -1;
+    }
+    // El directorio del spool solo contiene sus propios segmentos
+    DIR *d = opendir(cfg->dir);
+    if (!d) {
+        perror("Error leyendo el directorio del spool");
+        return -1;
+    }
+    int found = 0;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        unsigned int seg;
+        if (sscanf(de->d_name, "spool_%10u.log", &seg) != 1) continue;
+        if (!found || seg < sp->first_seg) sp->first_seg = seg;
+        if (!found || seg > sp->last_seg) sp->last_seg = seg;
+        found = 1;
+    }
+    closedir(d);
+
+    for (uint32_t s = sp->first_seg; found && s <= sp->last_seg; s++) sp->total_bytes += seg_size(sp, s);
+    if (open_writer(sp) < 0) return -1;
+    if (sp->total_bytes)
+        printf("[INFO] Spool MQTT: %llu bytes pendientes de la ejecución anterior\n",
+               (unsigned long long)sp->total_bytes);
+    return 0;
+}
+
+int spool_append(struct Spool *sp, const char *topic, const void *payload, int len, int qos, int retained) {
+    uint8_t hdr[REC_HEADER + REC_META];
+    size_t tlen = strlen(topic);
+
+    if (sp->cfg.max_bytes == 0 || tlen >= SPOOL_TOPIC_MAX || len < 0) return -1;
+
+    uint32_t body = (uint32_t)(REC_META + tlen + (size_t)len);
+    hdr[8] = (uint8_t)qos;
+    hdr[9] = (uint8_t)retained;
+    hdr[10] = (uint8_t)tlen;
+    hdr[11] = 0;
+    uint32_t crc = capture_crc32(0, hdr + REC_HEADER, REC_META);
+    crc = capture_crc32(crc, topic, tlen);
+    crc = capture_crc32(crc, payload, (size_t)len);
+    memcpy(hdr, &body, 4);
+    memcpy(hdr + 4, &crc, 4);
+
+    uint8_t rec[REC_HEADER + REC_META + SPOOL_TOPIC_MAX + SPOOL_PAYLOAD_MAX];
+    size_t rlen = sizeof(hdr) + tlen + (size_t)len;
+    if (rlen > sizeof(rec)) return -1;
+    memcpy(rec, hdr, sizeof(hdr));
+    memcpy(rec + sizeof(hdr), topic, tlen);
+    memcpy(rec + sizeof(hdr) + tlen, payload, (size_t)len);
+
+    pthread_mutex_lock(&sp->lock);
+    if (sp->woff > 0 && sp->woff + rlen > sp->cfg.seg_bytes) {
+        // Segmento lleno: se cierra y se empieza el siguiente
+        fdatasync(sp->wfd);
+        close(sp->wfd);
+        sp->last_seg++;
+        sp->dirty = 0;
+        if (open_writer(sp) < 0) {
+            pthread_mutex_unlock(&sp->lock);
+            return -1;
+        }
+    }
+    // Una sola write() por registro: un corte de luz deja como mucho el último incompleto
+    ssize_t n = write(sp->wfd, rec, rlen);
+    int rc = (n == (ssize_t)rlen) ? 0 : -1;
+    if (n > 0) {
+        sp->woff += (uint64_t)n;
+        sp->total_bytes += (uint64_t)n;
+        sp->dirty = 1;
+    }
+    if (rc == 0) sp->appended++;
+    else perror("Error escribiendo en el spool");
+
+    // Presupuesto de disco: se descartan segmentos enteros, los más antiguos primero
+    while (sp->total_bytes > sp->cfg.max_bytes && sp->first_seg < sp->last_seg) {
+        uint64_t size = seg_size(sp, sp->first_seg);
+        remove_first(sp);
+        sp->dropped_segs++;
+        sp->dropped_bytes += size;
+    }
+    pthread_mutex_unlock(&sp->lock);
+    return rc;
+}
+
+// Lee el siguiente registro del segmento en reproducción; 0 si se acabó o está dañado
+static int read_record(struct Spool *sp, char *topic, void *payload, int cap, int *len, int *qos, int *retained) {
+    uint8_t hdr[REC_HEADER + REC_META];
+    uint32_t body, crc;
+
+    if (pread(sp->rfd, hdr, sizeof(hdr), (off_t)sp->roff) != (ssize_t)sizeof(hdr)) return 0;
+    memcpy(&body, hdr, 4);
+    memcpy(&crc, hdr + 4, 4);
+    size_t tlen = hdr[10];
+    if (body < REC_META + tlen || tlen >= SPOOL_TOPIC_MAX) return 0;
+    int plen = (int)(body - REC_META - tlen);
+    if (plen > cap) return 0;
+
+    off_t off = (off_t)(sp->roff + sizeof(hdr));
+    if (pread(sp->rfd, topic, tlen, off) != (ssize_t)tlen) return 0;
+    if (pread(sp->rfd, payload, (size_t)plen, off + (off_t)tlen) != (ssize_t)plen) return 0;
+    uint32_t c = capture_crc32(0, hdr + REC_HEADER, REC_META);
+    c = capture_crc32(c, topic, tlen);
+    if (capture_crc32(c, payload, (size_t)plen) != crc) return 0;
+
+    topic[tlen] = '\0';
+    *len = plen;
+    *qos = hdr[8];
+    *retained = hdr[9];
+    sp->roff += REC_HEADER + body;
+    return 1;
+}
+
+// Todo reproducido: se vacía el segmento activo para no crecer sin fin ni repetirlo al reiniciar
+static void reset_if_drained(struct Spool *sp) {
+    if (sp->first_seg != sp->last_seg || sp->roff < sp->woff || sp->woff == 0) return;
+    close(sp->wfd);
+    remove_first(sp);
+    sp->last_seg = sp->first_seg;
+    sp->dirty = 0;
+    open_writer(sp);
+}
+
+int spool_next(struct Spool *sp, char *topic, void *payload, int cap, int *len, int *qos, int *retained) {
+    int got = 0;
+
+    if (sp->cfg.max_bytes == 0) return 0;
+    pthread_mutex_lock(&sp->lock);
+    while (!got) {
+        if (sp->first_seg == sp->last_seg && sp->roff >= sp->woff) {
+            reset_if_drained(sp);
+            break;
+        }
+        if (sp->rfd < 0) {
+            char path[SPOOL_DIR_MAX + 32];
+            seg_path(sp, sp->first_seg, path, sizeof(path));
+            sp->rfd = open(path, O_RDONLY | O_CLOEXEC);
+            if (sp->rfd < 0) {
+                if (sp->first_seg == sp->last_seg) break;
+                remove_first(sp);
+                continue;
+            }
+        }
+        got = read_record(sp, topic, payload, cap, len, qos, retained);
+        if (!got && sp->first_seg < sp->last_seg) {
+            remove_first(sp);       // Segmento terminado (o con cola dañada)
+        } else if (!got) {
+            sp->roff = sp->woff;    // Cola dañada en el segmento activo
+        }
+    }
+    if (got) {
+        sp->replayed++;
+        reset_if_drained(sp);
+    }
+    pthread_mutex_unlock(&sp->lock);
+    return got;
+}
+
+int spool_pending(struct Spool *sp) {
+    pthread_mutex_lock(&sp->lock);
+    int pending = sp->cfg.max_bytes && (sp->first_seg != sp->last_seg || sp->roff < sp->woff);
+    pthread_mutex_unlock(&sp->lock);
+    return pending;
+}
+
+void spool_sync(struct Spool *sp) {
+    pthread_mutex_lock(&sp->lock);
+    if (sp->dirty && sp->wfd >= 0) {
+        fdatasync(sp->wfd);
+        sp->dirty = 0;
+    }
+    pthread_mutex_unlock(&sp->lock);
+}
+
+void spool_print_stats(struct Spool *sp) {
+    pthread_mutex_lock(&sp->lock);
+    printf("[STAT] Spool MQTT: %llu bytes en disco, %lu guardados, %lu reenviados, "
+           "%lu segmentos descartados (%llu bytes)\n",
+           (unsigned long long)sp->total_bytes, sp->appended, sp->replayed,
+           sp->dropped_segs, (unsigned long long)sp->dropped_bytes);
+    pthread_mutex_unlock(&sp->lock);
+}
+
+void spool_close(struct Spool *sp) {
+    spool_sync(sp);
+    if (sp->rfd >= 0) close(sp->rfd);
+    if (sp->wfd >= 0) close(sp->wfd);
+    sp->rfd = sp->wfd = -1;
+    pthread_mutex_destroy(&sp->lock);
+}
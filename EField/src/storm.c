@@ -0,0 +1,239 @@
+/**
+ * @file storm.c
+ * @brief Storm-onset detector: sustained field drift and polarity reversal.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "storm.h"
+
+static const float level_conf[] = { 0.0f, 0.3f, 0.55f, 0.8f };
+
+void storm_load_env(struct StormConfig *cfg, float default_zero_v) {
+    const char *sOn = getenv("STORM");
+    const char *sScales = getenv("STORM_SCALES");
+    const char *sZero = getenv("STORM_ZERO_V");
+    const char *sMargin = getenv("STORM_REV_MARGIN_V");
+    const char *sRevHold = getenv("STORM_REV_HOLD_S");
+    const char *sSlope = getenv("STORM_SLOPE_V_MIN");
+    const char *sHold = getenv("STORM_HOLD_S");
+    const char *sReport = getenv("STORM_REPORT_S");
+    char list[64];
+
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->enabled = sOn ? atoi(sOn) != 0 : 0;
+    cfg->zero_v = sZero ? strtof(sZero, NULL) : default_zero_v;
+    cfg->rev_margin_v = sMargin ? strtof(sMargin, NULL) : 0.1f;
+    cfg->rev_hold_s = sRevHold ? atoi(sRevHold) : 10;
+    cfg->slope_v_min = sSlope ? strtof(sSlope, NULL) : 0.1f;
+    cfg->hold_s = sHold ? atoi(sHold) : 600;
+    cfg->report_s = sReport ? atoi(sReport) : 60;
+    if (cfg->rev_hold_s < 1) cfg->rev_hold_s = 1;
+    if (cfg->slope_v_min <= 0) cfg->slope_v_min = 0.1f;
+    if (cfg->report_s < 1) cfg->report_s = 1;
+
+    snprintf(list, sizeof(list), "%s", sScales ? sScales : "60,300,1200");
+    char *save = NULL;
+    for (char *tok = strtok_r(list, ",", &save); tok && cfg->nscales < STORM_MAX_SCALES;
+         tok = strtok_r(NULL, ",", &save)) {
+        int s = atoi(tok);
+        // Al menos un segundo por punto
+        if (s >= STORM_POINTS) cfg->scale_s[cfg->nscales++] = s;
+    }
+    if (cfg->nscales == 0) cfg->enabled = 0;
+
+    fprintf(stdout, "[CFG] STORM=%d STORM_SCALES=%s STORM_ZERO_V=%.3f STORM_REV_MARGIN_V=%.3f "
+            "STORM_REV_HOLD_S=%d STORM_SLOPE_V_MIN=%.3f STORM_HOLD_S=%d STORM_REPORT_S=%d\n",
+            cfg->enabled, sScales ? sScales : "60,300,1200", cfg->zero_v, cfg->rev_margin_v,
+            cfg->rev_hold_s, cfg->slope_v_min, cfg->hold_s, cfg->report_s);
+}
+
+void storm_init(struct StormDetector *d, const struct StormConfig *cfg) {
+    memset(d, 0, sizeof(*d));
+    d->reversal_s = -1;
+    d->below_since_s = -1;
+    for (int k = 0; k < cfg->nscales; k++) d->scales[k].res_s = cfg->scale_s[k] / STORM_POINTS;
+}
+
+const char *storm_level_name(int level) {
+    static const char *names[] = { "none", "watch", "warning", "alert" };
+    return level >= STORM_NONE && level <= STORM_ALERT ? names[level] : "?";
+}
+
+// k-ésimo menor de v[0..n-1] (quickselect, reordena v)
+static float select_k(float *v, int n, int k) {
+    int lo = 0, hi = n - 1;
+    while (lo < hi) {
+        float pivot = v[(lo + hi) / 2];
+        int i = lo, j = hi;
+        while (i <= j) {
+            while (v[i] < pivot) i++;
+            while (v[j] > pivot) j--;
+            if (i <= j) {
+                float tmp = v[i];
+                v[i++] = v[j];
+                v[j--] = tmp;
+            }
+        }
+        if (k <= j) hi = j;
+        else if (k >= i) lo = i;
+        else break;
+    }
+    return v[k];
+}
+
+static float median(float *v, int n) {
+    return select_k(v, n, n / 2);
+}
+
+// Pendiente de Theil-Sen y dispersión robusta de los residuos (1.4826 * MAD)
+static void theil_sen(struct StormScale *sc) {
+    float slopes[STORM_POINTS * (STORM_POINTS - 1) / 2];
+    float r[STORM_POINTS];
+    int m = 0;
+
+    for (int i = 0; i < sc->n; i++) {
+        for (int j = i + 1; j < sc->n; j++) {
+            double dt = sc->t[j] - sc->t[i];
+            if (dt != 0) slopes[m++] = (float)((sc->y[j] - sc->y[i]) / dt);
+        }
+    }
+    if (m == 0) return;
+    sc->slope = median(slopes, m);
+    for (int i = 0; i < sc->n; i++) r[i] = sc->y[i] - sc->slope * (float)sc->t[i];
+    float b = median(r, sc->n);
+    for (int i = 0; i < sc->n; i++) r[i] = fabsf(sc->y[i] - (b + sc->slope * (float)sc->t[i]));
+    sc->sigma = 1.4826f * median(r, sc->n);
+}
+
+static void scale_add(struct StormScale *sc, int64_t sec, double t, float mean) {
+    int64_t bucket = sec / sc->res_s;
+
+    if (sc->acc_n && bucket != sc->bucket) {
+        int i = (sc->head + sc->n) % STORM_POINTS;
+        if (sc->n == STORM_POINTS) {
+            i = sc->head;
+            sc->head = (sc->head + 1) % STORM_POINTS;
+        } else {
+            sc->n++;
+        }
+        sc->t[i] = t - sc->res_s / 2.0;
+        sc->y[i] = (float)(sc->acc / sc->acc_n);
+        sc->acc = 0;
+        sc->acc_n = 0;
+        if (sc->n >= STORM_POINTS / 4) theil_sen(sc);
+    }
+    sc->bucket = bucket;
+    sc->acc += mean;
+    sc->acc_n++;
+}
+
+static float clamp01(float x) {
+    return x < 0 ? 0 : x > 1 ? 1 : x;
+}
+
+static float confidence(const struct StormDetector *d, const struct StormConfig *cfg, int64_t sec) {
+    const struct StormScale *longest = NULL;
+    float drift = 0;
+    int valid = 0;
+
+    for (int k = cfg->nscales - 1; k >= 0 && !longest; k--) {
+        if (d->scales[k].n >= STORM_POINTS / 4) longest = &d->scales[k];
+    }
+    for (int k = 0; k < cfg->nscales && longest; k++) {
+        const struct StormScale *sc = &d->scales[k];
+        if (sc->n < STORM_POINTS / 4) continue;
+        double span = sc->t[(sc->head + sc->n - 1) % STORM_POINTS] - sc->t[sc->head];
+        float mag = clamp01(fabsf(sc->slope) * 60 / cfg->slope_v_min);
+        // Cambio a lo largo de la ventana frente al ruido: z = 3 ya es claro
+        float z = clamp01(fabsf(sc->slope) * (float)span / (3 * sc->sigma + 1e-6f));
+        float agree = (sc->slope > 0) == (longest->slope > 0) ? 1.0f : 0.5f;
+        drift += mag * z * agree;
+        valid++;
+    }
+    if (valid) drift /= valid;
+
+    float rev = 0;
+    if (d->reversal_s >= 0 && cfg->hold_s > 0)
+        rev = clamp01(1 - (float)(sec - d->reversal_s) / (float)cfg->hold_s);
+    return clamp01(0.7f * drift + 0.5f * rev);
+}
+
+// Cierra el segundo acumulado: escalas, polaridad, confianza y nivel
+static int close_second(struct StormDetector *d, const struct StormConfig *cfg, struct StormReport *rep) {
+    int64_t sec = d->sec;
+    float mean = (float)(d->sec_acc / d->sec_n);
+    double t = (double)(sec - d->origin_s) + 1;
+
+    d->sec_acc = 0;
+    d->sec_n = 0;
+    for (int k = 0; k < cfg->nscales; k++) scale_add(&d->scales[k], sec, t, mean);
+
+    int side = mean > cfg->zero_v + cfg->rev_margin_v ? 1 : mean < cfg->zero_v - cfg->rev_margin_v ? -1 : 0;
+    int reversal = 0;
+    if (d->polarity == 0) {
+        d->polarity = side;
+    } else if (side == -d->polarity) {
+        if (++d->opposite_s >= cfg->rev_hold_s) {
+            d->polarity = side;
+            d->opposite_s = 0;
+            d->reversal_s = sec;
+            reversal = 1;
+        }
+    } else if (side == d->polarity) {
+        d->opposite_s = 0;
+    }
+
+    float conf = confidence(d, cfg, sec);
+    int target = STORM_NONE;
+    while (target < STORM_ALERT && conf >= level_conf[target + 1]) target++;
+
+    int changed = 0;
+    if (target > d->level) {
+        d->level = target;
+        d->below_since_s = -1;
+        changed = 1;
+    } else if (target < d->level) {
+        if (d->below_since_s < 0) d->below_since_s = sec;
+        if (sec - d->below_since_s >= cfg->hold_s) {
+            d->level--;
+            d->below_since_s = d->level > target ? sec : -1;
+            changed = 1;
+        }
+    } else {
+        d->below_since_s = -1;
+    }
+
+    if (!changed && !reversal && sec - d->last_report_s < cfg->report_s) return 0;
+    d->last_report_s = sec;
+    memset(rep, 0, sizeof(*rep));
+    rep->t_ns = (uint64_t)(sec + 1) * 1000000000ull;
+    rep->level = d->level;
+    rep->level_changed = changed;
+    rep->reversal = reversal;
+    rep->polarity = d->polarity;
+    rep->confidence = conf;
+    rep->nscales = cfg->nscales;
+    for (int k = 0; k < cfg->nscales; k++) rep->slope_v_min[k] = d->scales[k].slope * 60;
+    return 1;
+}
+
+int storm_add(struct StormDetector *d, const struct StormConfig *cfg, uint64_t t_ns, float v,
+              struct StormReport *rep) {
+    int64_t sec = (int64_t)(t_ns / 1000000000ull);
+    int ready = 0;
+
+    if (!d->started) {
+        d->started = 1;
+        d->origin_s = d->sec = d->last_report_s = sec;
+    }
+    if (sec > d->sec && d->sec_n) ready = close_second(d, cfg, rep);
+    if (sec >= d->sec) {
+        d->sec = sec;
+        d->sec_acc += v;
+        d->sec_n++;
+    }
+    return ready;
+}
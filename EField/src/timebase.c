@@ -0,0 +1,45 @@
+/**
+ * @file timebase.c
+ * @brief Monotonic sample timestamps and wall-clock anchors.
+ */
+
+#include <stdio.h>
+#include "timebase.h"
+
+uint64_t mono_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return timespec_to_ns(&ts);
+}
+
+int64_t utc_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)timespec_to_ns(&ts);
+}
+
+void time_anchor_capture(struct TimeAnchor *a) {
+    struct timespec m0, rt, m1;
+
+    clock_gettime(CLOCK_MONOTONIC, &m0);
+    clock_gettime(CLOCK_REALTIME, &rt);
+    clock_gettime(CLOCK_MONOTONIC, &m1);
+    uint64_t t0 = timespec_to_ns(&m0);
+    a->mono_ns = t0 + (timespec_to_ns(&m1) - t0) / 2;
+    a->utc_ns = (int64_t)timespec_to_ns(&rt);
+}
+
+int64_t time_anchor_to_utc_ns(const struct TimeAnchor *a, uint64_t mono_ns) {
+    return a->utc_ns + ((int64_t)mono_ns - (int64_t)a->mono_ns);
+}
+
+void time_format(int64_t utc_ns, char *buf, size_t n) {
+    time_t secs = (time_t)(utc_ns / 1000000000ll);
+    int ms = (int)((utc_ns % 1000000000ll) / 1000000ll);
+    struct tm tm;
+    char base[24];
+
+    localtime_r(&secs, &tm);
+    strftime(base, sizeof(base), "%Y-%m-%d %H:%M:%S", &tm);
+    snprintf(buf, n, "%s.%03d", base, ms);
+}
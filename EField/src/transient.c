@@ -0,0 +1,160 @@
+/**
+ * @file transient.c
+ * @brief Fast-transient (lightning field-step) detector at the full sample rate.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "transient.h"
+
+#define SIGMA_PER_MEAN_ABS 1.2533f   // sqrt(pi/2): sigma de una gaussiana a partir de E|d|
+#define WARMUP_DIFFS       64        // Diferencias antes de fiarse del ruido estimado
+#define STEP_KEEP          0.5f      // Fracción del salto que debe quedarse para ser escalón
+
+void transient_load_env(struct TransientConfig *cfg) {
+    const char *sOn = getenv("TRANSIENT");
+    const char *sK = getenv("TRANSIENT_K");
+    const char *sMin = getenv("TRANSIENT_MIN_V");
+    const char *sWin = getenv("TRANSIENT_WIN");
+    const char *sTau = getenv("TRANSIENT_TAU");
+    const char *sDead = getenv("TRANSIENT_DEAD_MS");
+    const char *sGap = getenv("TRANSIENT_GAP_MS");
+    long tau = sTau ? atol(sTau) : 1000;
+    long dead_ms = sDead ? atol(sDead) : 20;
+    long gap_ms = sGap ? atol(sGap) : 1000;
+
+    cfg->enabled = sOn ? atoi(sOn) != 0 : 0;
+    cfg->k = sK ? strtof(sK, NULL) : 8.0f;
+    cfg->min_v = sMin ? strtof(sMin, NULL) : 0.05f;
+    cfg->win = sWin ? atoi(sWin) : 4;
+    if (cfg->k <= 0) cfg->k = 8.0f;
+    if (cfg->min_v < 0) cfg->min_v = 0;
+    if (cfg->win < 1) cfg->win = 1;
+    if (cfg->win > TRANSIENT_WIN_MAX) cfg->win = TRANSIENT_WIN_MAX;
+    if (tau < 1) tau = 1;
+    cfg->alpha = 1.0f / (float)tau;
+    cfg->dead_ns = (uint64_t)(dead_ms > 0 ? dead_ms : 0) * 1000000ull;
+    cfg->gap_ns = (uint64_t)(gap_ms > 0 ? gap_ms : 1) * 1000000ull;
+
+    fprintf(stdout, "[CFG] TRANSIENT=%d TRANSIENT_K=%.1f TRANSIENT_MIN_V=%.3f TRANSIENT_WIN=%d "
+            "TRANSIENT_TAU=%ld TRANSIENT_DEAD_MS=%ld TRANSIENT_GAP_MS=%ld\n",
+            cfg->enabled, cfg->k, cfg->min_v, cfg->win, tau, dead_ms, gap_ms);
+}
+
+static void push_pre(struct TransientDetector *d, const struct TransientConfig *cfg, int16_t raw) {
+    d->pre[d->head] = raw;
+    d->head = (d->head + 1) % cfg->win;
+    if (d->npre < cfg->win) d->npre++;
+}
+
+static float pre_mean(const struct TransientDetector *d) {
+    int32_t acc = 0;
+    for (int i = 0; i < d->npre; i++) acc += d->pre[i];
+    return (float)acc / (float)d->npre;
+}
+
+// Cierra la ventana posterior: escalón si el filtro adaptado conserva el salto, pico si no
+static int decide(struct TransientDetector *d, const struct TransientConfig *cfg, struct TransientEvent *ev) {
+    float amp = (float)d->post_acc / (float)cfg->win - d->cand_level;
+    float jump = (float)d->cand_jump;
+
+    if (fabsf(amp) < d->min_counts || amp * jump <= 0 || fabsf(amp) < STEP_KEEP * fabsf(jump)) {
+        d->spikes++;
+        return 0;
+    }
+    *ev = d->cand;
+    ev->amplitude_v = amp * d->lsb;
+    ev->jump_v = jump * d->lsb;
+    ev->noise_v = d->cand_noise * d->lsb;
+    ev->level_v = d->cand_level * d->lsb;
+    ev->sign = amp > 0 ? 1 : -1;
+    d->steps++;
+    return 1;
+}
+
+int transient_update(struct TransientDetector *d, const struct TransientConfig *cfg,
+                     const struct AdcSample *s, struct TransientEvent *ev) {
+    int16_t raw = s->raw;
+    int ret = 0;
+
+    // Cambio de ganancia o hueco: las ventanas ya no comparan lo mismo
+    if (!d->started || s->pga != d->pga || s->t_ns - d->prev_ns > cfg->gap_ns) {
+        if (!d->started || s->pga != d->pga) {
+            // El ruido aprendido se reescala a las cuentas de la nueva ganancia
+            float lsb = sample_lsb(s->pga);
+            if (d->started) d->mean_abs_d *= d->lsb / lsb;
+            d->lsb = lsb;
+            d->min_counts = cfg->min_v / lsb;
+        }
+        d->started = 1;
+        d->pga = s->pga;
+        d->npre = d->head = 0;
+        d->post = 0;
+        d->prev_raw = raw;
+        d->prev_ns = s->t_ns;
+        push_pre(d, cfg, raw);
+        return 0;
+    }
+
+    int32_t dv = raw - d->prev_raw;
+    float adv = (float)abs(dv);
+    float sigma = d->mean_abs_d * SIGMA_PER_MEAN_ABS;
+    float thr = cfg->k * sigma > d->min_counts ? cfg->k * sigma : d->min_counts;
+
+    if (d->post) {
+        // Escalón repartido entre dos conversiones: el salto es el mayor de los dos
+        if (dv != 0 && (dv > 0) == (d->cand_jump > 0) && abs(dv) > abs(d->cand_jump)) d->cand_jump = dv;
+        d->post_acc += raw;
+        if (--d->post == 0) ret = decide(d, cfg, ev);
+    } else if (d->warm >= WARMUP_DIFFS && s->t_ns >= d->dead_until_ns && adv > thr) {
+        // Candidato: la muestra del salto no entra en ninguna de las dos ventanas
+        d->cand = (struct TransientEvent) {
+            .t_ns = s->t_ns, .prev_ns = d->prev_ns,
+            .device = s->device, .channel = s->channel, .pga = s->pga,
+        };
+        d->cand_jump = dv;
+        d->cand_level = pre_mean(d);
+        d->cand_noise = sigma;
+        d->post = cfg->win;
+        d->post_acc = 0;
+        d->dead_until_ns = s->t_ns + cfg->dead_ns;
+        d->prev_raw = raw;
+        d->prev_ns = s->t_ns;
+        return 0;
+    }
+
+    // Ruido de la primera diferencia, recortado al umbral para que los escalones no lo inflen
+    float ad = adv < thr ? adv : thr;
+    if (d->warm == 0) d->mean_abs_d = ad;
+    else d->mean_abs_d += cfg->alpha * (ad - d->mean_abs_d);
+    if (d->warm < UINT32_MAX) d->warm++;
+
+    push_pre(d, cfg, raw);
+    d->prev_raw = raw;
+    d->prev_ns = s->t_ns;
+    return ret;
+}
+
+int transient_queue_push(struct TransientQueue *q, const struct TransientEvent *ev) {
+    unsigned int head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+
+    if (head - tail >= TRANSIENT_QUEUE_SLOTS) {
+        q->dropped++;
+        return -1;
+    }
+    q->slots[head & (TRANSIENT_QUEUE_SLOTS - 1)] = *ev;
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return 0;
+}
+
+int transient_queue_pop(struct TransientQueue *q, struct TransientEvent *ev) {
+    unsigned int tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&q->head, memory_order_acquire);
+
+    if (head == tail) return 0;
+    *ev = q->slots[tail & (TRANSIENT_QUEUE_SLOTS - 1)];
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return 1;
+}
@@ -0,0 +1,121 @@
+/**
+ * @file winstats.c
+ * @brief Sliding-window statistics of one sample stream.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "winstats.h"
+
+void stats_load_env(struct StatsConfig *cfg) {
+    const char *sWin = getenv("STATS_WINDOWS");
+    const char *sHop = getenv("STATS_HOP_MS");
+    long hop_ms = sHop ? atol(sHop) : 1000;
+    char list[64];
+
+    memset(cfg, 0, sizeof(*cfg));
+    if (hop_ms < 10) hop_ms = 10;
+    cfg->hop_ns = (uint64_t)hop_ms * 1000000ull;
+    snprintf(list, sizeof(list), "%s", sWin ? sWin : "");
+
+    char *save = NULL;
+    for (char *tok = strtok_r(list, ",", &save); tok && cfg->nwin < STATS_MAX_WINDOWS;
+         tok = strtok_r(NULL, ",", &save)) {
+        double secs = atof(tok);
+        long buckets = lround(secs * 1000 / hop_ms);
+        if (buckets < 1) continue;
+        if (buckets > STATS_MAX_BUCKETS) {
+            fprintf(stderr, "[WARN] Ventana de %.1f s demasiado larga para STATS_HOP_MS=%ld, se limita a %d s\n",
+                    secs, hop_ms, (int)(STATS_MAX_BUCKETS * hop_ms / 1000));
+            buckets = STATS_MAX_BUCKETS;
+        }
+        cfg->win_buckets[cfg->nwin++] = (int)buckets;
+        // Un hueco más que la ventana más larga: el cubo abierto no pisa al más antiguo cerrado
+        if (buckets + 1 > cfg->ring) cfg->ring = (int)buckets + 1;
+    }
+    fprintf(stdout, "[CFG] STATS_WINDOWS=%s STATS_HOP_MS=%ld (%d ventanas)\n",
+            sWin ? sWin : "", hop_ms, cfg->nwin);
+}
+
+static void bucket_clear(struct StatsBucket *b) {
+    memset(b, 0, sizeof(*b));
+}
+
+// Avanza hasta el cubo idx vaciando los intermedios; 1 si se ha cerrado alguno
+static int advance(struct WinStats *ws, const struct StatsConfig *cfg, uint64_t idx) {
+    if (!ws->started) {
+        ws->started = 1;
+        ws->cur = idx;
+        bucket_clear(&ws->ring[idx % (uint64_t)cfg->ring]);
+        return 0;
+    }
+    if (idx <= ws->cur) return 0;
+    uint64_t from = idx - ws->cur > (uint64_t)cfg->ring ? idx - (uint64_t)cfg->ring : ws->cur;
+    for (uint64_t k = from + 1; k <= idx; k++) bucket_clear(&ws->ring[k % (uint64_t)cfg->ring]);
+    ws->cur = idx;
+    return 1;
+}
+
+int stats_add(struct WinStats *ws, const struct StatsConfig *cfg, uint64_t t_ns, float v) {
+    uint64_t idx = t_ns / cfg->hop_ns;
+    int closed = advance(ws, cfg, idx);
+
+    // Una muestra retrasada cuenta en su cubo si aún está en el anillo
+    if (idx + (uint64_t)cfg->ring <= ws->cur) return closed;
+    struct StatsBucket *b = &ws->ring[idx % (uint64_t)cfg->ring];
+    double u = (double)(t_ns - idx * cfg->hop_ns) * 1e-9;
+    if (b->n == 0 || v < b->min) b->min = v;
+    if (b->n == 0 || v > b->max) b->max = v;
+    b->n++;
+    b->sv += v;
+    b->svv += (double)v * v;
+    b->su += u;
+    b->suu += u * u;
+    b->suv += u * v;
+    return closed;
+}
+
+int stats_roll(struct WinStats *ws, const struct StatsConfig *cfg, uint64_t now_ns) {
+    if (!ws->started || now_ns < STATS_LATE_NS) return 0;
+    return advance(ws, cfg, (now_ns - STATS_LATE_NS) / cfg->hop_ns);
+}
+
+uint32_t stats_summary(const struct WinStats *ws, const struct StatsConfig *cfg, int w, struct StatsSummary *out) {
+    int nb = cfg->win_buckets[w];
+    double n = 0, sv = 0, svv = 0, st = 0, stt = 0, stv = 0;
+    float vmin = 0, vmax = 0;
+    uint64_t end = ws->cur;   // El cubo abierto no entra
+
+    memset(out, 0, sizeof(*out));
+    out->t_end_ns = end * cfg->hop_ns;
+    out->window_ms = (uint32_t)((uint64_t)nb * cfg->hop_ns / 1000000ull);
+    for (int i = 1; i <= nb && (uint64_t)i <= end; i++) {
+        const struct StatsBucket *b = &ws->ring[(end - (uint64_t)i) % (uint64_t)cfg->ring];
+        if (!b->n) continue;
+        // Tiempo relativo al inicio de la ventana: t = u + d
+        double d = (double)(nb - i) * (double)cfg->hop_ns * 1e-9;
+        if (n == 0 || b->min < vmin) vmin = b->min;
+        if (n == 0 || b->max > vmax) vmax = b->max;
+        n += b->n;
+        sv += b->sv;
+        svv += b->svv;
+        st += b->su + b->n * d;
+        stt += b->suu + 2 * d * b->su + b->n * d * d;
+        stv += b->suv + d * b->sv;
+    }
+    if (n == 0) return 0;
+
+    double mean = sv / n;
+    double var = svv / n - mean * mean;
+    double den = n * stt - st * st;
+    out->n = (uint32_t)n;
+    out->mean = (float)mean;
+    out->rms = (float)sqrt(svv / n);
+    out->min = vmin;
+    out->max = vmax;
+    out->std = (float)sqrt(var > 0 ? var : 0);
+    out->slope = den > 0 ? (float)((n * stv - st * sv) / den) : 0;
+    return out->n;
+}
@@ -0,0 +1,119 @@
+/**
+ * @file efield_decode.c
+ * @brief Prints a binary MQTT payload (MQTT_FORMAT=bin) in readable form.
+ *
+ * Reads one message from a file or stdin, e.g.
+ *   mosquitto_sub -t ThunderSystem/eField/reading -C 1 -N > msg.bin
+ *   efield_decode msg.bin
+ *
+ * Subscribers that want to decode in their own code only need payload.h
+ * and payload.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "payload.h"
+
+int main(int argc, char **argv) {
+    static uint8_t msg[PAYLOAD_MAX_SIZE];
+    static struct PayloadMessage m;
+
+    FILE *in = argc > 1 ? fopen(argv[1], "rb") : stdin;
+    if (!in) {
+        perror("Error abriendo el mensaje");
+        return EXIT_FAILURE;
+    }
+    size_t len = fread(msg, 1, sizeof(msg), in);
+    if (in != stdin) fclose(in);
+
+    if (payload_decode(msg, len, &m) < 0) {
+        fprintf(stderr, "Mensaje no válido (%zu bytes)\n", len);
+        return EXIT_FAILURE;
+    }
+    switch (m.type) {
+    case PAYLOAD_READINGS: {
+        const struct PayloadReadings *r = &m.u.readings;
+        printf("# lecturas seq=%" PRIu32 " adc=%u canal=%u n=%u dt_ns=%" PRIu32 " lsb=%.9g V (%zu bytes%s)\n",
+               r->seq, r->device, r->channel, r->n, r->dt_ns, r->lsb_volts, len,
+               (msg[3] & PAYLOAD_FLAG_LZ) ? ", LZ" : "");
+        printf("t_utc_ns,raw,voltaje\n");
+        for (uint16_t i = 0; i < r->n; i++) {
+            printf("%" PRId64 ",%d,%.6f\n", r->t0_utc_ns + (int64_t)i * r->dt_ns, r->raw[i],
+                   r->raw[i] * r->lsb_volts);
+        }
+        break;
+    }
+    case PAYLOAD_ALERT: {
+        static const char *phases[] = { "?", "inicio", "actualizacion", "fin" };
+        const struct PayloadAlert *a = &m.u.alert;
+        printf("# alerta %s t_utc_ns=%" PRId64 " adc=%u canal=%u raw=%d v=%.5f trigger=%s\n",
+               phases[a->phase <= PAYLOAD_PHASE_END ? a->phase : 0], a->t_utc_ns, a->device, a->channel,
+               a->raw, a->raw * a->lsb_volts, a->trigger == PAYLOAD_TRIGGER_HIGH ? "HIGH" : "LOW");
+        printf("# inicio_utc_ns=%" PRId64 " duracion_ms=%" PRIu32 " pico=%.5f V area=%.6f V*s\n",
+               a->start_utc_ns, a->duration_ms, a->peak_v, a->area_vs);
+        break;
+    }
+    case PAYLOAD_ANOMALY: {
+        static const char *phases[] = { "?", "inicio", "actualizacion", "fin" };
+        const struct PayloadAnomaly *an = &m.u.anomaly;
+        printf("# anomalia %s t_utc_ns=%" PRId64 " adc=%u canal=%u v=%.5f trigger=%s\n",
+               phases[an->phase <= PAYLOAD_PHASE_END ? an->phase : 0], an->t_utc_ns, an->device, an->channel,
+               an->voltage, an->trigger == PAYLOAD_TRIGGER_HIGH ? "HIGH" : "LOW");
+        printf("# inicio_utc_ns=%" PRId64 " duracion_ms=%" PRIu32 " pico=%.5f V z=%.1f\n",
+               an->start_utc_ns, an->duration_ms, an->peak_v, an->z);
+        printf("# mediana=%.5f V sigma=%.5f V umbrales=[%.5f, %.5f] V\n",
+               an->median_v, an->sigma_v, an->thr_low, an->thr_high);
+        break;
+    }
+    case PAYLOAD_CAPTURE: {
+        const struct PayloadCapture *pc = &m.u.capture;
+        printf("# captura %s disparo_utc_ns=%" PRId64 " origen=%s adc=%u canal=%u valor=%.5f disparos=%u\n",
+               pc->name, pc->trigger_utc_ns, pc->source == 2 ? "transitorio" : "excursion", pc->device,
+               pc->channel, pc->value, pc->triggers);
+        printf("# inicio_utc_ns=%" PRId64 " duracion_ms=%" PRIu32 " muestras=%" PRIu32 " bytes=%" PRIu32 "\n",
+               pc->start_utc_ns, pc->duration_ms, pc->samples, pc->bytes);
+        break;
+    }
+    case PAYLOAD_SERIES: {
+        const struct PayloadSeries *sr = &m.u.series;
+        printf("# filtrado seq=%" PRIu32 " adc=%u canal=%u n=%u dt_ns=%" PRIu32 " (%zu bytes)\n",
+               sr->seq, sr->device, sr->channel, sr->n, sr->dt_ns, len);
+        printf("t_utc_ns,voltaje\n");
+        for (uint16_t i = 0; i < sr->n; i++)
+            printf("%" PRId64 ",%.7f\n", sr->t0_utc_ns + (int64_t)i * sr->dt_ns, sr->v[i]);
+        break;
+    }
+    case PAYLOAD_STATS: {
+        const struct PayloadStats *st = &m.u.stats;
+        printf("# estadisticas t_fin_utc_ns=%" PRId64 " ventana_ms=%" PRIu32 " adc=%u canal=%u n=%" PRIu32 "\n",
+               st->t_end_utc_ns, st->window_ms, st->device, st->channel, st->n);
+        printf("media=%.6f rms=%.6f min=%.6f max=%.6f std=%.6f pendiente=%.6f V/s\n",
+               st->mean, st->rms, st->min, st->max, st->std, st->slope);
+        break;
+    }
+    case PAYLOAD_STORM: {
+        static const char *levels[] = { "none", "watch", "warning", "alert" };
+        const struct PayloadStorm *st = &m.u.storm;
+        printf("# tormenta t_utc_ns=%" PRId64 " adc=%u canal=%u nivel=%s%s confianza=%.2f polaridad=%d%s\n",
+               st->t_utc_ns, st->device, st->channel, st->level <= 3 ? levels[st->level] : "?",
+               (st->flags & PAYLOAD_STORM_CHANGED) ? " (cambio)" : "", st->confidence, st->polarity,
+               (st->flags & PAYLOAD_STORM_REVERSAL) ? " INVERSION" : "");
+        for (int k = 0; k < st->nscales; k++) printf("pendiente[%d]=%.4f V/min\n", k, st->slope_v_min[k]);
+        break;
+    }
+    case PAYLOAD_TRANSIENT: {
+        const struct PayloadTransient *tr = &m.u.transient;
+        printf("# transitorio t_utc_ns=%" PRId64 " hueco_us=%u adc=%u canal=%u pga=%u\n",
+               tr->t_utc_ns, tr->gap_us, tr->device, tr->channel, tr->pga);
+        printf("amplitud=%+.5f V salto=%+.5f V ruido=%.5f V nivel=%.5f V\n",
+               tr->amplitude_v, tr->jump_v, tr->noise_v, tr->level_v);
+        break;
+    }
+    case PAYLOAD_THRESHOLDS:
+        printf("# umbrales v_high_thr=%.5f v_low_thr=%.5f\n",
+               m.u.thresholds.v_high_thr, m.u.thresholds.v_low_thr);
+        break;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,127 @@
+/**
+ * @file efield_dspbench.c
+ * @brief Throughput of each DSP kernel (dsp.h) in samples per second.
+ *
+ * Runs every kernel over a synthetic 860 SPS signal (DC + 50 Hz + noise)
+ * for about BENCH_SECONDS and prints samples/s and the real-time margin at
+ * 860 SPS. Build it for the target to measure the NEON kernels:
+ *   make bench            (cross-compiled, copy build/efield_dspbench to the Pi)
+ *   make bench BENCH_CC=gcc
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "dsp.h"
+
+#define BENCH_FS      860.0
+#define BENCH_SECONDS 0.5
+#define BENCH_BLOCK   DSP_BLOCK_MAX
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int16_t counts[BENCH_BLOCK];
+static float x[BENCH_BLOCK], y[BENCH_BLOCK];
+static uint64_t t_in[BENCH_BLOCK], t_out[BENCH_BLOCK];
+static volatile float sink;   // Evita que el compilador elimine el trabajo
+
+static void report(const char *name, double samples, double secs) {
+    double sps = samples / secs;
+    printf("%-28s %12.0f muestras/s  %8.0fx tiempo real a %.0f SPS\n", name, sps, sps / BENCH_FS, BENCH_FS);
+}
+
+static void bench_biquad(const char *name, struct DspBiquad *bq) {
+    double samples = 0, t0 = now_s(), t;
+    do {
+        for (int k = 0; k < 64; k++) {
+            dsp_biquad_process(bq, x, BENCH_BLOCK);
+            samples += BENCH_BLOCK;
+        }
+        t = now_s() - t0;
+    } while (t < BENCH_SECONDS);
+    sink = x[0];
+    report(name, samples, t);
+}
+
+static void bench_counts(const char *name) {
+    double samples = 0, t0 = now_s(), t;
+    do {
+        for (int k = 0; k < 64; k++) {
+            dsp_from_counts(y, counts, BENCH_BLOCK);
+            samples += BENCH_BLOCK;
+        }
+        t = now_s() - t0;
+    } while (t < BENCH_SECONDS);
+    sink = y[0];
+    report(name, samples, t);
+}
+
+static void bench_fir(const char *name, int taps, int decim) {
+    static struct DspFir fir;
+    float h[DSP_FIR_MAX_TAPS];
+    double samples = 0, t0 = now_s(), t;
+
+    dsp_design_lowpass(h, taps, 0.4 / decim);
+    dsp_fir_init(&fir, h, taps, decim);
+    do {
+        for (int k = 0; k < 64; k++) {
+            sink = (float)dsp_fir_process(&fir, x, BENCH_BLOCK, y, NULL);
+            samples += BENCH_BLOCK;
+        }
+        t = now_s() - t0;
+    } while (t < BENCH_SECONDS);
+    report(name, samples, t);
+}
+
+static void bench_chain(const char *name, const struct DspConfig *cfg) {
+    static struct DspChain ch;
+    double samples = 0, t0 = now_s(), t;
+
+    dsp_chain_init(&ch, cfg);
+    do {
+        for (int k = 0; k < 64; k++) {
+            sink = (float)dsp_chain_process(&ch, counts, t_in, BENCH_BLOCK, y, t_out);
+            samples += BENCH_BLOCK;
+        }
+        t = now_s() - t0;
+    } while (t < BENCH_SECONDS);
+    report(name, samples, t);
+}
+
+int main(void) {
+    char name[64];
+    struct DspBiquad bq;
+    struct DspConfig cfg = { 1, BENCH_FS, 8, 64, 0.4 * BENCH_FS / 8, 0, 50, 10 };
+
+    for (int i = 0; i < BENCH_BLOCK; i++) {
+        x[i] = 1.0f + 0.1f * (float)sin(2 * M_PI * 50 * i / BENCH_FS) + 0.001f * (float)(rand() % 1000) / 1000;
+        counts[i] = (int16_t)lrintf(x[i] * 32768 / 4.096f);   // Mismo nivel a ±4.096 V
+        t_in[i] = (uint64_t)(i * 1e9 / BENCH_FS);
+    }
+    printf("Kernels DSP (%s), bloques de %d muestras\n",
+#if defined(__aarch64__) && defined(__ARM_NEON)
+           "NEON",
+#else
+           "escalar",
+#endif
+           BENCH_BLOCK);
+
+    bench_counts("cuentas int16 -> float");
+    dsp_biquad_notch(&bq, BENCH_FS, 50, 10);
+    bench_biquad("biquad notch 50 Hz", &bq);
+    dsp_biquad_lowpass(&bq, BENCH_FS, 40, M_SQRT1_2);
+    bench_biquad("biquad paso bajo", &bq);
+    for (int taps = 16; taps <= 256; taps *= 4) {
+        snprintf(name, sizeof(name), "FIR %d taps", taps);
+        bench_fir(name, taps, 1);
+        snprintf(name, sizeof(name), "FIR %d taps diezmado /8", taps);
+        bench_fir(name, taps, 8);
+    }
+    bench_chain("cadena notch + FIR 64 /8", &cfg);
+    return EXIT_SUCCESS;
+}